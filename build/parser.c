@@ -0,0 +1,2419 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison implementation for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* C LALR(1) parser skeleton written by Richard Stallman, by
+   simplifying the original so-called "semantic" parser.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+/* All symbols defined below should begin with yy or YY, to avoid
+   infringing on user name space.  This should be done even for local
+   variables, as they might otherwise be expanded by user macros.
+   There are some unavoidable exceptions within include files to
+   define necessary library symbols; they are noted "INFRINGES ON
+   USER NAME SPACE" below.  */
+
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
+
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
+
+/* Skeleton name.  */
+#define YYSKELETON_NAME "yacc.c"
+
+/* Pure parsers.  */
+#define YYPURE 0
+
+/* Push parsers.  */
+#define YYPUSH 0
+
+/* Pull parsers.  */
+#define YYPULL 1
+
+
+
+
+/* First part of user prologue.  */
+#line 4 "src/parser.bison"
+
+#define YYDEBUG 1
+
+#line 75 "build/parser.c"
+
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
+# ifndef YY_NULLPTR
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
+#  else
+#   define YY_NULLPTR ((void*)0)
+#  endif
+# endif
+
+#include "parser.h"
+/* Symbol kind.  */
+enum yysymbol_kind_t
+{
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_TKN_UNSIGNED = 3,               /* "unsigned"  */
+  YYSYMBOL_TKN_SIGNED = 4,                 /* "signed"  */
+  YYSYMBOL_TKN_FLOAT = 5,                  /* "float"  */
+  YYSYMBOL_TKN_DOUBLE = 6,                 /* "double"  */
+  YYSYMBOL_TKN_BOOL = 7,                   /* "_Bool"  */
+  YYSYMBOL_TKN_CHAR = 8,                   /* "char"  */
+  YYSYMBOL_TKN_SHORT = 9,                  /* "short"  */
+  YYSYMBOL_TKN_INT = 10,                   /* "int"  */
+  YYSYMBOL_TKN_LONG = 11,                  /* "long"  */
+  YYSYMBOL_TKN_VOID = 12,                  /* "void"  */
+  YYSYMBOL_TKN_VOLATILE = 13,              /* "volatile"  */
+  YYSYMBOL_TKN_INLINE = 14,                /* "inline"  */
+  YYSYMBOL_TKN_GOTO = 15,                  /* "goto"  */
+  YYSYMBOL_TKN_IF = 16,                    /* "if"  */
+  YYSYMBOL_TKN_ELSE = 17,                  /* "else"  */
+  YYSYMBOL_TKN_WHILE = 18,                 /* "while"  */
+  YYSYMBOL_TKN_RETURN = 19,                /* "return"  */
+  YYSYMBOL_TKN_FOR = 20,                   /* "for"  */
+  YYSYMBOL_TKN_ASM = 21,                   /* "asm"  */
+  YYSYMBOL_TKN_THEN = 22,                  /* "then"  */
+  YYSYMBOL_TKN_LPAR = 23,                  /* "("  */
+  YYSYMBOL_TKN_RPAR = 24,                  /* ")"  */
+  YYSYMBOL_TKN_LBRAC = 25,                 /* "{"  */
+  YYSYMBOL_TKN_RBRAC = 26,                 /* "}"  */
+  YYSYMBOL_TKN_LSBRAC = 27,                /* "["  */
+  YYSYMBOL_TKN_RSBRAC = 28,                /* "]"  */
+  YYSYMBOL_TKN_SEMI = 29,                  /* ";"  */
+  YYSYMBOL_TKN_COLON = 30,                 /* ":"  */
+  YYSYMBOL_TKN_COMMA = 31,                 /* ","  */
+  YYSYMBOL_TKN_IVAL = 32,                  /* TKN_IVAL  */
+  YYSYMBOL_TKN_STRVAL = 33,                /* TKN_STRVAL  */
+  YYSYMBOL_TKN_IDENT = 34,                 /* TKN_IDENT  */
+  YYSYMBOL_TKN_GARBAGE = 35,               /* TKN_GARBAGE  */
+  YYSYMBOL_TKN_HASH = 36,                  /* "#"  */
+  YYSYMBOL_TKN_HASHHASH = 37,              /* "##"  */
+  YYSYMBOL_TKN_ASSIGN_ADD = 38,            /* "+="  */
+  YYSYMBOL_TKN_ASSIGN_SUB = 39,            /* "-="  */
+  YYSYMBOL_TKN_ASSIGN_SHL = 40,            /* "<<="  */
+  YYSYMBOL_TKN_ASSIGN_SHR = 41,            /* ">>="  */
+  YYSYMBOL_TKN_ASSIGN_MUL = 42,            /* "*="  */
+  YYSYMBOL_TKN_ASSIGN_DIV = 43,            /* "/="  */
+  YYSYMBOL_TKN_ASSIGN_REM = 44,            /* "%="  */
+  YYSYMBOL_TKN_ASSIGN_AND = 45,            /* "&="  */
+  YYSYMBOL_TKN_ASSIGN_OR = 46,             /* "|="  */
+  YYSYMBOL_TKN_ASSIGN_XOR = 47,            /* "^="  */
+  YYSYMBOL_TKN_INC = 48,                   /* "++"  */
+  YYSYMBOL_TKN_DEC = 49,                   /* "--"  */
+  YYSYMBOL_TKN_LOGIC_AND = 50,             /* "&&"  */
+  YYSYMBOL_TKN_LOGIC_OR = 51,              /* "||"  */
+  YYSYMBOL_TKN_ADD = 52,                   /* "+"  */
+  YYSYMBOL_TKN_SUB = 53,                   /* "-"  */
+  YYSYMBOL_TKN_ASSIGN = 54,                /* "="  */
+  YYSYMBOL_TKN_AMP = 55,                   /* "&"  */
+  YYSYMBOL_TKN_MUL = 56,                   /* "*"  */
+  YYSYMBOL_TKN_DIV = 57,                   /* "/"  */
+  YYSYMBOL_TKN_REM = 58,                   /* "%"  */
+  YYSYMBOL_TKN_NOT = 59,                   /* "!"  */
+  YYSYMBOL_TKN_INV = 60,                   /* "~"  */
+  YYSYMBOL_TKN_XOR = 61,                   /* "^"  */
+  YYSYMBOL_TKN_OR = 62,                    /* "|"  */
+  YYSYMBOL_TKN_SHL = 63,                   /* "<<"  */
+  YYSYMBOL_TKN_SHR = 64,                   /* ">>"  */
+  YYSYMBOL_TKN_LT = 65,                    /* "<"  */
+  YYSYMBOL_TKN_LE = 66,                    /* "<="  */
+  YYSYMBOL_TKN_GT = 67,                    /* ">"  */
+  YYSYMBOL_TKN_GE = 68,                    /* ">="  */
+  YYSYMBOL_TKN_EQ = 69,                    /* "=="  */
+  YYSYMBOL_TKN_NE = 70,                    /* "!="  */
+  YYSYMBOL_TKN_ATTR = 71,                  /* "__attribute__"  */
+  YYSYMBOL_YYACCEPT = 72,                  /* $accept  */
+  YYSYMBOL_library = 73,                   /* library  */
+  YYSYMBOL_global = 74,                    /* global  */
+  YYSYMBOL_opt_int = 75,                   /* opt_int  */
+  YYSYMBOL_opt_signed = 76,                /* opt_signed  */
+  YYSYMBOL_simple_long = 77,               /* simple_long  */
+  YYSYMBOL_simple_type_int = 78,           /* simple_type_int  */
+  YYSYMBOL_simple_type = 79,               /* simple_type  */
+  YYSYMBOL_var_nonarr = 80,                /* var_nonarr  */
+  YYSYMBOL_var_stars = 81,                 /* var_stars  */
+  YYSYMBOL_var_arrays = 82,                /* var_arrays  */
+  YYSYMBOL_var = 83,                       /* var  */
+  YYSYMBOL_funcdef = 84,                   /* funcdef  */
+  YYSYMBOL_vardecls = 85,                  /* vardecls  */
+  YYSYMBOL_opt_params = 86,                /* opt_params  */
+  YYSYMBOL_params = 87,                    /* params  */
+  YYSYMBOL_idents = 88,                    /* idents  */
+  YYSYMBOL_stmts = 89,                     /* stmts  */
+  YYSYMBOL_stmt = 90,                      /* stmt  */
+  YYSYMBOL_stmt_no_stmts = 91,             /* stmt_no_stmts  */
+  YYSYMBOL_opt_exprs = 92,                 /* opt_exprs  */
+  YYSYMBOL_exprs = 93,                     /* exprs  */
+  YYSYMBOL_expr = 94,                      /* expr  */
+  YYSYMBOL_inline_asm = 95,                /* inline_asm  */
+  YYSYMBOL_asm_qual = 96,                  /* asm_qual  */
+  YYSYMBOL_asm_code = 97,                  /* asm_code  */
+  YYSYMBOL_opt_asm_strs = 98,              /* opt_asm_strs  */
+  YYSYMBOL_asm_strs = 99,                  /* asm_strs  */
+  YYSYMBOL_opt_asm_regs = 100,             /* opt_asm_regs  */
+  YYSYMBOL_asm_regs = 101,                 /* asm_regs  */
+  YYSYMBOL_asm_reg = 102                   /* asm_reg  */
+};
+typedef enum yysymbol_kind_t yysymbol_kind_t;
+
+
+
+
+#ifdef short
+# undef short
+#endif
+
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
+
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
+
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
+
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
+#endif
+
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
+#else
+typedef short yytype_int16;
+#endif
+
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
+#else
+typedef short yytype_uint8;
+#endif
+
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
+#else
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
+#endif
+
+#ifndef YYSIZE_T
+# ifdef __SIZE_TYPE__
+#  define YYSIZE_T __SIZE_TYPE__
+# elif defined size_t
+#  define YYSIZE_T size_t
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYSIZE_T size_t
+# else
+#  define YYSIZE_T unsigned
+# endif
+#endif
+
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_uint8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
+
+#ifndef YY_
+# if defined YYENABLE_NLS && YYENABLE_NLS
+#  if ENABLE_NLS
+#   include <libintl.h> /* INFRINGES ON USER NAME SPACE */
+#   define YY_(Msgid) dgettext ("bison-runtime", Msgid)
+#  endif
+# endif
+# ifndef YY_
+#  define YY_(Msgid) Msgid
+# endif
+#endif
+
+
+#ifndef YY_ATTRIBUTE_PURE
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
+#endif
+
+#ifndef YY_ATTRIBUTE_UNUSED
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
+# else
+#  define YY_ATTRIBUTE_UNUSED
+# endif
+#endif
+
+/* Suppress unused-variable warnings by "using" E.  */
+#if ! defined lint || defined __GNUC__
+# define YY_USE(E) ((void) (E))
+#else
+# define YY_USE(E) /* empty */
+#endif
+
+/* Suppress an incorrect diagnostic about yylval being uninitialized.  */
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
+    _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
+    _Pragma ("GCC diagnostic pop")
+#else
+# define YY_INITIAL_VALUE(Value) Value
+#endif
+#ifndef YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END
+#endif
+#ifndef YY_INITIAL_VALUE
+# define YY_INITIAL_VALUE(Value) /* Nothing. */
+#endif
+
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
+
+#if !defined yyoverflow
+
+/* The parser invokes alloca or malloc; define the necessary symbols.  */
+
+# ifdef YYSTACK_USE_ALLOCA
+#  if YYSTACK_USE_ALLOCA
+#   ifdef __GNUC__
+#    define YYSTACK_ALLOC __builtin_alloca
+#   elif defined __BUILTIN_VA_ARG_INCR
+#    include <alloca.h> /* INFRINGES ON USER NAME SPACE */
+#   elif defined _AIX
+#    define YYSTACK_ALLOC __alloca
+#   elif defined _MSC_VER
+#    include <malloc.h> /* INFRINGES ON USER NAME SPACE */
+#    define alloca _alloca
+#   else
+#    define YYSTACK_ALLOC alloca
+#    if ! defined _ALLOCA_H && ! defined EXIT_SUCCESS
+#     include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+      /* Use EXIT_SUCCESS as a witness for stdlib.h.  */
+#     ifndef EXIT_SUCCESS
+#      define EXIT_SUCCESS 0
+#     endif
+#    endif
+#   endif
+#  endif
+# endif
+
+# ifdef YYSTACK_ALLOC
+   /* Pacify GCC's 'empty if-body' warning.  */
+#  define YYSTACK_FREE(Ptr) do { /* empty */; } while (0)
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+    /* The OS might guarantee only one guard page at the bottom of the stack,
+       and a page size can be as small as 4096 bytes.  So we cannot safely
+       invoke alloca (N) if N exceeds 4096.  Use a slightly smaller number
+       to allow for a few compiler-allocated temporary stack slots.  */
+#   define YYSTACK_ALLOC_MAXIMUM 4032 /* reasonable circa 2006 */
+#  endif
+# else
+#  define YYSTACK_ALLOC YYMALLOC
+#  define YYSTACK_FREE YYFREE
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+#   define YYSTACK_ALLOC_MAXIMUM YYSIZE_MAXIMUM
+#  endif
+#  if (defined __cplusplus && ! defined EXIT_SUCCESS \
+       && ! ((defined YYMALLOC || defined malloc) \
+             && (defined YYFREE || defined free)))
+#   include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+#   ifndef EXIT_SUCCESS
+#    define EXIT_SUCCESS 0
+#   endif
+#  endif
+#  ifndef YYMALLOC
+#   define YYMALLOC malloc
+#   if ! defined malloc && ! defined EXIT_SUCCESS
+void *malloc (YYSIZE_T); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+#  ifndef YYFREE
+#   define YYFREE free
+#   if ! defined free && ! defined EXIT_SUCCESS
+void free (void *); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+# endif
+#endif /* !defined yyoverflow */
+
+#if (! defined yyoverflow \
+     && (! defined __cplusplus \
+         || (defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
+
+/* A type that is properly aligned for any stack member.  */
+union yyalloc
+{
+  yy_state_t yyss_alloc;
+  YYSTYPE yyvs_alloc;
+};
+
+/* The size of the maximum gap between one aligned stack and the next.  */
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
+
+/* The size of an array large to enough to hold all stacks, each with
+   N elements.  */
+# define YYSTACK_BYTES(N) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
+      + YYSTACK_GAP_MAXIMUM)
+
+# define YYCOPY_NEEDED 1
+
+/* Relocate STACK from its old location to the new one.  The
+   local variables YYSIZE and YYSTACKSIZE give the old and new number of
+   elements in the stack, and YYPTR gives the new location of the
+   stack.  Advance YYPTR to a properly aligned location for the next
+   stack.  */
+# define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
+    do                                                                  \
+      {                                                                 \
+        YYPTRDIFF_T yynewbytes;                                         \
+        YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
+        Stack = &yyptr->Stack_alloc;                                    \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
+      }                                                                 \
+    while (0)
+
+#endif
+
+#if defined YYCOPY_NEEDED && YYCOPY_NEEDED
+/* Copy COUNT objects from SRC to DST.  The source and destination do
+   not overlap.  */
+# ifndef YYCOPY
+#  if defined __GNUC__ && 1 < __GNUC__
+#   define YYCOPY(Dst, Src, Count) \
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
+#  else
+#   define YYCOPY(Dst, Src, Count)              \
+      do                                        \
+        {                                       \
+          YYPTRDIFF_T yyi;                      \
+          for (yyi = 0; yyi < (Count); yyi++)   \
+            (Dst)[yyi] = (Src)[yyi];            \
+        }                                       \
+      while (0)
+#  endif
+# endif
+#endif /* !YYCOPY_NEEDED */
+
+/* YYFINAL -- State number of the termination state.  */
+#define YYFINAL  27
+/* YYLAST -- Last index in YYTABLE.  */
+#define YYLAST   1034
+
+/* YYNTOKENS -- Number of terminals.  */
+#define YYNTOKENS  72
+/* YYNNTS -- Number of nonterminals.  */
+#define YYNNTS  31
+/* YYNRULES -- Number of rules.  */
+#define YYNRULES  129
+/* YYNSTATES -- Number of states.  */
+#define YYNSTATES  242
+
+/* YYMAXUTOK -- Last valid token kind.  */
+#define YYMAXUTOK   326
+
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
+
+/* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
+{
+       0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
+       5,     6,     7,     8,     9,    10,    11,    12,    13,    14,
+      15,    16,    17,    18,    19,    20,    21,    22,    23,    24,
+      25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
+      35,    36,    37,    38,    39,    40,    41,    42,    43,    44,
+      45,    46,    47,    48,    49,    50,    51,    52,    53,    54,
+      55,    56,    57,    58,    59,    60,    61,    62,    63,    64,
+      65,    66,    67,    68,    69,    70,    71
+};
+
+#if YYDEBUG
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int16 yyrline[] =
+{
+       0,   135,   135,   136,   139,   140,   142,   143,   144,   145,
+     148,   149,   150,   152,   153,   154,   155,   156,   157,   158,
+     159,   160,   161,   162,   163,   164,   165,   166,   167,   169,
+     173,   180,   181,   184,   185,   186,   189,   190,   200,   203,
+     206,   209,   210,   211,   212,   213,   214,   215,   216,   219,
+     220,   221,   222,   223,   224,   226,   227,   229,   230,   231,
+     232,   233,   234,   237,   238,   239,   240,   241,   242,   243,
+     244,   245,   246,   248,   249,   251,   252,   254,   255,   256,
+     257,   258,   260,   261,   262,   264,   265,   267,   268,   269,
+     270,   272,   273,   275,   276,   277,   278,   279,   281,   282,
+     284,   285,   286,   287,   288,   289,   290,   291,   292,   293,
+     294,   297,   299,   300,   301,   302,   304,   308,   311,   313,
+     315,   316,   317,   318,   319,   320,   321,   322,   323,   324
+};
+#endif
+
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
+/* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
+   First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
+static const char *const yytname[] =
+{
+  "\"end of file\"", "error", "\"invalid token\"", "\"unsigned\"",
+  "\"signed\"", "\"float\"", "\"double\"", "\"_Bool\"", "\"char\"",
+  "\"short\"", "\"int\"", "\"long\"", "\"void\"", "\"volatile\"",
+  "\"inline\"", "\"goto\"", "\"if\"", "\"else\"", "\"while\"",
+  "\"return\"", "\"for\"", "\"asm\"", "\"then\"", "\"(\"", "\")\"",
+  "\"{\"", "\"}\"", "\"[\"", "\"]\"", "\";\"", "\":\"", "\",\"",
+  "TKN_IVAL", "TKN_STRVAL", "TKN_IDENT", "TKN_GARBAGE", "\"#\"", "\"##\"",
+  "\"+=\"", "\"-=\"", "\"<<=\"", "\">>=\"", "\"*=\"", "\"/=\"", "\"%=\"",
+  "\"&=\"", "\"|=\"", "\"^=\"", "\"++\"", "\"--\"", "\"&&\"", "\"||\"",
+  "\"+\"", "\"-\"", "\"=\"", "\"&\"", "\"*\"", "\"/\"", "\"%\"", "\"!\"",
+  "\"~\"", "\"^\"", "\"|\"", "\"<<\"", "\">>\"", "\"<\"", "\"<=\"",
+  "\">\"", "\">=\"", "\"==\"", "\"!=\"", "\"__attribute__\"", "$accept",
+  "library", "global", "opt_int", "opt_signed", "simple_long",
+  "simple_type_int", "simple_type", "var_nonarr", "var_stars",
+  "var_arrays", "var", "funcdef", "vardecls", "opt_params", "params",
+  "idents", "stmts", "stmt", "stmt_no_stmts", "opt_exprs", "exprs", "expr",
+  "inline_asm", "asm_qual", "asm_code", "opt_asm_strs", "asm_strs",
+  "opt_asm_regs", "asm_regs", "asm_reg", YY_NULLPTR
+};
+
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
+{
+  return yytname[yysymbol];
+}
+#endif
+
+#define YYPACT_NINF (-186)
+
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
+
+#define YYTABLE_NINF (-43)
+
+#define yytable_value_is_error(Yyn) \
+  0
+
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
+static const yytype_int16 yypact[] =
+{
+     608,    87,    18,  -186,  -186,  -186,  -186,   207,  -186,     7,
+     608,    15,  -186,  -186,  -186,  -186,  -186,    23,  -186,   166,
+    -186,   221,  -186,  -186,    23,  -186,  -186,  -186,  -186,    23,
+    -186,    29,    56,   -16,   116,  -186,    23,  -186,    23,  -186,
+    -186,  -186,   237,  -186,    59,  -186,   974,  -186,  -186,  -186,
+    -186,  -186,    60,    69,    70,    63,    62,   974,  -186,  -186,
+    -186,   974,   974,   974,   974,   974,   974,   974,   775,    81,
+    -186,   -33,   -17,   352,  -186,  -186,   943,   343,    65,    65,
+      65,    65,    65,    65,    65,   974,   974,   974,   974,   974,
+     974,   974,   974,   974,   974,   974,   974,  -186,  -186,   974,
+     974,   974,   974,   974,   974,   974,   974,   974,   974,   974,
+     974,   974,   974,   974,   974,   974,   974,   974,   974,  -186,
+    -186,  -186,  -186,    62,  -186,   391,  -186,    83,    96,   775,
+     439,   775,   775,   775,   775,   775,   775,   775,   775,   775,
+     775,   847,   823,   133,   133,   775,    65,    65,    65,    65,
+     895,   871,   -21,   -21,    53,    53,    53,    53,    76,    76,
+     775,   146,  -186,  -186,  -186,   974,  -186,   107,   115,   956,
+     132,  -186,  -186,  -186,  -186,  -186,  -186,  -186,  -186,   487,
+     130,   775,   974,   974,  -186,   535,   320,   170,   204,  -186,
+    -186,   583,   631,  -186,   974,  -186,  -186,  -186,   135,  -186,
+    -186,   262,   262,   134,    51,   153,  -186,   974,  -186,    58,
+     262,   149,   162,   177,   168,  -186,   183,  -186,   262,   176,
+     974,  -186,    58,    58,  -186,   186,   679,   173,  -186,   198,
+    -186,  -186,   193,   974,   197,   210,  -186,   727,   193,  -186,
+    -186,  -186
+};
+
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_uint8 yydefact[] =
+{
+       9,     0,     8,    25,    26,    27,    13,     7,    28,     0,
+       9,     0,    29,    32,     4,     5,    15,     7,    22,     7,
+      14,     7,    11,     6,     7,    10,    19,     1,     2,     7,
+      17,     0,     0,    48,     0,    21,     7,    23,     7,    18,
+      12,    16,     9,    32,    35,    31,     0,    40,    32,    24,
+      20,    32,     0,    41,     0,     0,    36,     0,    67,    68,
+      69,     0,     0,     0,     0,     0,     0,     0,    47,    46,
+      44,     0,     0,     9,    35,    35,     0,     0,    75,    76,
+      77,    80,    81,    78,    79,    64,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,    73,    74,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,    30,
+      50,    39,    32,    37,    33,     0,    72,     0,    63,    66,
+       0,   101,   102,   109,   110,   103,   104,   105,   106,   107,
+     108,    98,    99,    85,    86,   100,    93,    82,    83,    84,
+      94,    95,    96,    97,    87,    88,    89,    90,    91,    92,
+      45,     9,    43,    34,    70,     0,    71,     0,     0,     0,
+       0,   112,    50,    38,    62,    32,    59,    49,    52,     0,
+       0,    65,     0,     0,    57,     0,     9,     0,     9,    60,
+      61,     0,     0,    58,    64,   113,   114,   115,     0,   111,
+      51,     9,     9,     0,     0,    53,    55,    64,   119,   125,
+       9,     0,     0,     0,     0,   124,   127,    54,     9,     0,
+       0,   118,   125,     0,    56,     0,     0,     0,   126,     0,
+     129,   117,   121,     0,   123,     0,   120,     0,     0,   116,
+     128,   122
+};
+
+/* YYPGOTO[NTERM-NUM].  */
+static const yytype_int16 yypgoto[] =
+{
+    -186,   225,  -186,   269,  -186,  -186,  -186,    73,   -48,     0,
+     164,   -38,  -186,     4,  -186,  -186,  -186,    74,  -124,    61,
+    -185,  -186,   -46,  -186,  -186,  -186,  -186,    12,    32,    28,
+    -186
+};
+
+/* YYDEFGOTO[NTERM-NUM].  */
+static const yytype_uint8 yydefgoto[] =
+{
+       0,     9,    10,    25,    11,    26,    12,   175,    31,    54,
+      56,    33,    14,   176,    52,    53,    34,   161,   177,   178,
+     127,   128,   179,   180,   187,   199,   235,   236,   214,   215,
+     216
+};
+
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int16 yytable[] =
+{
+      68,   119,    85,    70,    15,    55,    86,    27,   120,   203,
+      69,    77,   121,    32,    15,    78,    79,    80,    81,    82,
+      83,    84,   211,    45,    29,    30,    20,    97,    98,    21,
+     125,   101,   102,    23,   104,   105,   106,   107,    46,   129,
+     130,   131,   132,   133,   134,   135,   136,   137,   138,   139,
+     140,    71,    42,   141,   142,   143,   144,   145,   146,   147,
+     148,   149,   150,   151,   152,   153,   154,   155,   156,   157,
+     158,   159,   160,    13,   162,   208,    85,   205,   206,    43,
+      86,   209,   -30,    13,    72,   212,   217,    75,    85,    76,
+      44,   213,    86,    43,   224,    16,    17,    18,    19,    85,
+      73,    97,    98,    86,    74,   101,   102,   164,   104,   105,
+     106,   107,    45,    97,    98,    51,   110,   111,   102,   181,
+     104,   105,    71,   185,    97,    98,    45,   165,   101,   102,
+     182,   104,   105,   106,   107,   118,   191,   192,   183,   110,
+     111,   112,   113,   114,   115,    47,   122,    48,   129,     1,
+       2,     3,     4,     5,     6,   186,    85,     7,     8,   190,
+      86,   129,   167,   207,   168,   169,   170,   171,   204,    57,
+     210,   172,   173,   218,   226,   174,    23,    36,    58,    59,
+      60,    97,    98,   195,   196,   197,   102,   237,   104,   105,
+     106,   107,   221,   198,    61,    62,   219,   231,   222,    63,
+     220,    64,    65,   232,   225,    66,    67,     1,     2,     3,
+       4,     5,     6,    22,   223,     7,     8,    23,    24,   229,
+     167,   233,   168,   169,   170,   171,   234,    57,   238,   172,
+     200,    23,    38,   174,   239,    28,    58,    59,    60,   123,
+       1,     2,     3,     4,     5,     6,   188,   194,     7,     8,
+     241,   228,    61,    62,   227,     0,     0,    63,     0,    64,
+      65,   -42,     0,    66,    67,     1,     2,     3,     4,     5,
+       6,     0,     0,     7,     8,     0,     0,     0,   167,     0,
+     168,   169,   170,   171,     0,    57,    35,   172,    37,     0,
+      39,   174,     0,    40,    58,    59,    60,     0,    41,     0,
+       0,     0,     0,     0,     0,    49,     0,    50,     0,     0,
+      61,    62,     0,     0,     0,    63,     0,    64,    65,     0,
+       0,    66,    67,     1,     2,     3,     4,     5,     6,     0,
+       0,     7,     8,     0,     0,     0,   167,     0,   168,   169,
+     170,   171,     0,    57,     0,     0,     0,     0,     0,   174,
+       0,     0,    58,    59,    60,     1,     2,     3,     4,     5,
+       6,     0,     0,     7,     8,     0,    85,   126,    61,    62,
+      86,     0,     0,    63,     0,    64,    65,     0,     0,    66,
+      67,    87,    88,    89,    90,    91,    92,    93,    94,    95,
+      96,    97,    98,    99,   100,   101,   102,   103,   104,   105,
+     106,   107,     0,     0,   108,   109,   110,   111,   112,   113,
+     114,   115,   116,   117,    85,     0,     0,     0,    86,   163,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,    87,
+      88,    89,    90,    91,    92,    93,    94,    95,    96,    97,
+      98,    99,   100,   101,   102,   103,   104,   105,   106,   107,
+       0,     0,   108,   109,   110,   111,   112,   113,   114,   115,
+     116,   117,    85,     0,     0,     0,    86,   166,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,    87,    88,    89,
+      90,    91,    92,    93,    94,    95,    96,    97,    98,    99,
+     100,   101,   102,   103,   104,   105,   106,   107,     0,     0,
+     108,   109,   110,   111,   112,   113,   114,   115,   116,   117,
+      85,     0,     0,     0,    86,     0,   189,     0,     0,     0,
+       0,     0,     0,     0,     0,    87,    88,    89,    90,    91,
+      92,    93,    94,    95,    96,    97,    98,    99,   100,   101,
+     102,   103,   104,   105,   106,   107,     0,     0,   108,   109,
+     110,   111,   112,   113,   114,   115,   116,   117,    85,     0,
+       0,     0,    86,     0,   193,     0,     0,     0,     0,     0,
+       0,     0,     0,    87,    88,    89,    90,    91,    92,    93,
+      94,    95,    96,    97,    98,    99,   100,   101,   102,   103,
+     104,   105,   106,   107,     0,     0,   108,   109,   110,   111,
+     112,   113,   114,   115,   116,   117,    85,   201,    -3,     0,
+      86,     1,     2,     3,     4,     5,     6,     0,     0,     7,
+       8,    87,    88,    89,    90,    91,    92,    93,    94,    95,
+      96,    97,    98,    99,   100,   101,   102,   103,   104,   105,
+     106,   107,     0,     0,   108,   109,   110,   111,   112,   113,
+     114,   115,   116,   117,    85,   202,     0,     0,    86,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,    87,
+      88,    89,    90,    91,    92,    93,    94,    95,    96,    97,
+      98,    99,   100,   101,   102,   103,   104,   105,   106,   107,
+       0,     0,   108,   109,   110,   111,   112,   113,   114,   115,
+     116,   117,    85,   230,     0,     0,    86,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,    87,    88,    89,
+      90,    91,    92,    93,    94,    95,    96,    97,    98,    99,
+     100,   101,   102,   103,   104,   105,   106,   107,     0,     0,
+     108,   109,   110,   111,   112,   113,   114,   115,   116,   117,
+      85,   240,     0,     0,    86,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,    87,    88,    89,    90,    91,
+      92,    93,    94,    95,    96,    97,    98,    99,   100,   101,
+     102,   103,   104,   105,   106,   107,     0,     0,   108,   109,
+     110,   111,   112,   113,   114,   115,   116,   117,    85,     0,
+       0,     0,    86,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,    87,    88,    89,    90,    91,    92,    93,
+      94,    95,    96,    97,    98,    99,   100,   101,   102,   103,
+     104,   105,   106,   107,     0,     0,   108,   109,   110,   111,
+     112,   113,   114,   115,   116,   117,    85,     0,     0,     0,
+      86,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+      85,    97,    98,    99,    86,   101,   102,     0,   104,   105,
+     106,   107,     0,     0,   108,   109,   110,   111,   112,   113,
+     114,   115,   116,   117,    85,    97,    98,     0,    86,   101,
+     102,     0,   104,   105,   106,   107,     0,     0,   108,   109,
+     110,   111,   112,   113,   114,   115,   116,   117,    85,    97,
+      98,     0,    86,   101,   102,     0,   104,   105,   106,   107,
+       0,     0,   108,     0,   110,   111,   112,   113,   114,   115,
+     116,   117,     0,    97,    98,     0,     0,   101,   102,     0,
+     104,   105,   106,   107,     0,     0,     0,     0,   110,   111,
+     112,   113,   114,   115,   116,   117,    57,     0,     0,     0,
+       0,   124,     0,     0,     0,    58,    59,    60,     0,    57,
+       0,     0,     0,     0,     0,   184,     0,     0,    58,    59,
+      60,    61,    62,     0,     0,     0,    63,    57,    64,    65,
+       0,     0,    66,    67,    61,    62,    58,    59,    60,    63,
+       0,    64,    65,     0,     0,    66,    67,     0,     0,     0,
+       0,     0,    61,    62,     0,     0,     0,    63,     0,    64,
+      65,     0,     0,    66,    67
+};
+
+static const yytype_int16 yycheck[] =
+{
+      46,    34,    23,    51,     0,    43,    27,     0,    25,   194,
+      48,    57,    29,    13,    10,    61,    62,    63,    64,    65,
+      66,    67,   207,    56,     9,    10,     8,    48,    49,    11,
+      76,    52,    53,    10,    55,    56,    57,    58,    54,    85,
+      86,    87,    88,    89,    90,    91,    92,    93,    94,    95,
+      96,    51,    23,    99,   100,   101,   102,   103,   104,   105,
+     106,   107,   108,   109,   110,   111,   112,   113,   114,   115,
+     116,   117,   118,     0,   122,    24,    23,   201,   202,    23,
+      27,    30,    23,    10,    24,    27,   210,    24,    23,    27,
+      34,    33,    27,    23,   218,     8,     9,    10,    11,    23,
+      31,    48,    49,    27,    34,    52,    53,    24,    55,    56,
+      57,    58,    56,    48,    49,    42,    63,    64,    53,   165,
+      55,    56,   122,   169,    48,    49,    56,    31,    52,    53,
+      23,    55,    56,    57,    58,    54,   182,   183,    23,    63,
+      64,    65,    66,    67,    68,    29,    73,    31,   194,     3,
+       4,     5,     6,     7,     8,    23,    23,    11,    12,    29,
+      27,   207,    16,    29,    18,    19,    20,    21,    33,    23,
+      17,    25,    26,    24,   220,    29,    10,    11,    32,    33,
+      34,    48,    49,    13,    14,    15,    53,   233,    55,    56,
+      57,    58,    24,    23,    48,    49,    34,    24,    30,    53,
+      23,    55,    56,    30,    28,    59,    60,     3,     4,     5,
+       6,     7,     8,     6,    31,    11,    12,    10,    11,    33,
+      16,    23,    18,    19,    20,    21,    33,    23,    31,    25,
+      26,    10,    11,    29,    24,    10,    32,    33,    34,    75,
+       3,     4,     5,     6,     7,     8,   172,   186,    11,    12,
+     238,   223,    48,    49,   222,    -1,    -1,    53,    -1,    55,
+      56,    24,    -1,    59,    60,     3,     4,     5,     6,     7,
+       8,    -1,    -1,    11,    12,    -1,    -1,    -1,    16,    -1,
+      18,    19,    20,    21,    -1,    23,    17,    25,    19,    -1,
+      21,    29,    -1,    24,    32,    33,    34,    -1,    29,    -1,
+      -1,    -1,    -1,    -1,    -1,    36,    -1,    38,    -1,    -1,
+      48,    49,    -1,    -1,    -1,    53,    -1,    55,    56,    -1,
+      -1,    59,    60,     3,     4,     5,     6,     7,     8,    -1,
+      -1,    11,    12,    -1,    -1,    -1,    16,    -1,    18,    19,
+      20,    21,    -1,    23,    -1,    -1,    -1,    -1,    -1,    29,
+      -1,    -1,    32,    33,    34,     3,     4,     5,     6,     7,
+       8,    -1,    -1,    11,    12,    -1,    23,    24,    48,    49,
+      27,    -1,    -1,    53,    -1,    55,    56,    -1,    -1,    59,
+      60,    38,    39,    40,    41,    42,    43,    44,    45,    46,
+      47,    48,    49,    50,    51,    52,    53,    54,    55,    56,
+      57,    58,    -1,    -1,    61,    62,    63,    64,    65,    66,
+      67,    68,    69,    70,    23,    -1,    -1,    -1,    27,    28,
+      -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    38,
+      39,    40,    41,    42,    43,    44,    45,    46,    47,    48,
+      49,    50,    51,    52,    53,    54,    55,    56,    57,    58,
+      -1,    -1,    61,    62,    63,    64,    65,    66,    67,    68,
+      69,    70,    23,    -1,    -1,    -1,    27,    28,    -1,    -1,
+      -1,    -1,    -1,    -1,    -1,    -1,    -1,    38,    39,    40,
+      41,    42,    43,    44,    45,    46,    47,    48,    49,    50,
+      51,    52,    53,    54,    55,    56,    57,    58,    -1,    -1,
+      61,    62,    63,    64,    65,    66,    67,    68,    69,    70,
+      23,    -1,    -1,    -1,    27,    -1,    29,    -1,    -1,    -1,
+      -1,    -1,    -1,    -1,    -1,    38,    39,    40,    41,    42,
+      43,    44,    45,    46,    47,    48,    49,    50,    51,    52,
+      53,    54,    55,    56,    57,    58,    -1,    -1,    61,    62,
+      63,    64,    65,    66,    67,    68,    69,    70,    23,    -1,
+      -1,    -1,    27,    -1,    29,    -1,    -1,    -1,    -1,    -1,
+      -1,    -1,    -1,    38,    39,    40,    41,    42,    43,    44,
+      45,    46,    47,    48,    49,    50,    51,    52,    53,    54,
+      55,    56,    57,    58,    -1,    -1,    61,    62,    63,    64,
+      65,    66,    67,    68,    69,    70,    23,    24,     0,    -1,
+      27,     3,     4,     5,     6,     7,     8,    -1,    -1,    11,
+      12,    38,    39,    40,    41,    42,    43,    44,    45,    46,
+      47,    48,    49,    50,    51,    52,    53,    54,    55,    56,
+      57,    58,    -1,    -1,    61,    62,    63,    64,    65,    66,
+      67,    68,    69,    70,    23,    24,    -1,    -1,    27,    -1,
+      -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    38,
+      39,    40,    41,    42,    43,    44,    45,    46,    47,    48,
+      49,    50,    51,    52,    53,    54,    55,    56,    57,    58,
+      -1,    -1,    61,    62,    63,    64,    65,    66,    67,    68,
+      69,    70,    23,    24,    -1,    -1,    27,    -1,    -1,    -1,
+      -1,    -1,    -1,    -1,    -1,    -1,    -1,    38,    39,    40,
+      41,    42,    43,    44,    45,    46,    47,    48,    49,    50,
+      51,    52,    53,    54,    55,    56,    57,    58,    -1,    -1,
+      61,    62,    63,    64,    65,    66,    67,    68,    69,    70,
+      23,    24,    -1,    -1,    27,    -1,    -1,    -1,    -1,    -1,
+      -1,    -1,    -1,    -1,    -1,    38,    39,    40,    41,    42,
+      43,    44,    45,    46,    47,    48,    49,    50,    51,    52,
+      53,    54,    55,    56,    57,    58,    -1,    -1,    61,    62,
+      63,    64,    65,    66,    67,    68,    69,    70,    23,    -1,
+      -1,    -1,    27,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
+      -1,    -1,    -1,    38,    39,    40,    41,    42,    43,    44,
+      45,    46,    47,    48,    49,    50,    51,    52,    53,    54,
+      55,    56,    57,    58,    -1,    -1,    61,    62,    63,    64,
+      65,    66,    67,    68,    69,    70,    23,    -1,    -1,    -1,
+      27,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
+      -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
+      23,    48,    49,    50,    27,    52,    53,    -1,    55,    56,
+      57,    58,    -1,    -1,    61,    62,    63,    64,    65,    66,
+      67,    68,    69,    70,    23,    48,    49,    -1,    27,    52,
+      53,    -1,    55,    56,    57,    58,    -1,    -1,    61,    62,
+      63,    64,    65,    66,    67,    68,    69,    70,    23,    48,
+      49,    -1,    27,    52,    53,    -1,    55,    56,    57,    58,
+      -1,    -1,    61,    -1,    63,    64,    65,    66,    67,    68,
+      69,    70,    -1,    48,    49,    -1,    -1,    52,    53,    -1,
+      55,    56,    57,    58,    -1,    -1,    -1,    -1,    63,    64,
+      65,    66,    67,    68,    69,    70,    23,    -1,    -1,    -1,
+      -1,    28,    -1,    -1,    -1,    32,    33,    34,    -1,    23,
+      -1,    -1,    -1,    -1,    -1,    29,    -1,    -1,    32,    33,
+      34,    48,    49,    -1,    -1,    -1,    53,    23,    55,    56,
+      -1,    -1,    59,    60,    48,    49,    32,    33,    34,    53,
+      -1,    55,    56,    -1,    -1,    59,    60,    -1,    -1,    -1,
+      -1,    -1,    48,    49,    -1,    -1,    -1,    53,    -1,    55,
+      56,    -1,    -1,    59,    60
+};
+
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
+{
+       0,     3,     4,     5,     6,     7,     8,    11,    12,    73,
+      74,    76,    78,    79,    84,    85,     8,     9,    10,    11,
+       8,    11,     6,    10,    11,    75,    77,     0,    73,     9,
+      10,    80,    81,    83,    88,    75,    11,    75,    11,    75,
+      75,    75,    23,    23,    34,    56,    54,    29,    31,    75,
+      75,    79,    86,    87,    81,    83,    82,    23,    32,    33,
+      34,    48,    49,    53,    55,    56,    59,    60,    94,    83,
+      80,    81,    24,    31,    34,    24,    27,    94,    94,    94,
+      94,    94,    94,    94,    94,    23,    27,    38,    39,    40,
+      41,    42,    43,    44,    45,    46,    47,    48,    49,    50,
+      51,    52,    53,    54,    55,    56,    57,    58,    61,    62,
+      63,    64,    65,    66,    67,    68,    69,    70,    54,    34,
+      25,    29,    79,    82,    28,    94,    24,    92,    93,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    89,    80,    28,    24,    31,    28,    16,    18,    19,
+      20,    21,    25,    26,    29,    79,    85,    90,    91,    94,
+      95,    94,    23,    23,    29,    94,    23,    96,    89,    29,
+      29,    94,    94,    29,    91,    13,    14,    15,    23,    97,
+      26,    24,    24,    92,    33,    90,    90,    29,    24,    30,
+      17,    92,    27,    33,   100,   101,   102,    90,    24,    34,
+      23,    24,    30,    31,    90,    28,    94,   100,   101,    33,
+      24,    24,    30,    23,    33,    98,    99,    94,    31,    24,
+      24,    99
+};
+
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
+{
+       0,    72,    73,    73,    74,    74,    75,    75,    76,    76,
+      77,    77,    77,    78,    78,    78,    78,    78,    78,    78,
+      78,    78,    78,    78,    78,    78,    78,    78,    78,    79,
+      80,    81,    81,    82,    82,    82,    83,    83,    84,    84,
+      85,    86,    86,    87,    87,    88,    88,    88,    88,    89,
+      89,    90,    90,    91,    91,    91,    91,    91,    91,    91,
+      91,    91,    91,    92,    92,    93,    93,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    94,    94,    94,    94,    94,    94,    94,    94,    94,
+      94,    95,    96,    96,    96,    96,    97,    97,    97,    97,
+      98,    98,    99,    99,   100,   100,   101,   101,   102,   102
+};
+
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
+{
+       0,     2,     2,     0,     1,     1,     1,     0,     1,     0,
+       1,     1,     2,     1,     2,     2,     3,     2,     3,     2,
+       4,     3,     2,     3,     4,     1,     1,     1,     1,     1,
+       2,     2,     0,     3,     4,     0,     3,     5,     8,     6,
+       3,     1,     0,     4,     2,     5,     3,     3,     1,     2,
+       0,     3,     1,     5,     7,     5,     8,     2,     3,     1,
+       2,     2,     1,     1,     0,     3,     1,     1,     1,     1,
+       4,     4,     3,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     0,     2,     2,     2,     9,     7,     5,     3,
+       1,     0,     3,     1,     1,     0,     3,     1,     7,     4
+};
+
+
+enum { YYENOMEM = -2 };
+
+#define yyerrok         (yyerrstatus = 0)
+#define yyclearin       (yychar = YYEMPTY)
+
+#define YYACCEPT        goto yyacceptlab
+#define YYABORT         goto yyabortlab
+#define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
+
+
+#define YYRECOVERING()  (!!yyerrstatus)
+
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (ctx, YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
+
+
+/* Enable debugging if requested.  */
+#if YYDEBUG
+
+# ifndef YYFPRINTF
+#  include <stdio.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYFPRINTF fprintf
+# endif
+
+# define YYDPRINTF(Args)                        \
+do {                                            \
+  if (yydebug)                                  \
+    YYFPRINTF Args;                             \
+} while (0)
+
+
+
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
+do {                                                                      \
+  if (yydebug)                                                            \
+    {                                                                     \
+      YYFPRINTF (stderr, "%s ", Title);                                   \
+      yy_symbol_print (stderr,                                            \
+                  Kind, Value, ctx); \
+      YYFPRINTF (stderr, "\n");                                           \
+    }                                                                     \
+} while (0)
+
+
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
+
+static void
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, parser_ctx_t *ctx)
+{
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  YY_USE (ctx);
+  if (!yyvaluep)
+    return;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
+
+static void
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep, parser_ctx_t *ctx)
+{
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
+
+  yy_symbol_value_print (yyo, yykind, yyvaluep, ctx);
+  YYFPRINTF (yyo, ")");
+}
+
+/*------------------------------------------------------------------.
+| yy_stack_print -- Print the state stack from its BOTTOM up to its |
+| TOP (included).                                                   |
+`------------------------------------------------------------------*/
+
+static void
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
+{
+  YYFPRINTF (stderr, "Stack now");
+  for (; yybottom <= yytop; yybottom++)
+    {
+      int yybot = *yybottom;
+      YYFPRINTF (stderr, " %d", yybot);
+    }
+  YYFPRINTF (stderr, "\n");
+}
+
+# define YY_STACK_PRINT(Bottom, Top)                            \
+do {                                                            \
+  if (yydebug)                                                  \
+    yy_stack_print ((Bottom), (Top));                           \
+} while (0)
+
+
+/*------------------------------------------------.
+| Report that the YYRULE is going to be reduced.  |
+`------------------------------------------------*/
+
+static void
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule, parser_ctx_t *ctx)
+{
+  int yylno = yyrline[yyrule];
+  int yynrhs = yyr2[yyrule];
+  int yyi;
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
+             yyrule - 1, yylno);
+  /* The symbols being reduced.  */
+  for (yyi = 0; yyi < yynrhs; yyi++)
+    {
+      YYFPRINTF (stderr, "   $%d = ", yyi + 1);
+      yy_symbol_print (stderr,
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)], ctx);
+      YYFPRINTF (stderr, "\n");
+    }
+}
+
+# define YY_REDUCE_PRINT(Rule)          \
+do {                                    \
+  if (yydebug)                          \
+    yy_reduce_print (yyssp, yyvsp, Rule, ctx); \
+} while (0)
+
+/* Nonzero means print parse trace.  It is left uninitialized so that
+   multiple parsers can coexist.  */
+int yydebug;
+#else /* !YYDEBUG */
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
+# define YY_STACK_PRINT(Bottom, Top)
+# define YY_REDUCE_PRINT(Rule)
+#endif /* !YYDEBUG */
+
+
+/* YYINITDEPTH -- initial size of the parser's stacks.  */
+#ifndef YYINITDEPTH
+# define YYINITDEPTH 200
+#endif
+
+/* YYMAXDEPTH -- maximum size the stacks can grow to (effective only
+   if the built-in stack extension method is used).
+
+   Do not make this value too large; the results are undefined if
+   YYSTACK_ALLOC_MAXIMUM < YYSTACK_BYTES (YYMAXDEPTH)
+   evaluated with infinite-precision integer arithmetic.  */
+
+#ifndef YYMAXDEPTH
+# define YYMAXDEPTH 10000
+#endif
+
+
+
+
+
+
+/*-----------------------------------------------.
+| Release the memory associated to this symbol.  |
+`-----------------------------------------------*/
+
+static void
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep, parser_ctx_t *ctx)
+{
+  YY_USE (yyvaluep);
+  YY_USE (ctx);
+  if (!yymsg)
+    yymsg = "Deleting";
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/* Lookahead token kind.  */
+int yychar;
+
+/* The semantic value of the lookahead symbol.  */
+YYSTYPE yylval;
+/* Number of syntax errors so far.  */
+int yynerrs;
+
+
+
+
+/*----------.
+| yyparse.  |
+`----------*/
+
+int
+yyparse (parser_ctx_t *ctx)
+{
+    yy_state_fast_t yystate = 0;
+    /* Number of tokens to shift before error messages enabled.  */
+    int yyerrstatus = 0;
+
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
+       to reallocate them elsewhere.  */
+
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
+
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
+
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
+
+  int yyn;
+  /* The return value of yyparse.  */
+  int yyresult;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
+  /* The variables used to return semantic value and location from the
+     action routines.  */
+  YYSTYPE yyval;
+
+
+
+#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
+
+  /* The number of symbols on the RHS of the reduced rule.
+     Keep to zero when no symbol should be popped.  */
+  int yylen = 0;
+
+  YYDPRINTF ((stderr, "Starting parse\n"));
+
+  yychar = YYEMPTY; /* Cause a token to be read.  */
+
+  goto yysetstate;
+
+
+/*------------------------------------------------------------.
+| yynewstate -- push a new state, which is found in yystate.  |
+`------------------------------------------------------------*/
+yynewstate:
+  /* In all cases, when you get here, the value and location stacks
+     have just been pushed.  So pushing a state here evens the stacks.  */
+  yyssp++;
+
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
+
+  if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
+    {
+      /* Get the current used size of the three stacks, in elements.  */
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
+
+# if defined yyoverflow
+      {
+        /* Give user a chance to reallocate the stack.  Use copies of
+           these so that the &'s don't force the real ones into
+           memory.  */
+        yy_state_t *yyss1 = yyss;
+        YYSTYPE *yyvs1 = yyvs;
+
+        /* Each stack pointer address is followed by the size of the
+           data in use in that stack, in bytes.  This used to be a
+           conditional around just the two extra args, but that might
+           be undefined if yyoverflow is a macro.  */
+        yyoverflow (YY_("memory exhausted"),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
+                    &yystacksize);
+        yyss = yyss1;
+        yyvs = yyvs1;
+      }
+# else /* defined YYSTACK_RELOCATE */
+      /* Extend the stack our own way.  */
+      if (YYMAXDEPTH <= yystacksize)
+        YYNOMEM;
+      yystacksize *= 2;
+      if (YYMAXDEPTH < yystacksize)
+        yystacksize = YYMAXDEPTH;
+
+      {
+        yy_state_t *yyss1 = yyss;
+        union yyalloc *yyptr =
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
+        if (! yyptr)
+          YYNOMEM;
+        YYSTACK_RELOCATE (yyss_alloc, yyss);
+        YYSTACK_RELOCATE (yyvs_alloc, yyvs);
+#  undef YYSTACK_RELOCATE
+        if (yyss1 != yyssa)
+          YYSTACK_FREE (yyss1);
+      }
+# endif
+
+      yyssp = yyss + yysize - 1;
+      yyvsp = yyvs + yysize - 1;
+
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
+
+      if (yyss + yystacksize - 1 <= yyssp)
+        YYABORT;
+    }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
+
+
+  if (yystate == YYFINAL)
+    YYACCEPT;
+
+  goto yybackup;
+
+
+/*-----------.
+| yybackup.  |
+`-----------*/
+yybackup:
+  /* Do appropriate processing given the current state.  Read a
+     lookahead token if we need one and don't already have one.  */
+
+  /* First try to decide what to do without reference to lookahead token.  */
+  yyn = yypact[yystate];
+  if (yypact_value_is_default (yyn))
+    goto yydefault;
+
+  /* Not known => get a lookahead token if don't already have one.  */
+
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
+  if (yychar == YYEMPTY)
+    {
+      YYDPRINTF ((stderr, "Reading a token\n"));
+      yychar = yylex (ctx);
+    }
+
+  if (yychar <= YYEOF)
+    {
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
+      YYDPRINTF ((stderr, "Now at end of input.\n"));
+    }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
+  else
+    {
+      yytoken = YYTRANSLATE (yychar);
+      YY_SYMBOL_PRINT ("Next token is", yytoken, &yylval, &yylloc);
+    }
+
+  /* If the proper action on seeing token YYTOKEN is to reduce or to
+     detect an error, take that action.  */
+  yyn += yytoken;
+  if (yyn < 0 || YYLAST < yyn || yycheck[yyn] != yytoken)
+    goto yydefault;
+  yyn = yytable[yyn];
+  if (yyn <= 0)
+    {
+      if (yytable_value_is_error (yyn))
+        goto yyerrlab;
+      yyn = -yyn;
+      goto yyreduce;
+    }
+
+  /* Count tokens shifted since error; after three, turn off error
+     status.  */
+  if (yyerrstatus)
+    yyerrstatus--;
+
+  /* Shift the lookahead token.  */
+  YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
+  yystate = yyn;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
+  goto yynewstate;
+
+
+/*-----------------------------------------------------------.
+| yydefault -- do the default action for the current state.  |
+`-----------------------------------------------------------*/
+yydefault:
+  yyn = yydefact[yystate];
+  if (yyn == 0)
+    goto yyerrlab;
+  goto yyreduce;
+
+
+/*-----------------------------.
+| yyreduce -- do a reduction.  |
+`-----------------------------*/
+yyreduce:
+  /* yyn is the number of a rule to reduce with.  */
+  yylen = yyr2[yyn];
+
+  /* If YYLEN is nonzero, implement the default value of the action:
+     '$$ = $1'.
+
+     Otherwise, the following line sets YYVAL to garbage.
+     This behavior is undocumented and Bison
+     users should not rely upon it.  Assigning to YYVAL
+     unconditionally makes the parser a bit smaller, and it avoids a
+     GCC warning that YYVAL may be used uninitialized.  */
+  yyval = yyvsp[1-yylen];
+
+
+  YY_REDUCE_PRINT (yyn);
+  switch (yyn)
+    {
+  case 4: /* global: funcdef  */
+#line 139 "src/parser.bison"
+                                {function_added(ctx, &(yyvsp[0].func));}
+#line 1495 "build/parser.c"
+    break;
+
+  case 6: /* opt_int: "int"  */
+#line 142 "src/parser.bison"
+                                                                                                        {(yyval.pos)=(yyvsp[0].pos);}
+#line 1501 "build/parser.c"
+    break;
+
+  case 7: /* opt_int: %empty  */
+#line 143 "src/parser.bison"
+                                                                                                                {(yyval.pos)=pos_empty(ctx->tokeniser_ctx);}
+#line 1507 "build/parser.c"
+    break;
+
+  case 8: /* opt_signed: "signed"  */
+#line 144 "src/parser.bison"
+                                                                                                        {(yyval.pos)=(yyvsp[0].pos);}
+#line 1513 "build/parser.c"
+    break;
+
+  case 9: /* opt_signed: %empty  */
+#line 145 "src/parser.bison"
+                                                                                                                {(yyval.pos)=pos_empty(ctx->tokeniser_ctx);}
+#line 1519 "build/parser.c"
+    break;
+
+  case 10: /* simple_long: opt_int  */
+#line 148 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_S_LONG;}
+#line 1525 "build/parser.c"
+    break;
+
+  case 11: /* simple_long: "double"  */
+#line 149 "src/parser.bison"
+                                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_LONG_DOUBLE;}
+#line 1531 "build/parser.c"
+    break;
+
+  case 12: /* simple_long: "long" opt_int  */
+#line 150 "src/parser.bison"
+                                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_LONGER;}
+#line 1537 "build/parser.c"
+    break;
+
+  case 13: /* simple_type_int: "char"  */
+#line 152 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_CHAR;}
+#line 1543 "build/parser.c"
+    break;
+
+  case 14: /* simple_type_int: "signed" "char"  */
+#line 153 "src/parser.bison"
+                                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_CHAR;}
+#line 1549 "build/parser.c"
+    break;
+
+  case 15: /* simple_type_int: "unsigned" "char"  */
+#line 154 "src/parser.bison"
+                                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_U_CHAR;}
+#line 1555 "build/parser.c"
+    break;
+
+  case 16: /* simple_type_int: opt_signed "short" opt_int  */
+#line 155 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_SHORT;}
+#line 1561 "build/parser.c"
+    break;
+
+  case 17: /* simple_type_int: opt_signed "int"  */
+#line 156 "src/parser.bison"
+                                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_INT;}
+#line 1567 "build/parser.c"
+    break;
+
+  case 18: /* simple_type_int: "signed" "long" opt_int  */
+#line 157 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_LONG;}
+#line 1573 "build/parser.c"
+    break;
+
+  case 19: /* simple_type_int: "long" simple_long  */
+#line 158 "src/parser.bison"
+                                                                                                        {(yyval.simple_type)=(yyvsp[0].simple_type);                                      (yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].simple_type).pos);}
+#line 1579 "build/parser.c"
+    break;
+
+  case 20: /* simple_type_int: "signed" "long" "long" opt_int  */
+#line 159 "src/parser.bison"
+                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-3].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_S_LONGER;}
+#line 1585 "build/parser.c"
+    break;
+
+  case 21: /* simple_type_int: "unsigned" "short" opt_int  */
+#line 160 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_U_SHORT;}
+#line 1591 "build/parser.c"
+    break;
+
+  case 22: /* simple_type_int: "unsigned" "int"  */
+#line 161 "src/parser.bison"
+                                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_U_INT;}
+#line 1597 "build/parser.c"
+    break;
+
+  case 23: /* simple_type_int: "unsigned" "long" opt_int  */
+#line 162 "src/parser.bison"
+                                                                                                {(yyval.simple_type).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_U_LONG;}
+#line 1603 "build/parser.c"
+    break;
+
+  case 24: /* simple_type_int: "unsigned" "long" "long" opt_int  */
+#line 163 "src/parser.bison"
+                                                                                        {(yyval.simple_type).pos=pos_merge((yyvsp[-3].pos), (yyvsp[0].pos));                   (yyval.simple_type).ival=STYPE_U_LONGER;}
+#line 1609 "build/parser.c"
+    break;
+
+  case 25: /* simple_type_int: "float"  */
+#line 164 "src/parser.bison"
+                                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_FLOAT;}
+#line 1615 "build/parser.c"
+    break;
+
+  case 26: /* simple_type_int: "double"  */
+#line 165 "src/parser.bison"
+                                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_DOUBLE;}
+#line 1621 "build/parser.c"
+    break;
+
+  case 27: /* simple_type_int: "_Bool"  */
+#line 166 "src/parser.bison"
+                                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_BOOL;}
+#line 1627 "build/parser.c"
+    break;
+
+  case 28: /* simple_type_int: "void"  */
+#line 167 "src/parser.bison"
+                                                                                                                {(yyval.simple_type).pos=(yyvsp[0].pos);                                  (yyval.simple_type).ival=STYPE_VOID;}
+#line 1633 "build/parser.c"
+    break;
+
+  case 29: /* simple_type: simple_type_int  */
+#line 169 "src/parser.bison"
+                                                                                        {ctx->s_type = (yyvsp[0].simple_type).ival;}
+#line 1639 "build/parser.c"
+    break;
+
+  case 30: /* var_nonarr: var_stars TKN_IDENT  */
+#line 173 "src/parser.bison"
+                                                                                                {(yyval.ident)=ident_of_strval(ctx, &(yyvsp[-1].ident), &(yyvsp[0].strval), NULL); (yyval.ident).pos=pos_merge((yyvsp[-1].ident).pos, (yyvsp[0].strval).pos);}
+#line 1645 "build/parser.c"
+    break;
+
+  case 31: /* var_stars: var_stars "*"  */
+#line 180 "src/parser.bison"
+                                                                                                {(yyval.ident).type=ctype_ptr   (ctx->asm_ctx, (yyvsp[-1].ident).type);}
+#line 1651 "build/parser.c"
+    break;
+
+  case 32: /* var_stars: %empty  */
+#line 181 "src/parser.bison"
+                                                                                                                {(yyval.ident).type=ctype_simple(ctx->asm_ctx, ctx->s_type);}
+#line 1657 "build/parser.c"
+    break;
+
+  case 33: /* var_arrays: var_arrays "[" "]"  */
+#line 184 "src/parser.bison"
+                                                                                                {(yyval.ident).type=ctype_arr   (ctx->asm_ctx, (yyvsp[-2].ident).type, NULL); (yyval.ident).pos=pos_merge((yyvsp[-2].ident).pos, (yyvsp[0].pos));}
+#line 1663 "build/parser.c"
+    break;
+
+  case 34: /* var_arrays: var_arrays "[" expr "]"  */
+#line 185 "src/parser.bison"
+                                                                                                {size_t i=expr_get_const(ctx, &(yyvsp[-1].expr)); (yyval.ident).type=ctype_arr(ctx->asm_ctx, (yyvsp[-3].ident).type, &i); (yyval.ident).pos=pos_merge((yyvsp[-3].ident).pos, (yyvsp[0].pos));}
+#line 1669 "build/parser.c"
+    break;
+
+  case 35: /* var_arrays: %empty  */
+#line 186 "src/parser.bison"
+                                                                                                                {(yyval.ident).type=ctype_simple(ctx->asm_ctx, ctx->s_type); (yyval.ident).pos=pos_empty(ctx->tokeniser_ctx);}
+#line 1675 "build/parser.c"
+    break;
+
+  case 36: /* var: var_stars TKN_IDENT var_arrays  */
+#line 189 "src/parser.bison"
+                                                                                {(yyval.ident)=ident_of_strval(ctx, &(yyvsp[-2].ident), &(yyvsp[-1].strval), &(yyvsp[0].ident)); (yyval.ident).pos=pos_merge((yyvsp[-2].ident).pos, (yyvsp[0].ident).pos);}
+#line 1681 "build/parser.c"
+    break;
+
+  case 37: /* var: var_stars "(" var ")" var_arrays  */
+#line 190 "src/parser.bison"
+                                                                                        {(yyval.ident)=ident_of_types (ctx, &(yyvsp[-4].ident), &(yyvsp[-2].ident), &(yyvsp[0].ident)); (yyval.ident).pos=pos_merge((yyvsp[-4].ident).pos, (yyvsp[0].ident).pos);}
+#line 1687 "build/parser.c"
+    break;
+
+  case 38: /* funcdef: simple_type var_nonarr "(" opt_params ")" "{" stmts "}"  */
+#line 201 "src/parser.bison"
+                                                                                                        {(yyval.func)=funcdef_decl(ctx, &(yyvsp[-7].simple_type), &(yyvsp[-6].ident), &(yyvsp[-4].idents), &(yyvsp[-1].stmts)); (yyval.func).pos=pos_merge((yyvsp[-7].simple_type).pos, (yyvsp[0].pos));}
+#line 1693 "build/parser.c"
+    break;
+
+  case 39: /* funcdef: simple_type var_nonarr "(" opt_params ")" ";"  */
+#line 204 "src/parser.bison"
+                                                                                                                        {(yyval.func)=funcdef_def(ctx, &(yyvsp[-5].simple_type), &(yyvsp[-4].ident), &(yyvsp[-2].idents));       (yyval.func).pos=pos_merge((yyvsp[-5].simple_type).pos, (yyvsp[0].pos));}
+#line 1699 "build/parser.c"
+    break;
+
+  case 40: /* vardecls: simple_type idents ";"  */
+#line 206 "src/parser.bison"
+                                                                                        {(yyval.idents)=(yyvsp[-1].idents);                                    (yyval.idents).pos=pos_merge((yyvsp[-2].simple_type).pos, (yyvsp[0].pos));}
+#line 1705 "build/parser.c"
+    break;
+
+  case 41: /* opt_params: params  */
+#line 209 "src/parser.bison"
+                                                                                                        {(yyval.idents)=(yyvsp[0].idents);}
+#line 1711 "build/parser.c"
+    break;
+
+  case 42: /* opt_params: %empty  */
+#line 210 "src/parser.bison"
+                                                                                                                {(yyval.idents)=idents_empty(ctx);                         (yyval.idents).pos=pos_empty(ctx->tokeniser_ctx);}
+#line 1717 "build/parser.c"
+    break;
+
+  case 43: /* params: params "," simple_type var_nonarr  */
+#line 211 "src/parser.bison"
+                                                                                {idents_cat_ex(ctx, &(yyvsp[-3].idents), &(yyvsp[0].ident), NULL); (yyval.idents)=(yyvsp[-3].idents);    (yyval.idents).pos=pos_merge((yyvsp[-3].idents).pos, (yyvsp[0].ident).pos);}
+#line 1723 "build/parser.c"
+    break;
+
+  case 44: /* params: simple_type var_nonarr  */
+#line 212 "src/parser.bison"
+                                                                                                {(yyval.idents)=idents_one_ex(ctx, &(yyvsp[0].ident), NULL);             (yyval.idents).pos=pos_merge((yyvsp[-1].simple_type).pos, (yyvsp[0].ident).pos);}
+#line 1729 "build/parser.c"
+    break;
+
+  case 45: /* idents: idents "," var "=" expr  */
+#line 213 "src/parser.bison"
+                                                                                        {idents_cat_ex(ctx, &(yyvsp[-4].idents), &(yyvsp[-2].ident), &(yyvsp[0].expr)); (yyval.idents)=(yyvsp[-4].idents);     (yyval.idents).pos=pos_merge((yyvsp[-4].idents).pos, (yyvsp[-2].ident).pos);}
+#line 1735 "build/parser.c"
+    break;
+
+  case 46: /* idents: idents "," var  */
+#line 214 "src/parser.bison"
+                                                                                                        {idents_cat_ex(ctx, &(yyvsp[-2].idents), &(yyvsp[0].ident), NULL); (yyval.idents)=(yyvsp[-2].idents);    (yyval.idents).pos=pos_merge((yyvsp[-2].idents).pos, (yyvsp[0].ident).pos);}
+#line 1741 "build/parser.c"
+    break;
+
+  case 47: /* idents: var "=" expr  */
+#line 215 "src/parser.bison"
+                                                                                                        {(yyval.idents)=idents_one_ex(ctx, &(yyvsp[-2].ident), &(yyvsp[0].expr));              (yyval.idents).pos=(yyvsp[-2].ident).pos;}
+#line 1747 "build/parser.c"
+    break;
+
+  case 48: /* idents: var  */
+#line 216 "src/parser.bison"
+                                                                                                                        {(yyval.idents)=idents_one_ex(ctx, &(yyvsp[0].ident), NULL);             (yyval.idents).pos=(yyvsp[0].ident).pos;}
+#line 1753 "build/parser.c"
+    break;
+
+  case 49: /* stmts: stmts stmt  */
+#line 219 "src/parser.bison"
+                                                                                                        {stmts_cat   (ctx, &(yyvsp[-1].stmts), &(yyvsp[0].stmt)); (yyval.stmts)=(yyvsp[-1].stmts);         (yyval.stmts).pos=pos_merge((yyvsp[-1].stmts).pos, (yyvsp[0].stmt).pos);}
+#line 1759 "build/parser.c"
+    break;
+
+  case 50: /* stmts: %empty  */
+#line 220 "src/parser.bison"
+                                                                                                                {(yyval.stmts)=stmts_empty (ctx);                       (yyval.stmts).pos=pos_empty(ctx->tokeniser_ctx);}
+#line 1765 "build/parser.c"
+    break;
+
+  case 51: /* stmt: "{" stmts "}"  */
+#line 221 "src/parser.bison"
+                                                                                                {(yyval.stmt)=stmt_multi  (ctx, &(yyvsp[-1].stmts));                  (yyval.stmt).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));}
+#line 1771 "build/parser.c"
+    break;
+
+  case 52: /* stmt: stmt_no_stmts  */
+#line 222 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=(yyvsp[0].stmt);}
+#line 1777 "build/parser.c"
+    break;
+
+  case 53: /* stmt_no_stmts: "if" "(" expr ")" stmt  */
+#line 223 "src/parser.bison"
+                                                                {(yyval.stmt)=stmt_if     (ctx, &(yyvsp[-2].expr), &(yyvsp[0].stmt), NULL);       (yyval.stmt).pos=pos_merge((yyvsp[-4].pos), (yyvsp[0].stmt).pos);}
+#line 1783 "build/parser.c"
+    break;
+
+  case 54: /* stmt_no_stmts: "if" "(" expr ")" stmt "else" stmt  */
+#line 225 "src/parser.bison"
+                                                                                                                {(yyval.stmt)=stmt_if     (ctx, &(yyvsp[-4].expr), &(yyvsp[-2].stmt), &(yyvsp[0].stmt));        (yyval.stmt).pos=pos_merge((yyvsp[-6].pos), (yyvsp[0].stmt).pos);}
+#line 1789 "build/parser.c"
+    break;
+
+  case 55: /* stmt_no_stmts: "while" "(" expr ")" stmt  */
+#line 226 "src/parser.bison"
+                                                                                                {(yyval.stmt)=stmt_while  (ctx, &(yyvsp[-2].expr), &(yyvsp[0].stmt));             (yyval.stmt).pos=pos_merge((yyvsp[-4].pos), (yyvsp[0].stmt).pos);}
+#line 1795 "build/parser.c"
+    break;
+
+  case 56: /* stmt_no_stmts: "for" "(" stmt_no_stmts opt_exprs ";" opt_exprs ")" stmt  */
+#line 228 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=stmt_for    (ctx, &(yyvsp[-5].stmt), &(yyvsp[-4].exprs), &(yyvsp[-2].exprs), &(yyvsp[0].stmt));   (yyval.stmt).pos=pos_merge((yyvsp[-7].pos), (yyvsp[0].stmt).pos);}
+#line 1801 "build/parser.c"
+    break;
+
+  case 57: /* stmt_no_stmts: "return" ";"  */
+#line 229 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=stmt_ret    (ctx, NULL);                 (yyval.stmt).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].pos));}
+#line 1807 "build/parser.c"
+    break;
+
+  case 58: /* stmt_no_stmts: "return" expr ";"  */
+#line 230 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=stmt_ret    (ctx, &(yyvsp[-1].expr));                  (yyval.stmt).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));}
+#line 1813 "build/parser.c"
+    break;
+
+  case 59: /* stmt_no_stmts: vardecls  */
+#line 231 "src/parser.bison"
+                                                                                                                {(yyval.stmt)=stmt_var    (ctx, &(yyvsp[0].idents));                  (yyval.stmt).pos=(yyvsp[0].idents).pos;}
+#line 1819 "build/parser.c"
+    break;
+
+  case 60: /* stmt_no_stmts: expr ";"  */
+#line 232 "src/parser.bison"
+                                                                                                                {(yyval.stmt)=stmt_expr   (ctx, &(yyvsp[-1].expr));                  (yyval.stmt).pos=pos_merge((yyvsp[-1].expr).pos, (yyvsp[0].pos));}
+#line 1825 "build/parser.c"
+    break;
+
+  case 61: /* stmt_no_stmts: inline_asm ";"  */
+#line 233 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=(yyvsp[-1].stmt);                                      (yyval.stmt).pos=pos_merge((yyvsp[-1].stmt).pos, (yyvsp[0].pos));}
+#line 1831 "build/parser.c"
+    break;
+
+  case 62: /* stmt_no_stmts: ";"  */
+#line 234 "src/parser.bison"
+                                                                                                                        {(yyval.stmt)=stmt_empty  (ctx);                       (yyval.stmt).pos=(yyvsp[0].pos);}
+#line 1837 "build/parser.c"
+    break;
+
+  case 63: /* opt_exprs: exprs  */
+#line 237 "src/parser.bison"
+                                                                                                        {(yyval.exprs)=(yyvsp[0].exprs);}
+#line 1843 "build/parser.c"
+    break;
+
+  case 64: /* opt_exprs: %empty  */
+#line 238 "src/parser.bison"
+                                                                                                                {(yyval.exprs)=exprs_empty(ctx);}
+#line 1849 "build/parser.c"
+    break;
+
+  case 65: /* exprs: exprs "," expr  */
+#line 239 "src/parser.bison"
+                                                                                                {exprs_cat (ctx, &(yyvsp[-2].exprs), &(yyvsp[0].expr)); (yyval.exprs)=(yyvsp[-2].exprs);           (yyval.exprs).pos=pos_merge((yyvsp[-2].exprs).pos, (yyvsp[0].expr).pos);}
+#line 1855 "build/parser.c"
+    break;
+
+  case 66: /* exprs: expr  */
+#line 240 "src/parser.bison"
+                                                                                                                {(yyval.exprs)=exprs_one (ctx, &(yyvsp[0].expr));                    (yyval.exprs).pos=(yyvsp[0].expr).pos;}
+#line 1861 "build/parser.c"
+    break;
+
+  case 67: /* expr: TKN_IVAL  */
+#line 241 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_icnst(ctx, &(yyvsp[0].ival));                    (yyval.expr).pos=(yyvsp[0].ival).pos;}
+#line 1867 "build/parser.c"
+    break;
+
+  case 68: /* expr: TKN_STRVAL  */
+#line 242 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_scnst(ctx, &(yyvsp[0].strval));                    (yyval.expr).pos=(yyvsp[0].strval).pos;}
+#line 1873 "build/parser.c"
+    break;
+
+  case 69: /* expr: TKN_IDENT  */
+#line 243 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_ident(ctx, &(yyvsp[0].strval));                    (yyval.expr).pos=(yyvsp[0].strval).pos;}
+#line 1879 "build/parser.c"
+    break;
+
+  case 70: /* expr: expr "(" opt_exprs ")"  */
+#line 244 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_call (ctx, &(yyvsp[-3].expr), &(yyvsp[-1].exprs));               (yyval.expr).pos=pos_merge((yyvsp[-3].expr).pos, (yyvsp[0].pos));}
+#line 1885 "build/parser.c"
+    break;
+
+  case 71: /* expr: expr "[" expr "]"  */
+#line 245 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_INDEX, &(yyvsp[-3].expr), &(yyvsp[-1].expr));     (yyval.expr).pos=pos_merge((yyvsp[-3].expr).pos, (yyvsp[0].pos));}
+#line 1891 "build/parser.c"
+    break;
+
+  case 72: /* expr: "(" expr ")"  */
+#line 246 "src/parser.bison"
+                                                                                                        {(yyval.expr)=(yyvsp[-1].expr);                                      (yyval.expr).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));}
+#line 1897 "build/parser.c"
+    break;
+
+  case 73: /* expr: expr "++"  */
+#line 248 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_POST_INC,  &(yyvsp[-1].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].expr).pos, (yyvsp[0].pos));}
+#line 1903 "build/parser.c"
+    break;
+
+  case 74: /* expr: expr "--"  */
+#line 249 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_POST_DEC,  &(yyvsp[-1].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].expr).pos, (yyvsp[0].pos));}
+#line 1909 "build/parser.c"
+    break;
+
+  case 75: /* expr: "++" expr  */
+#line 251 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1a(ctx, OP_ADD,      &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1915 "build/parser.c"
+    break;
+
+  case 76: /* expr: "--" expr  */
+#line 252 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1a(ctx, OP_SUB,      &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1921 "build/parser.c"
+    break;
+
+  case 77: /* expr: "-" expr  */
+#line 254 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_0_MINUS,   &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1927 "build/parser.c"
+    break;
+
+  case 78: /* expr: "!" expr  */
+#line 255 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_LOGIC_NOT, &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1933 "build/parser.c"
+    break;
+
+  case 79: /* expr: "~" expr  */
+#line 256 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_BIT_NOT,   &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1939 "build/parser.c"
+    break;
+
+  case 80: /* expr: "&" expr  */
+#line 257 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_ADROF,     &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1945 "build/parser.c"
+    break;
+
+  case 81: /* expr: "*" expr  */
+#line 258 "src/parser.bison"
+                                                                                                                {(yyval.expr)=expr_math1(ctx, OP_DEREF,     &(yyvsp[0].expr));      (yyval.expr).pos=pos_merge((yyvsp[-1].pos), (yyvsp[0].expr).pos);}
+#line 1951 "build/parser.c"
+    break;
+
+  case 82: /* expr: expr "*" expr  */
+#line 260 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_MUL,       &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1957 "build/parser.c"
+    break;
+
+  case 83: /* expr: expr "/" expr  */
+#line 261 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_DIV,       &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1963 "build/parser.c"
+    break;
+
+  case 84: /* expr: expr "%" expr  */
+#line 262 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_MOD,       &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1969 "build/parser.c"
+    break;
+
+  case 85: /* expr: expr "+" expr  */
+#line 264 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_ADD,       &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1975 "build/parser.c"
+    break;
+
+  case 86: /* expr: expr "-" expr  */
+#line 265 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_SUB,       &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1981 "build/parser.c"
+    break;
+
+  case 87: /* expr: expr "<" expr  */
+#line 267 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_LT,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1987 "build/parser.c"
+    break;
+
+  case 88: /* expr: expr "<=" expr  */
+#line 268 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_LE,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1993 "build/parser.c"
+    break;
+
+  case 89: /* expr: expr ">" expr  */
+#line 269 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_GT,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 1999 "build/parser.c"
+    break;
+
+  case 90: /* expr: expr ">=" expr  */
+#line 270 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_GE,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2005 "build/parser.c"
+    break;
+
+  case 91: /* expr: expr "==" expr  */
+#line 272 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_NE,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2011 "build/parser.c"
+    break;
+
+  case 92: /* expr: expr "!=" expr  */
+#line 273 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_EQ,        &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2017 "build/parser.c"
+    break;
+
+  case 93: /* expr: expr "&" expr  */
+#line 275 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_BIT_AND,   &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2023 "build/parser.c"
+    break;
+
+  case 94: /* expr: expr "^" expr  */
+#line 276 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_BIT_XOR,   &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2029 "build/parser.c"
+    break;
+
+  case 95: /* expr: expr "|" expr  */
+#line 277 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_BIT_OR,    &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2035 "build/parser.c"
+    break;
+
+  case 96: /* expr: expr "<<" expr  */
+#line 278 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_SHIFT_L,   &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2041 "build/parser.c"
+    break;
+
+  case 97: /* expr: expr ">>" expr  */
+#line 279 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2(ctx, OP_SHIFT_R,   &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2047 "build/parser.c"
+    break;
+
+  case 98: /* expr: expr "&&" expr  */
+#line 281 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_LOGIC_AND, &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2053 "build/parser.c"
+    break;
+
+  case 99: /* expr: expr "||" expr  */
+#line 282 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_LOGIC_OR,  &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2059 "build/parser.c"
+    break;
+
+  case 100: /* expr: expr "=" expr  */
+#line 284 "src/parser.bison"
+                                                                                                        {(yyval.expr)=expr_math2(ctx, OP_ASSIGN,    &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2065 "build/parser.c"
+    break;
+
+  case 101: /* expr: expr "+=" expr  */
+#line 285 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_ADD,      &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2071 "build/parser.c"
+    break;
+
+  case 102: /* expr: expr "-=" expr  */
+#line 286 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_SUB,      &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2077 "build/parser.c"
+    break;
+
+  case 103: /* expr: expr "*=" expr  */
+#line 287 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_MUL,      &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2083 "build/parser.c"
+    break;
+
+  case 104: /* expr: expr "/=" expr  */
+#line 288 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_DIV,      &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2089 "build/parser.c"
+    break;
+
+  case 105: /* expr: expr "%=" expr  */
+#line 289 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_MOD,      &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2095 "build/parser.c"
+    break;
+
+  case 106: /* expr: expr "&=" expr  */
+#line 290 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_BIT_AND,  &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2101 "build/parser.c"
+    break;
+
+  case 107: /* expr: expr "|=" expr  */
+#line 291 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_BIT_OR,   &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2107 "build/parser.c"
+    break;
+
+  case 108: /* expr: expr "^=" expr  */
+#line 292 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_BIT_XOR,  &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2113 "build/parser.c"
+    break;
+
+  case 109: /* expr: expr "<<=" expr  */
+#line 293 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_SHIFT_L,  &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2119 "build/parser.c"
+    break;
+
+  case 110: /* expr: expr ">>=" expr  */
+#line 294 "src/parser.bison"
+                                                                                                {(yyval.expr)=expr_math2a(ctx, OP_SHIFT_R,  &(yyvsp[-2].expr), &(yyvsp[0].expr)); (yyval.expr).pos=pos_merge((yyvsp[-2].expr).pos, (yyvsp[0].expr).pos);}
+#line 2125 "build/parser.c"
+    break;
+
+  case 111: /* inline_asm: "asm" asm_qual asm_code  */
+#line 297 "src/parser.bison"
+                                                                                        {(yyval.stmt)=(yyvsp[0].stmt); (yyval.stmt).iasm->qualifiers=(yyvsp[-1].asm_qual); (yyval.stmt).iasm->qualifiers.is_volatile |= !(yyval.stmt).iasm->outputs;}
+#line 2131 "build/parser.c"
+    break;
+
+  case 112: /* asm_qual: %empty  */
+#line 299 "src/parser.bison"
+                                                                                                        {(yyval.asm_qual)=(iasm_qual_t) {0, 0, 0};                 (yyval.asm_qual).pos=pos_empty(ctx->tokeniser_ctx);}
+#line 2137 "build/parser.c"
+    break;
+
+  case 113: /* asm_qual: asm_qual "volatile"  */
+#line 300 "src/parser.bison"
+                                                                                                        {(yyval.asm_qual)=(yyvsp[-1].asm_qual); (yyval.asm_qual).is_volatile=1;                    (yyval.asm_qual).pos=pos_merge((yyvsp[-1].asm_qual).pos, (yyvsp[0].pos));}
+#line 2143 "build/parser.c"
+    break;
+
+  case 114: /* asm_qual: asm_qual "inline"  */
+#line 301 "src/parser.bison"
+                                                                                                        {(yyval.asm_qual)=(yyvsp[-1].asm_qual); (yyval.asm_qual).is_inline=1;                      (yyval.asm_qual).pos=pos_merge((yyvsp[-1].asm_qual).pos, (yyvsp[0].pos));}
+#line 2149 "build/parser.c"
+    break;
+
+  case 115: /* asm_qual: asm_qual "goto"  */
+#line 302 "src/parser.bison"
+                                                                                                        {(yyval.asm_qual)=(yyvsp[-1].asm_qual); (yyval.asm_qual).is_goto=1;                        (yyval.asm_qual).pos=pos_merge((yyvsp[-1].asm_qual).pos, (yyvsp[0].pos));}
+#line 2155 "build/parser.c"
+    break;
+
+  case 116: /* asm_code: "(" TKN_STRVAL ":" opt_asm_regs ":" opt_asm_regs ":" opt_asm_strs ")"  */
+#line 307 "src/parser.bison"
+                                                                                                {(yyval.stmt)=stmt_iasm(ctx, &(yyvsp[-7].strval), &(yyvsp[-5].asm_regs),  &(yyvsp[-3].asm_regs),  NULL);   (yyval.stmt).pos=pos_merge((yyvsp[-8].pos), (yyvsp[0].pos));}
+#line 2161 "build/parser.c"
+    break;
+
+  case 117: /* asm_code: "(" TKN_STRVAL ":" opt_asm_regs ":" opt_asm_regs ")"  */
+#line 310 "src/parser.bison"
+                                                                                                {(yyval.stmt)=stmt_iasm(ctx, &(yyvsp[-5].strval), &(yyvsp[-3].asm_regs),  &(yyvsp[-1].asm_regs),  NULL);   (yyval.stmt).pos=pos_merge((yyvsp[-6].pos), (yyvsp[0].pos));}
+#line 2167 "build/parser.c"
+    break;
+
+  case 118: /* asm_code: "(" TKN_STRVAL ":" opt_asm_regs ")"  */
+#line 312 "src/parser.bison"
+                                                                                                {(yyval.stmt)=stmt_iasm(ctx, &(yyvsp[-3].strval), &(yyvsp[-1].asm_regs),  NULL, NULL);   (yyval.stmt).pos=pos_merge((yyvsp[-4].pos), (yyvsp[0].pos));}
+#line 2173 "build/parser.c"
+    break;
+
+  case 119: /* asm_code: "(" TKN_STRVAL ")"  */
+#line 313 "src/parser.bison"
+                                                                                                        {(yyval.stmt)=stmt_iasm(ctx, &(yyvsp[-1].strval), NULL, NULL, NULL);   (yyval.stmt).pos=pos_merge((yyvsp[-2].pos), (yyvsp[0].pos));}
+#line 2179 "build/parser.c"
+    break;
+
+  case 124: /* opt_asm_regs: asm_regs  */
+#line 319 "src/parser.bison"
+                                                                                                {(yyval.asm_regs)=(yyvsp[0].asm_regs);}
+#line 2185 "build/parser.c"
+    break;
+
+  case 125: /* opt_asm_regs: %empty  */
+#line 320 "src/parser.bison"
+                                                                                                                {(yyval.asm_regs)=iasm_regs_empty(ctx);                    (yyval.asm_regs).pos=pos_empty(ctx->tokeniser_ctx);}
+#line 2191 "build/parser.c"
+    break;
+
+  case 126: /* asm_regs: asm_reg "," asm_regs  */
+#line 321 "src/parser.bison"
+                                                                                        {iasm_regs_cat(ctx, &(yyvsp[0].asm_regs), &(yyvsp[-2].asm_reg)); (yyval.asm_regs)=(yyvsp[0].asm_regs);        (yyval.asm_regs).pos=pos_merge((yyvsp[-2].asm_reg).pos, (yyvsp[0].asm_regs).pos);}
+#line 2197 "build/parser.c"
+    break;
+
+  case 127: /* asm_regs: asm_reg  */
+#line 322 "src/parser.bison"
+                                                                                                                {(yyval.asm_regs)=iasm_regs_one(ctx, &(yyvsp[0].asm_reg));                 (yyval.asm_regs).pos=(yyvsp[0].asm_reg).pos;}
+#line 2203 "build/parser.c"
+    break;
+
+  case 128: /* asm_reg: "[" TKN_IDENT "]" TKN_STRVAL "(" expr ")"  */
+#line 323 "src/parser.bison"
+                                                                        {(yyval.asm_reg)=stmt_iasm_reg(ctx, &(yyvsp[-5].strval),  &(yyvsp[-3].strval), &(yyvsp[-1].expr));      (yyval.asm_reg).pos=pos_merge((yyvsp[-6].pos), (yyvsp[0].pos));}
+#line 2209 "build/parser.c"
+    break;
+
+  case 129: /* asm_reg: TKN_STRVAL "(" expr ")"  */
+#line 324 "src/parser.bison"
+                                                                                                {(yyval.asm_reg)=stmt_iasm_reg(ctx, NULL, &(yyvsp[-3].strval), &(yyvsp[-1].expr));      (yyval.asm_reg).pos=pos_merge((yyvsp[-3].strval).pos, (yyvsp[0].pos));}
+#line 2215 "build/parser.c"
+    break;
+
+
+#line 2219 "build/parser.c"
+
+      default: break;
+    }
+  /* User semantic actions sometimes alter yychar, and that requires
+     that yytoken be updated with the new translation.  We take the
+     approach of translating immediately before every use of yytoken.
+     One alternative is translating here after every semantic action,
+     but that translation would be missed if the semantic action invokes
+     YYABORT, YYACCEPT, or YYERROR immediately after altering yychar or
+     if it invokes YYBACKUP.  In the case of YYABORT or YYACCEPT, an
+     incorrect destructor might then be invoked immediately.  In the
+     case of YYERROR or YYBACKUP, subsequent parser actions might lead
+     to an incorrect destructor call or verbose syntax error message
+     before the lookahead is translated.  */
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
+
+  YYPOPSTACK (yylen);
+  yylen = 0;
+
+  *++yyvsp = yyval;
+
+  /* Now 'shift' the result of the reduction.  Determine what state
+     that goes to, based on the state we popped back to and the rule
+     number reduced by.  */
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
+
+  goto yynewstate;
+
+
+/*--------------------------------------.
+| yyerrlab -- here on detecting error.  |
+`--------------------------------------*/
+yyerrlab:
+  /* Make sure we have latest lookahead translation.  See comments at
+     user semantic actions for why this is necessary.  */
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
+  /* If not already recovering from an error, report this error.  */
+  if (!yyerrstatus)
+    {
+      ++yynerrs;
+      yyerror (ctx, YY_("syntax error"));
+    }
+
+  if (yyerrstatus == 3)
+    {
+      /* If just tried and failed to reuse lookahead token after an
+         error, discard it.  */
+
+      if (yychar <= YYEOF)
+        {
+          /* Return failure if at end of input.  */
+          if (yychar == YYEOF)
+            YYABORT;
+        }
+      else
+        {
+          yydestruct ("Error: discarding",
+                      yytoken, &yylval, ctx);
+          yychar = YYEMPTY;
+        }
+    }
+
+  /* Else will try to reuse lookahead token after shifting the error
+     token.  */
+  goto yyerrlab1;
+
+
+/*---------------------------------------------------.
+| yyerrorlab -- error raised explicitly by YYERROR.  |
+`---------------------------------------------------*/
+yyerrorlab:
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
+
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYERROR.  */
+  YYPOPSTACK (yylen);
+  yylen = 0;
+  YY_STACK_PRINT (yyss, yyssp);
+  yystate = *yyssp;
+  goto yyerrlab1;
+
+
+/*-------------------------------------------------------------.
+| yyerrlab1 -- common code for both syntax error and YYERROR.  |
+`-------------------------------------------------------------*/
+yyerrlab1:
+  yyerrstatus = 3;      /* Each real token shifted decrements this.  */
+
+  /* Pop stack until we find a state that shifts the error token.  */
+  for (;;)
+    {
+      yyn = yypact[yystate];
+      if (!yypact_value_is_default (yyn))
+        {
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
+            {
+              yyn = yytable[yyn];
+              if (0 < yyn)
+                break;
+            }
+        }
+
+      /* Pop the current state because it cannot handle the error token.  */
+      if (yyssp == yyss)
+        YYABORT;
+
+
+      yydestruct ("Error: popping",
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp, ctx);
+      YYPOPSTACK (1);
+      yystate = *yyssp;
+      YY_STACK_PRINT (yyss, yyssp);
+    }
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+
+  /* Shift the error token.  */
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
+
+  yystate = yyn;
+  goto yynewstate;
+
+
+/*-------------------------------------.
+| yyacceptlab -- YYACCEPT comes here.  |
+`-------------------------------------*/
+yyacceptlab:
+  yyresult = 0;
+  goto yyreturnlab;
+
+
+/*-----------------------------------.
+| yyabortlab -- YYABORT comes here.  |
+`-----------------------------------*/
+yyabortlab:
+  yyresult = 1;
+  goto yyreturnlab;
+
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
+yyexhaustedlab:
+  yyerror (ctx, YY_("memory exhausted"));
+  yyresult = 2;
+  goto yyreturnlab;
+
+
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
+  if (yychar != YYEMPTY)
+    {
+      /* Make sure we have latest lookahead translation.  See comments at
+         user semantic actions for why this is necessary.  */
+      yytoken = YYTRANSLATE (yychar);
+      yydestruct ("Cleanup: discarding lookahead",
+                  yytoken, &yylval, ctx);
+    }
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYABORT or YYACCEPT.  */
+  YYPOPSTACK (yylen);
+  YY_STACK_PRINT (yyss, yyssp);
+  while (yyssp != yyss)
+    {
+      yydestruct ("Cleanup: popping",
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp, ctx);
+      YYPOPSTACK (1);
+    }
+#ifndef yyoverflow
+  if (yyss != yyssa)
+    YYSTACK_FREE (yyss);
+#endif
+
+  return yyresult;
+}
+
+#line 325 "src/parser.bison"
+
+
+void *xmake_copy(alloc_ctx_t alloc, void *mem, size_t size) {
+	if (!mem) return NULL;
+	void *copy = xalloc(alloc, size);
+	memcpy(copy, mem, size);
+	return copy;
+}
@@ -3,6 +3,7 @@
 #include <gen.h>
 #include <gr8cpu-r3_gen.h>
 #include <tokeniser.h>
+#include <keywords.h>
 #include <strings.h>
 #include <string.h>
 #include <stdlib.h>
@@ -48,6 +49,11 @@ char *r3_iasm_keyw[] = {
 	"y",    "stl",  "sth",  "f", 
 };
 
+// Perfect hash lookup over r3_iasm_keyw.
+static keyw_table_t r3_iasm_keyw_table = KEYW_TABLE(r3_iasm_keyw, true);
+// Labels up to this length are checked for keywords without being copied.
+#define R3_KEYW_PEEK_LEN 16
+
 // Addressing modes belonging to instructions.
 r3_iasm_modes_t r3_insn_lut[46] = {
 	{ // bki
@@ -504,6 +510,25 @@ r3_token_t r3_iasm_lex(tokeniser_ctx_t *ctx) {
 		int offs = 0;
 		while (r3_is_label_char(tokeniser_nextchar_no(ctx, offs))) offs++;
 		offs ++;
+		// Check for keywords before copying anything.
+		if (offs <= R3_KEYW_PEEK_LEN) {
+			char peek[R3_KEYW_PEEK_LEN];
+			peek[0] = c;
+			for (int i = 1; i < offs; i++) {
+				peek[i] = tokeniser_nextchar_no(ctx, i - 1);
+			}
+			int keyw = keyw_lookup(&r3_iasm_keyw_table, peek, offs);
+			if (keyw != -1) {
+				DEBUG_TKN("keyw  '%s'\n", r3_iasm_keyw[keyw]);
+				for (int i = 1; i < offs; i++) {
+					tokeniser_readchar(ctx);
+				}
+				return (r3_token_t) {
+					.type  = (r3_iasm_token_id_t) keyw,
+					.ident = r3_iasm_keyw[keyw]
+				};
+			}
+		}
 		// Now, grab it.
 		char *strval = (char *) malloc(sizeof(char) * (offs + 1));
 		*strval = c;
@@ -511,17 +536,6 @@ r3_token_t r3_iasm_lex(tokeniser_ctx_t *ctx) {
 		for (int i = 1; i < offs; i++) {
 			strval[i] = tokeniser_readchar(ctx);
 		}
-		// Next, check for keywords.
-		for (size_t i = 0; i < R3_NUM_KEYW; i++) {
-			if (!strcasecmp(strval, r3_iasm_keyw[i])) {
-				DEBUG_TKN("keyw  '%s'\n", strval);
-				free(strval);
-				return (r3_token_t) {
-					.type  = (r3_iasm_token_id_t) i,
-					.ident = r3_iasm_keyw[i]
-				};
-			}
-		}
 		DEBUG_TKN("ident '%s'\n", strval);
 		// Return the appropriate alternative.
 		return (r3_token_t) {
@@ -98,7 +98,7 @@ void px_vacate_reg(asm_ctx_t *ctx, reg_t regno) {
 		// Move it in.
 		gen_mov(ctx, temp_loc, stored);
 		*stored = *temp_loc;
-		xfree(ctx->current_scope->allocator, temp_loc);
+		gen_var_free(ctx, temp_loc);
 		DEBUG_GEN("// Vacated to temp loc.\n");
 	}
 	
@@ -106,6 +106,26 @@ void px_vacate_reg(asm_ctx_t *ctx, reg_t regno) {
 	ctx->current_scope->reg_usage[regno] = NULL;
 }
 
+// Returns a temporary variable to the pool, unless a register is still marked as holding it.
+static void px_free_tmp(asm_ctx_t *ctx, gen_var_t *var) {
+	for (reg_t i = 0; i < NUM_REGS; i++) {
+		if (ctx->current_scope->reg_usage[i] == var) return;
+	}
+	gen_var_free(ctx, var);
+}
+
+// Makes sure a pointer dereference can be used as memory operand, by moving the pointer to a register.
+static void px_ptr_to_reg(asm_ctx_t *ctx, gen_var_t *var) {
+	if (var->type == VAR_TYPE_PTR && var->ptr->type != VAR_TYPE_CONST && var->ptr->type != VAR_TYPE_REG) {
+		// Make the pointer into a register.
+		reg_t regno    = px_pick_reg(ctx, true);
+		px_mov_to_reg(ctx, var->ptr, regno);
+		ctx->current_scope->reg_usage[regno] = var;
+		var->ptr->type = VAR_TYPE_REG;
+		var->ptr->reg  = regno;
+	}
+}
+
 // Creates MATH1 instructions.
 gen_var_t *px_math1(asm_ctx_t *ctx, memword_t opcode, gen_var_t *out_hint, gen_var_t *a) {
 	gen_var_t *output = out_hint;
@@ -130,14 +150,7 @@ gen_var_t *px_math1(asm_ctx_t *ctx, memword_t opcode, gen_var_t *out_hint, gen_v
 	}
 	
 	// Pointer conversion check.
-	if (a->type == VAR_TYPE_PTR && a->ptr->type != VAR_TYPE_CONST && a->ptr->type != VAR_TYPE_REG) {
-		// Make the pointer into a register.
-		reg_t regno  = px_pick_reg(ctx, true);
-		px_mov_to_reg(ctx, a->ptr, regno);
-		ctx->current_scope->reg_usage[regno] = a;
-		a->ptr->type = VAR_TYPE_REG;
-		a->ptr->reg  = regno;
-	}
+	px_ptr_to_reg(ctx, a);
 	
 	// A fancy for loop.
 	for (; i != limit; i += delta) {
@@ -211,6 +224,9 @@ gen_var_t *px_math2(asm_ctx_t *ctx, memword_t opcode, gen_var_t *out_hint, gen_v
 		// Perform the copy.
 		gen_mov(ctx, output, a);
 		a = output;
+	} else {
+		// A is operated on in place, e.g. by compound assignment.
+		px_ptr_to_reg(ctx, a);
 	}
 	
 	// Whether a temp register is required.
@@ -369,8 +385,8 @@ void gen_function_entry(asm_ctx_t *ctx, funcdef_t *funcdef) {
 		// Define variables in registers.
 		address_t arg_size = 0;
 		for (size_t i = 0; i < funcdef->args.num; i++) {
-			gen_var_t *var = xalloc(ctx->allocator, sizeof(gen_var_t));
-			gen_var_t *loc = xalloc(ctx->allocator, sizeof(gen_var_t));
+			gen_var_t *var = gen_var_alloc(ctx);
+			gen_var_t *loc = gen_var_alloc(ctx);
 			
 			// Variable in register.
 			*var = (gen_var_t) {
@@ -405,7 +421,7 @@ void gen_function_entry(asm_ctx_t *ctx, funcdef_t *funcdef) {
 		// First parameter has least offset.
 		address_t arg_size = 0;
 		for (size_t i = 0; i < funcdef->args.num; i++) {
-			gen_var_t *var = xalloc(ctx->allocator, sizeof(gen_var_t));
+			gen_var_t *var = gen_var_alloc(ctx);
 			
 			// Variable in stack.
 			*var = (gen_var_t) {
@@ -416,7 +432,7 @@ void gen_function_entry(asm_ctx_t *ctx, funcdef_t *funcdef) {
 				.default_loc = NULL
 			};
 			// Which is also it's default location.
-			var->default_loc = XCOPY(ctx->allocator, var, gen_var_t);
+			var->default_loc = gen_var_copy(ctx, var);
 			
 			gen_define_var(ctx, var, funcdef->args.arr[i].strval);
 			arg_size += var->ctype->size;
@@ -731,7 +747,7 @@ char *gen_iasm_var(asm_ctx_t *ctx, gen_var_t *var, iasm_reg_t *reg) {
 	if (reg->mode_register) {
 		reg_t regno = px_pick_reg(ctx, true);
 		px_mov_to_reg(ctx, var, regno);
-		gen_var_t *default_loc = XCOPY(ctx->allocator, var, gen_var_t);
+		gen_var_t *default_loc = gen_var_copy(ctx, var);
 		var->type        = VAR_TYPE_REG;
 		var->reg         = regno;
 		var->default_loc = default_loc;
@@ -797,7 +813,7 @@ gen_var_t *gen_expr_call(asm_ctx_t *ctx, funcdef_t *funcdef, expr_t *callee, siz
 		regindex = 0;
 		for (size_t i = 0; i < n_args; i++) {
 			// Make an output hint for the appropriate register.
-			gen_var_t *out_hint = xalloc(ctx->allocator, sizeof(gen_var_t));
+			gen_var_t *out_hint = gen_var_alloc(ctx);
 			*out_hint = (gen_var_t) {
 				.type  = VAR_TYPE_REG,
 				.reg   = regindex,
@@ -821,6 +837,11 @@ gen_var_t *gen_expr_call(asm_ctx_t *ctx, funcdef_t *funcdef, expr_t *callee, siz
 			gen_mov(ctx, hints[i], locations[i]);
 		}
 		
+		// The hints are done with, unless a parameter was generated right into one.
+		for (size_t i = 0; i < n_args; i++) {
+			if (hints[i] != locations[i]) px_free_tmp(ctx, hints[i]);
+		}
+		
 	} else if (funcdef->call_conv == PX_CC_STACK) {
 		DEBUG_GEN("// Writing call for convention: stack\n");
 		
@@ -910,7 +931,7 @@ gen_var_t *gen_expr_call(asm_ctx_t *ctx, funcdef_t *funcdef, expr_t *callee, siz
 	
 	if (funcdef->returns && funcdef->returns->simple_type != STYPE_VOID) {
 		// Make a return with values.
-		gen_var_t *retval = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+		gen_var_t *retval = gen_var_alloc(ctx);
 		if (funcdef->returns->size <= NUM_REGS) {
 			// Registrex.
 			*retval = (gen_var_t) {
@@ -945,7 +966,7 @@ gen_var_t *gen_expr_call(asm_ctx_t *ctx, funcdef_t *funcdef, expr_t *callee, siz
 			.owner       = NULL,
 			.default_loc = NULL,
 		};
-		return XCOPY(ctx->allocator, &dummy, gen_var_t);
+		return gen_var_copy(ctx, &dummy);
 	}
 }
 
@@ -1078,7 +1099,7 @@ gen_var_t *gen_expr_math2(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		gen_var_t *output = out_hint;
 		if (!output || output->type != VAR_TYPE_COND) {
 			// Make a new output.
-			output  = xalloc(ctx->allocator, sizeof(gen_var_t));
+			output  = gen_var_alloc(ctx);
 			*output = (gen_var_t) {
 				.type        = VAR_TYPE_COND,
 				.ctype       = ctype_simple(ctx, STYPE_BOOL),
@@ -1101,7 +1122,7 @@ gen_var_t *gen_expr_math2(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 	
 	if (oper == OP_INDEX) {
 		// Construct the indexing hint.
-		gen_var_t *hint = xalloc(ctx->allocator, sizeof(gen_var_t));
+		gen_var_t *hint = gen_var_alloc(ctx);
 		*hint = (gen_var_t) {
 			.type        = VAR_TYPE_INDEXED,
 			.indexed     = {
@@ -1118,12 +1139,28 @@ gen_var_t *gen_expr_math2(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		if (out_hint) {
 			// Move directly to the destination thing.
 			gen_mov(ctx, out_hint, hint);
+			gen_var_free(ctx, hint);
 			return out_hint;
 		} else {
 			// Just give back the hint.
 			return hint;
 		}
 		
+	} else if (OP_IS_SHIFT(oper) && b->type == VAR_TYPE_CONST) {
+		// Shift by a constant: Pixie 16 only shifts by one bit at a time.
+		address_t n_bits = b->iconst < a->ctype->size * MEM_BITS ? b->iconst : a->ctype->size * MEM_BITS;
+		if (!n_bits) {
+			// Nothing to shift.
+			if (!out_hint) return a;
+			gen_mov(ctx, out_hint, a);
+			return out_hint;
+		}
+		gen_var_t *output = gen_expr_math1(ctx, expr, oper, out_hint, a);
+		for (address_t i = 1; i < n_bits; i++) {
+			output = gen_expr_math1(ctx, expr, oper, output, output);
+		}
+		return output;
+		
 	} else if (OP_IS_SHIFT(oper)) {
 		// TODO.
 	} else if (OP_IS_COMP(oper)) {
@@ -1132,7 +1169,7 @@ gen_var_t *gen_expr_math2(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		gen_unuse(ctx, ignored);
 		
 		// Give back a condition representation.
-		gen_var_t *cond = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+		gen_var_t *cond = gen_var_alloc(ctx);
 		*cond = (gen_var_t) {
 			.type        = VAR_TYPE_COND,
 			.ctype       = ctype_simple(ctx, STYPE_BOOL),
@@ -1151,7 +1188,7 @@ gen_var_t *gen_expr_math2(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		}
 		
 		return cond;
-
+	
 	} else {
 		// General math stuff.
 		memword_t opcode = 0;
@@ -1222,7 +1259,7 @@ gen_var_t *gen_expr_math1(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		cmp1:
 		if (!output || output->type != VAR_TYPE_COND) {
 			// Make a new output.
-			output  = xalloc(ctx->allocator, sizeof(gen_var_t));
+			output  = gen_var_alloc(ctx);
 			*output = (gen_var_t) {
 				.type        = VAR_TYPE_COND,
 				.ctype       = ctype_simple(ctx, STYPE_BOOL),
@@ -1262,7 +1299,7 @@ gen_var_t *gen_expr_math1(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 		return px_math1(ctx, PX_OP_SHR, output, a);
 	} else if (oper == OP_DEREF) {
 		// Look at where the pointer goes to.
-		gen_var_t *var = xalloc(ctx->allocator, sizeof(gen_var_t));
+		gen_var_t *var = gen_var_alloc(ctx);
 		var->type        = VAR_TYPE_PTR;
 		var->ctype       = a->ctype->underlying;
 		var->ptr         = a;
@@ -1305,7 +1342,7 @@ gen_var_t *gen_expr_math1(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 			if (use_hint) {
 				var = output;
 			} else {
-				var = xalloc(ctx->allocator, sizeof(gen_var_t));
+				var = gen_var_alloc(ctx);
 				var->owner       = NULL;
 				var->default_loc = NULL;
 				var->reg         = regno;
@@ -1332,7 +1369,7 @@ gen_var_t *gen_expr_math1(asm_ctx_t *ctx, expr_t *expr, oper_t oper, gen_var_t *
 			if (use_hint) {
 				var = output;
 			} else {
-				var = xalloc(ctx->allocator, sizeof(gen_var_t));
+				var = gen_var_alloc(ctx);
 				var->owner       = NULL;
 				var->default_loc = NULL;
 				var->reg         = regno;
@@ -1598,7 +1635,7 @@ void px_var_to_reg(asm_ctx_t *ctx, gen_var_t *var, bool allow_const) {
 	// Check whether it's already in a register.
 	if ((var->type != VAR_TYPE_CONST || !allow_const) && var->type != VAR_TYPE_REG) {
 		// Make a copy of the original.
-		gen_var_t *orig = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+		gen_var_t *orig = gen_var_alloc(ctx);
 		memcpy(orig, var, sizeof(gen_var_t));
 		
 		// Reconfigure the variable.
@@ -1615,7 +1652,7 @@ void px_var_to_reg(asm_ctx_t *ctx, gen_var_t *var, bool allow_const) {
 		
 		// Clean up.
 		if (orig->default_loc) {
-			xfree(ctx->current_scope->allocator, orig);
+			gen_var_free(ctx, orig);
 		}
 	}
 }
@@ -1637,7 +1674,7 @@ void gen_mov(asm_ctx_t *ctx, gen_var_t *dst, gen_var_t *src) {
 		gen_var_t *to_free = dst->default_loc;
 		*dst = *dst->default_loc;
 		// Free up old memory.
-		xfree(ctx->allocator, to_free);
+		gen_var_free(ctx, to_free);
 	}
 	
 	// Normal copy.
@@ -1667,7 +1704,7 @@ gen_var_t *gen_preproc_var(asm_ctx_t *ctx, preproc_data_t *parent, ident_t *iden
 	};
 	
 	// And return a copy.
-	return XCOPY(ctx->allocator, &loc, gen_var_t);
+	return gen_var_copy(ctx, &loc);
 }
 
 // Variables: Populate the value from initialiser expression.
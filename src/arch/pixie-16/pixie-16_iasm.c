@@ -3,6 +3,7 @@
 #include <gen.h>
 #include <pixie-16_gen.h>
 #include <tokeniser.h>
+#include <keywords.h>
 #include <strings.h>
 #include <string.h>
 #include <stdlib.h>
@@ -35,6 +36,11 @@ char *px_iasm_keyw[] = {
 	"ST", "PF", "PC", "IMM",
 };
 
+// Perfect hash lookup over px_iasm_keyw.
+static keyw_table_t px_iasm_keyw_table = KEYW_TABLE(px_iasm_keyw, true);
+// Labels up to this length are checked for keywords without being copied.
+#define PX_KEYW_PEEK_LEN 16
+
 bool px_is_label_char(char c) {
 	switch (c) {
 		case '0' ... '9':
@@ -182,6 +188,26 @@ px_token_t px_iasm_lex(tokeniser_ctx_t *ctx) {
 		int offs = 0;
 		while (px_is_label_char(tokeniser_nextchar_no(ctx, offs))) offs++;
 		offs ++;
+		// Check for keywords before copying anything.
+		if (offs <= PX_KEYW_PEEK_LEN) {
+			char peek[PX_KEYW_PEEK_LEN];
+			peek[0] = c;
+			for (int i = 1; i < offs; i++) {
+				peek[i] = tokeniser_nextchar_no(ctx, i - 1);
+			}
+			int keyw = keyw_lookup(&px_iasm_keyw_table, peek, offs);
+			if (keyw != -1) {
+				DEBUG_TKN("keyw  '%s'\n", px_iasm_keyw[keyw]);
+				for (int i = 1; i < offs; i++) {
+					tokeniser_readchar(ctx);
+				}
+				return (px_token_t) {
+					.type  = (px_iasm_token_id_t) keyw,
+					.ident = NULL,
+					.ival  = 0
+				};
+			}
+		}
 		// Now, grab it.
 		char *strval = (char *) xalloc(ctx->allocator, sizeof(char) * (offs + 1));
 		*strval = c;
@@ -189,18 +215,6 @@ px_token_t px_iasm_lex(tokeniser_ctx_t *ctx) {
 		for (int i = 1; i < offs; i++) {
 			strval[i] = tokeniser_readchar(ctx);
 		}
-		// Next, check for keywords.
-		for (size_t i = 0; i < PX_NUM_KEYW; i++) {
-			if (!strcasecmp(strval, px_iasm_keyw[i])) {
-				DEBUG_TKN("keyw  '%s'\n", strval);
-				xfree(ctx->allocator, strval);
-				return (px_token_t) {
-					.type  = (px_iasm_token_id_t) i,
-					.ident = NULL,
-					.ival  = 0
-				};
-			}
-		}
 		DEBUG_TKN("ident '%s'\n", strval);
 		// Return the appropriate alternative.
 		return (px_token_t) {
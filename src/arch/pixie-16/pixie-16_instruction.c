@@ -363,7 +363,7 @@ gen_var_t *px_get_tmp(asm_ctx_t *ctx, size_t size, bool allow_reg) {
 		for (reg_t i = 0; i < NUM_REGS; i++) {
 			if (!ctx->current_scope->reg_usage[i]) {
 				// We can use this register.
-				gen_var_t *var = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+				gen_var_t *var = gen_var_alloc(ctx);
 				*var = (gen_var_t) {
 					.type        = VAR_TYPE_REG,
 					.reg         = i,
@@ -396,7 +396,7 @@ gen_var_t *px_get_tmp(asm_ctx_t *ctx, size_t size, bool allow_reg) {
 			address_t end_offset = ctx->current_scope->stack_size - ctx->temp_num;
 			address_t offset     = end_offset - i;
 			// Package it up.
-			gen_var_t *var = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+			gen_var_t *var = gen_var_alloc(ctx);
 			*var = (gen_var_t) {
 				.type        = VAR_TYPE_STACKOFFS,
 				.offset      = offset,
@@ -420,7 +420,7 @@ gen_var_t *px_get_tmp(asm_ctx_t *ctx, size_t size, bool allow_reg) {
 	// Return the new stack bit.
 	ctx->current_scope->stack_size += size;
 	gen_stack_space(ctx, size);
-	gen_var_t *var = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+	gen_var_t *var = gen_var_alloc(ctx);
 	*var = (gen_var_t) {
 		.type        = VAR_TYPE_STACKOFFS,
 		.offset      = ctx->current_scope->stack_size - size,
@@ -574,10 +574,16 @@ reg_t px_addr_var(asm_ctx_t *ctx, gen_var_t *var, address_t part, px_addr_t *add
 				px_var_to_reg(ctx, a, true);
 				px_var_to_reg(ctx, b, true);
 				
+				// Determine the underlying type of the operation.
+				var_type_t *underlying = var->ctype;
+				
 				// Check for constants.
 				if (a->type == VAR_TYPE_CONST) {
 					if (b->type == VAR_TYPE_CONST) {
-						// TODO: CONVERT the thingy.
+						// Both constant: this is a normal memory access.
+						*addrmode = PX_ADDR_MEM;
+						*offs     = a->iconst + b->iconst * underlying->size + part;
+						return PX_REG_IMM;
 					} else {
 						// Swapperoni.
 						gen_var_t *tmp = a;
@@ -586,9 +592,6 @@ reg_t px_addr_var(asm_ctx_t *ctx, gen_var_t *var, address_t part, px_addr_t *add
 					}
 				}
 				
-				// Determine the underlying type of the operation.
-				var_type_t *underlying = var->ctype;
-				
 				if (b->type == VAR_TYPE_CONST && (b->iconst + part)) {
 					// Constant (nonzero) offset and variable offset.
 					*addrmode = a->reg;
@@ -617,7 +620,7 @@ reg_t px_addr_var(asm_ctx_t *ctx, gen_var_t *var, address_t part, px_addr_t *add
 						px_write_insn(ctx, insn, NULL, 0, NULL, 0);
 						
 						// Make a fancy variable for next time.
-						var->indexed.combined = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+						var->indexed.combined = gen_var_alloc(ctx);
 						*var->indexed.combined = (gen_var_t) {
 							.type        = VAR_TYPE_REG,
 							.reg         = dest,
@@ -1,8 +1,11 @@
 
 #include "asm.h"
+#include "intern.h"
 #include "ctxalloc_warn.h"
 #include <string.h>
 
+POOL_DEFINE(asm_scope_t)
+
 static inline asm_sect_t *asm_create_sect (asm_ctx_t  *ctx,  const char *id,   address_t align);
 static inline void        asm_align_sect  (asm_sect_t *sect, address_t   align);
 static        void        asm_append_chunk(asm_ctx_t  *ctx,  char        type);
@@ -13,6 +16,11 @@ static inline void        asm_append      (asm_ctx_t  *ctx,  const char *data, s
 void asm_init(asm_ctx_t *ctx) {
 	// Sections.
 	ctx->allocator   = alloc_create(ALLOC_NO_PARENT);
+	alloc_set_name(ctx->allocator, "asm");
+	gen_var_t_pool_init(&ctx->var_pool, ctx->allocator);
+	asm_scope_t_pool_init(&ctx->scope_pool, ctx->allocator);
+	preproc_data_t_pool_init(&ctx->preproc_pool, ctx->allocator);
+	map_t_pool_init(&ctx->map_pool, ctx->allocator);
 	ctx->sections    = (map_t *) xalloc(ctx->allocator, sizeof(map_t));
 	map_create(ctx->sections);
 	// Scopeth.
@@ -230,8 +238,8 @@ static inline asm_label_def_t *get_or_create_label(asm_ctx_t *ctx, const char *l
 		*val = (asm_label_def_t) {
 			.address    = 0,
 			.is_defined = false,
-			.source     = xstrdup(ctx->allocator, label),
-			.value      = xstrdup(ctx->allocator, label)
+			.source     = (char *) intern(label),
+			.value      = (char *) intern(label)
 		};
 		map_set(ctx->labels, label, val);
 	}
@@ -323,22 +331,18 @@ void asm_write_label_ref(asm_ctx_t *ctx, const char *label, address_t offset, as
 
 // Writes linenumber and position information.
 void asm_write_pos(asm_ctx_t *ctx, pos_t pos) {
-	if (!pos.filename) return;
+	if (!pos.start) return;
 	
-	DEBUG_ASM("// %s:%d (col %d)\n", pos.filename, pos.y0, pos.x0);
+#ifdef DEBUG_ASSEMBLER
+	pos_info_t info = pos_decode(pos);
+	DEBUG_ASM("// %s:%d (col %d)\n", info.filename, info.y0, info.x0);
+#endif
 	asm_append_chunk(ctx, ASM_CHUNK_POS);
 	// Address (for more convenient independent dumping).
 	asm_write_address(ctx, 0);
-	// File position.
-	asm_write_num(ctx, pos.x0, sizeof(int));
-	asm_write_num(ctx, pos.y0, sizeof(int));
-	asm_write_num(ctx, pos.x1, sizeof(int));
-	asm_write_num(ctx, pos.y1, sizeof(int));
-	// File index.
-	asm_write_num(ctx, pos.index0, sizeof(size_t));
-	asm_write_num(ctx, pos.index1, sizeof(size_t));
-	// File name.
-	asm_append(ctx, pos.filename, strlen(pos.filename) + 1);
+	// Encoded position, decoded when the line numbers are written.
+	asm_write_num(ctx, pos.start, sizeof(srcloc_t));
+	asm_write_num(ctx, pos.end,   sizeof(srcloc_t));
 	asm_append_chunk(ctx, ASM_CHUNK_DATA);
 }
 
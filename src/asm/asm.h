@@ -32,7 +32,14 @@ typedef struct asm_label_def asm_label_def_t;
 typedef char *asm_label_t;
 
 #include <strmap.h>
+#include <pool.h>
 #include <gen.h>
+#include <gen_preproc.h>
+
+POOL_DECLARE(gen_var_t)
+POOL_DECLARE(asm_scope_t)
+POOL_DECLARE(preproc_data_t)
+POOL_DECLARE(map_t)
 
 struct asm_scope {
     // The parent scope.
@@ -77,6 +84,14 @@ struct asm_ctx {
     asm_label_t   last_global_label;
     // The memory allocator associated.
     alloc_ctx_t   allocator;
+    // Variables, taken from allocator; temporaries are recycled through gen_var_free.
+    gen_var_t_pool_t   var_pool;
+    // Recycled scopes, taken from allocator.
+    asm_scope_t_pool_t scope_pool;
+    // Preprocessing data, taken from allocator and recycled after each function.
+    preproc_data_t_pool_t preproc_pool;
+    // Preprocessing variable maps, taken from allocator and recycled after each function.
+    map_t_pool_t       map_pool;
     // Extra bits of context on an architecture basis.
     ASM_CTX_EXTRAS
     
@@ -160,15 +160,11 @@ void asm_ppc_addr2line(asm_ctx_t *ctx, asm_sect_t *sect, uint8_t chunk_type, siz
 	if (chunk_type == ASM_CHUNK_POS) {
 		// A position chuck (usually for addr2line purposes).
 		address_t addr = *(address_t *) chunk_data;
-		pos_t pos = {
-			.x0       = asm_read_numb(chunk_data + sizeof(address_t),                                    sizeof(int)),
-			.y0       = asm_read_numb(chunk_data + sizeof(address_t) +   sizeof(int),                    sizeof(int)),
-			.x1       = asm_read_numb(chunk_data + sizeof(address_t) + 2*sizeof(int),                    sizeof(int)),
-			.y1       = asm_read_numb(chunk_data + sizeof(address_t) + 3*sizeof(int),                    sizeof(int)),
-			.index0   = asm_read_numb(chunk_data + sizeof(address_t) + 4*sizeof(int),                    sizeof(size_t)),
-			.index1   = asm_read_numb(chunk_data + sizeof(address_t) + 4*sizeof(int) +   sizeof(size_t), sizeof(size_t)),
-			.filename =               chunk_data + sizeof(address_t) + 4*sizeof(int) + 2*sizeof(size_t),
-		};
+		pos_info_t pos = pos_decode((pos_t) {
+			.start = asm_read_numb(chunk_data + sizeof(address_t),                    sizeof(srcloc_t)),
+			.end   = asm_read_numb(chunk_data + sizeof(address_t) + sizeof(srcloc_t), sizeof(srcloc_t)),
+		});
+		if (!pos.filename) return;
 		
 		char *absfile = realpath(pos.filename, NULL);
 		char *absesc  = absfile ? escapespaces(absfile) : strdup("??");
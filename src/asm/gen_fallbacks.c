@@ -4,6 +4,7 @@
 #include "gen_util.h"
 #include "malloc.h"
 #include "gen_preproc.h"
+#include "gen_fold.h"
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -50,6 +51,7 @@ void gen_function(asm_ctx_t *ctx, funcdef_t *funcdef) {
 	ctx->last_label_no = 0;
 	ctx->temp_num      = 0;
 	ctx->current_scope->stack_size    = 0;
+	gen_fold_function(ctx, funcdef);
 	gen_preproc_function(ctx, funcdef);
 	
 	// New function, new scope.
@@ -79,6 +81,7 @@ void gen_function(asm_ctx_t *ctx, funcdef_t *funcdef) {
 	
 	// Close the scope.
 	gen_pop_scope(ctx);
+	gen_preproc_function_done(ctx, funcdef);
 	ctx->current_func = NULL;
 	if (ctx->temp_labels) xfree(ctx->allocator, ctx->temp_labels);
 	if (ctx->temp_usage)  xfree(ctx->allocator, ctx->temp_usage);
@@ -668,7 +671,6 @@ void gen_asm_file(asm_ctx_t *ctx, tokeniser_ctx_t *lex_ctx) {
 				char *sect_id = asm_expect_str(lex_ctx);
 				if (sect_id) {
 					asm_use_sect(ctx, sect_id, ASM_NOT_ALIGNED);
-					xfree(lex_ctx->allocator, sect_id);
 				} else {
 					printf("Error: Expected STRING after '.section'\n");
 				}
@@ -788,18 +790,18 @@ gen_var_t *gen_expression(asm_ctx_t *ctx, expr_t *expr, gen_var_t *out_hint) {
 	switch (expr->type) {
 		case EXPR_TYPE_CONST: {
 			// Constants are very simple.
-			gen_var_t *val = (gen_var_t *) xalloc(ctx->allocator, sizeof(gen_var_t));
+			gen_var_t *val = gen_var_alloc(ctx);
 			*val = (gen_var_t) {
 				.type   = VAR_TYPE_CONST,
 				.iconst = expr->iconst,
-				.ctype  = ctype_simple(ctx, STYPE_S_INT),
+				.ctype  = ctype_simple(ctx, expr->iconst_type),
 			};
 			return val;
 		} break;
 		
 		case EXPR_TYPE_CSTR: {
 			// C-strings are label references.
-			gen_var_t *val = (gen_var_t *) xalloc(ctx->allocator, sizeof(gen_var_t));
+			gen_var_t *val = gen_var_alloc(ctx);
 			*val = (gen_var_t) {
 				.type   = VAR_TYPE_LABEL,
 				.label  = expr->label,
@@ -813,10 +815,10 @@ gen_var_t *gen_expression(asm_ctx_t *ctx, expr_t *expr, gen_var_t *out_hint) {
 			gen_var_t *val = gen_get_variable(ctx, expr->ident->strval);
 			if (!val) {
 				// Is it maybe a function?
-				funcdef_t *func = map_get(&ctx->functions, expr->ident->strval);
+				funcdef_t *func = map_get_atom(&ctx->functions, expr->ident->strval);
 				if (func) {
 					// It's a function, so make a label variable out of it.
-					val = (gen_var_t *) xalloc(ctx->allocator, sizeof(gen_var_t));
+					val = gen_var_alloc(ctx);
 					*val = (gen_var_t) {
 						.type   = VAR_TYPE_LABEL,
 						.label  = expr->ident->strval,
@@ -844,7 +846,7 @@ gen_var_t *gen_expression(asm_ctx_t *ctx, expr_t *expr, gen_var_t *out_hint) {
 			if (expr->func->type == EXPR_TYPE_IDENT) {
 				// Funcdef lookup.
 				const char *name = expr->func->ident->strval;
-				funcdef = map_get(&ctx->functions, name);
+				funcdef = map_get_atom(&ctx->functions, name);
 				
 				if (!funcdef) {
 					// Undefined function called.
@@ -878,7 +880,7 @@ gen_var_t *gen_expression(asm_ctx_t *ctx, expr_t *expr, gen_var_t *out_hint) {
 				
 			} else if (oper == OP_LOGIC_NOT) {
 				// Apply the "condition" output hint to logic not.
-				gen_var_t *cond_hint = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+				gen_var_t *cond_hint = gen_var_alloc(ctx);
 				*cond_hint = (gen_var_t) {
 					.type = VAR_TYPE_COND,
 					.ctype = ctype_simple(ctx, STYPE_BOOL),
@@ -955,6 +957,40 @@ gen_var_t *gen_expression(asm_ctx_t *ctx, expr_t *expr, gen_var_t *out_hint) {
 				return out;
 			}
 		} break;
+		
+		case EXPR_TYPE_MATH1A:
+		case EXPR_TYPE_MATH2A: {
+			// Mark line position.
+			asm_write_pos(ctx, expr->pos);
+			
+			// Assignment math (things like ++a, b += c and d[e] |= f).
+			// The location is evaluated only once and then operated on in place.
+			gen_var_t *a = gen_expression(ctx, expr->par_a, NULL);
+			if (!a) return NULL;
+			// Enforce that A is writable.
+			if (a->type == VAR_TYPE_COND || a->type == VAR_TYPE_CONST) {
+				// These aren't writable.
+				report_error(ctx->tokeniser_ctx, E_ERROR, expr->par_a->pos, "Left hand of an assignment must be assignable.");
+				gen_unuse(ctx, a);
+				return NULL;
+			}
+			if (expr->type == EXPR_TYPE_MATH1A) {
+				// Increment or decrement.
+				gen_var_t *out = gen_expr_math1(ctx, expr, expr->oper, a, a);
+				if (!out) gen_unuse(ctx, a);
+				return out;
+			}
+			gen_var_t *b   = gen_expression(ctx, expr->par_b, NULL);
+			if (!b) gen_unuse(ctx, a);
+			if (!b) return NULL;
+			gen_var_t *out = gen_expr_math2(ctx, expr, expr->oper, a, a, b);
+			if (!out) gen_unuse(ctx, a);
+			if (!out) gen_unuse(ctx, b);
+			if (!out) return NULL;
+			// Free up variables if necessary.
+			if (!gen_cmp(ctx, b, out)) gen_unuse(ctx, b);
+			return out;
+		} break;
 	}
 	raise(SIGABRT);
 }
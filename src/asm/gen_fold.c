@@ -0,0 +1,378 @@
+
+#include "gen_fold.h"
+#include "array_util.h"
+#include "malloc.h"
+
+// State of the folding pass over one function.
+typedef struct {
+	asm_ctx_t  *ctx;
+	// Variables currently in scope, innermost last.
+	ident_t   **vars;
+	size_t      vars_len, vars_cap;
+} fold_ctx_t;
+
+static void          fold_stmt (fold_ctx_t *fold, stmt_t *stmt);
+static simple_type_t fold_expr (fold_ctx_t *fold, expr_t *expr);
+
+// The integer type of a variable or function, or STYPE_VOID if it is not an integer.
+static simple_type_t fold_ctype(var_type_t *ctype) {
+	if (!ctype || ctype->category != TYPE_CAT_SIMPLE) return STYPE_VOID;
+	if (ctype->simple_type > STYPE_S_LONGER && ctype->simple_type != STYPE_BOOL) return STYPE_VOID;
+	return ctype->simple_type;
+}
+
+// The integer type of the variable with the given name, or STYPE_VOID if it is not an integer.
+static simple_type_t fold_var_type(fold_ctx_t *fold, const char *name) {
+	// Identifiers are interned, so the names can be compared by pointer.
+	for (size_t i = fold->vars_len; i-- > 0;) {
+		if (fold->vars[i]->strval == name) return fold_ctype(fold->vars[i]->type);
+	}
+	return STYPE_VOID;
+}
+
+// Replace an expression with an integer constant.
+static void fold_to_const(expr_t *expr, long iconst, simple_type_t type) {
+	*expr = (expr_t) {
+		.pos         = expr->pos,
+		.type        = EXPR_TYPE_CONST,
+		.iconst      = iconst,
+		.iconst_type = type,
+		.int_type    = type,
+	};
+}
+
+// Replace math by a constant power of two with cheaper math, like x * 4 with x << 2.
+// The math is done in type, type_x is the type of the left hand side.
+static void fold_strength(expr_t *expr, simple_type_t type, simple_type_t type_x) {
+	expr_t       *b    = expr->par_b;
+	unsigned long c    = iconst_trunc(type, b->iconst);
+	if (c < 2 || (c & (c - 1))) return;
+	
+	// Assignments convert back to the type of the left hand side, so only the low bits matter for them.
+	bool same = iconst_promote(type_x) == type;
+	if (expr->oper == OP_MUL && (same || expr->type == EXPR_TYPE_MATH2A)) {
+		// Multiplication becomes a left shift.
+		expr->oper     = OP_SHIFT_L;
+		b->iconst      = __builtin_ctzl(c);
+		b->iconst_type = STYPE_S_INT;
+		b->int_type    = STYPE_S_INT;
+	} else if (expr->oper == OP_DIV && same && !STYPE_IS_SIGNED(type)) {
+		// Unsigned division becomes a right shift.
+		expr->oper     = OP_SHIFT_R;
+		b->iconst      = __builtin_ctzl(c);
+		b->iconst_type = STYPE_S_INT;
+		b->int_type    = STYPE_S_INT;
+	} else if (expr->oper == OP_MOD && same && !STYPE_IS_SIGNED(type)) {
+		// Unsigned modulo becomes a bitwise and.
+		expr->oper     = OP_BIT_AND;
+		b->iconst      = c - 1;
+		b->iconst_type = type;
+		b->int_type    = type;
+	}
+}
+
+// Move constants together in chains of math, like (x + 1) + 2 to x + 3.
+// Both the outer math and the inner math on the left hand side must be done in type.
+static void fold_reassociate(expr_t *expr, simple_type_t type) {
+	expr_t *a     = expr->par_a;
+	expr_t *b     = expr->par_b;
+	oper_t  oper  = expr->oper;
+	oper_t  inner = a->oper;
+	long    c1    = a->par_b->iconst;
+	long    c2    = b->iconst;
+	long    k;
+	
+	if (OP_IS_ADD(oper) && OP_IS_ADD(inner)) {
+		// Additions and subtractions combine into one addition.
+		if (inner == OP_SUB) iconst_math2(OP_SUB, type, 0, c1, &c1);
+		iconst_math2(oper, type, c1, c2, &k);
+		oper = OP_ADD;
+	} else if (oper == inner && (oper == OP_MUL || OP_IS_BIT(oper))) {
+		// Associative math combines as is.
+		iconst_math2(oper, type, c1, c2, &k);
+	} else if (oper == inner && OP_IS_SHIFT(oper)) {
+		// Shifts in the same direction add up, as long as the total is not too much.
+		k = c1 + c2;
+		long dummy;
+		if (!iconst_math2(oper, type, 0, k, &dummy)) return;
+		type = STYPE_S_INT;
+	} else {
+		return;
+	}
+	
+	// Adding a negative number is subtracting a positive one.
+	if (oper == OP_ADD && k < 0 && iconst_trunc(type, -(unsigned long) k) > 0) {
+		oper = OP_SUB;
+		k    = iconst_trunc(type, -(unsigned long) k);
+	}
+	expr->oper     = oper;
+	expr->par_a    = a->par_a;
+	b->iconst      = k;
+	b->iconst_type = type;
+	b->int_type    = type;
+}
+
+// Fold unary math.
+static simple_type_t fold_math1(fold_ctx_t *fold, expr_t *expr) {
+	simple_type_t type = fold_expr(fold, expr->par_a);
+	expr_t       *a    = expr->par_a;
+	
+	switch (expr->oper) {
+		case OP_0_MINUS:
+		case OP_BIT_NOT:
+			if (type == STYPE_VOID) return STYPE_VOID;
+			type = iconst_promote(type);
+			if (a->type == EXPR_TYPE_CONST) {
+				long iconst = expr->oper == OP_0_MINUS ? -(unsigned long) a->iconst : ~a->iconst;
+				fold_to_const(expr, iconst_trunc(type, iconst), type);
+			}
+			return type;
+		
+		case OP_LOGIC_NOT:
+			if (a->type == EXPR_TYPE_CONST) {
+				fold_to_const(expr, !a->iconst, STYPE_S_INT);
+			}
+			return STYPE_S_INT;
+		
+		case OP_POST_INC:
+		case OP_POST_DEC:
+			return type;
+		
+		default:
+			// Pointer math.
+			return STYPE_VOID;
+	}
+}
+
+// Fold binary math.
+static simple_type_t fold_math2(fold_ctx_t *fold, expr_t *expr) {
+	oper_t        oper   = expr->oper;
+	simple_type_t type_a = fold_expr(fold, expr->par_a);
+	expr_t       *a      = expr->par_a;
+	
+	if ((oper == OP_LOGIC_AND || oper == OP_LOGIC_OR) && a->type == EXPR_TYPE_CONST
+			&& !a->iconst == (oper == OP_LOGIC_AND)) {
+		// The left hand side decides the result, so the right hand side is never evaluated.
+		fold_to_const(expr, oper == OP_LOGIC_OR, STYPE_S_INT);
+		return STYPE_S_INT;
+	}
+	
+	simple_type_t type_b = fold_expr(fold, expr->par_b);
+	expr_t       *b      = expr->par_b;
+	
+	if (oper == OP_LOGIC_AND || oper == OP_LOGIC_OR) {
+		// The left hand side is constant but doesn't decide the result, so the right hand side does.
+		if (a->type == EXPR_TYPE_CONST && b->type == EXPR_TYPE_CONST) {
+			fold_to_const(expr, !!b->iconst, STYPE_S_INT);
+		}
+		return STYPE_S_INT;
+	} else if (oper == OP_ASSIGN) {
+		return type_a;
+	} else if (oper == OP_INDEX || type_a == STYPE_VOID || type_b == STYPE_VOID) {
+		// Pointer math or unknown types.
+		return OP_IS_COMP(oper) ? STYPE_S_INT : STYPE_VOID;
+	}
+	
+	// Shifts are done in the type of the left hand side, everything else in a common type.
+	simple_type_t type = OP_IS_SHIFT(oper) ? iconst_promote(type_a) : iconst_common_type(type_a, type_b);
+	
+	if ((oper == OP_DIV || oper == OP_MOD) && b->type == EXPR_TYPE_CONST && !iconst_trunc(type, b->iconst)) {
+		// This would trap or produce garbage at runtime.
+		report_error(fold->ctx->tokeniser_ctx, E_WARN, expr->pos, "Division by zero.");
+	}
+	
+	if (a->type == EXPR_TYPE_CONST && b->type == EXPR_TYPE_CONST) {
+		// Constant math; if the result is undefined, any value will do.
+		long iconst;
+		if (!iconst_math2(oper, type, a->iconst, b->iconst, &iconst)) iconst = 0;
+		type = OP_IS_COMP(oper) ? STYPE_S_INT : type;
+		fold_to_const(expr, iconst, type);
+		return type;
+	} else if (OP_IS_COMP(oper)) {
+		return STYPE_S_INT;
+	}
+	
+	if (a->type == EXPR_TYPE_CONST && (oper == OP_ADD || oper == OP_MUL || OP_IS_BIT(oper))) {
+		// Keep constants on the right hand side.
+		expr->par_a = b;
+		expr->par_b = a;
+		a           = expr->par_a;
+		b           = expr->par_b;
+		type_a      = type_b;
+	}
+	if (b->type != EXPR_TYPE_CONST) return type;
+	
+	// Cheaper math first, so that it can combine with the math on the left hand side.
+	fold_strength(expr, type, type_a);
+	oper = expr->oper;
+	
+	if (a->type == EXPR_TYPE_MATH2 && a->par_b->type == EXPR_TYPE_CONST && type_a == type) {
+		// Move constants together.
+		fold_reassociate(expr, type);
+		a      = expr->par_a;
+		type_a = a->int_type;
+		oper   = expr->oper;
+		if (type_a == STYPE_VOID) return type;
+	}
+	
+	// Math that doesn't do anything.
+	long c        = iconst_trunc(type, b->iconst);
+	bool identity = false;
+	switch (oper) {
+		case OP_ADD:
+		case OP_SUB:
+		case OP_BIT_OR:
+		case OP_BIT_XOR:
+		case OP_SHIFT_L:
+		case OP_SHIFT_R:
+			identity = c == 0;
+			break;
+		case OP_MUL:
+		case OP_DIV:
+			identity = c == 1;
+			break;
+		case OP_BIT_AND:
+			identity = c == iconst_trunc(type, -1);
+			break;
+	}
+	if (identity && iconst_promote(type_a) == type) {
+		*expr = *a;
+		return type_a;
+	}
+	return type;
+}
+
+// Fold the constant math in an expression.
+// Returns the integer type of the expression, or STYPE_VOID if it is not an integer or the type is unknown.
+static simple_type_t fold_expr(fold_ctx_t *fold, expr_t *expr) {
+	simple_type_t type = STYPE_VOID;
+	switch (expr->type) {
+		case EXPR_TYPE_CONST:
+			type = expr->iconst_type;
+			break;
+		
+		case EXPR_TYPE_CSTR:
+			break;
+		
+		case EXPR_TYPE_IDENT:
+			type = fold_var_type(fold, expr->ident->strval);
+			break;
+		
+		case EXPR_TYPE_CALL:
+			for (size_t i = 0; i < expr->args->num; i++) {
+				fold_expr(fold, &expr->args->arr[i]);
+			}
+			if (expr->func->type == EXPR_TYPE_IDENT) {
+				funcdef_t *funcdef = map_get_atom(&fold->ctx->functions, expr->func->ident->strval);
+				if (funcdef) type = fold_ctype(funcdef->returns);
+			}
+			break;
+		
+		case EXPR_TYPE_MATH1:
+			type = fold_math1(fold, expr);
+			break;
+		
+		case EXPR_TYPE_MATH2:
+			type = fold_math2(fold, expr);
+			break;
+		
+		case EXPR_TYPE_MATH1A:
+			type = fold_expr(fold, expr->par_a);
+			break;
+		
+		case EXPR_TYPE_MATH2A: {
+			type = fold_expr(fold, expr->par_a);
+			simple_type_t type_b = fold_expr(fold, expr->par_b);
+			if (type != STYPE_VOID && type_b != STYPE_VOID && expr->par_b->type == EXPR_TYPE_CONST) {
+				// Things like x *= 4 to x <<= 2.
+				simple_type_t type_math = OP_IS_SHIFT(expr->oper) ? iconst_promote(type) : iconst_common_type(type, type_b);
+				fold_strength(expr, type_math, type);
+			}
+		} break;
+	}
+	expr->int_type = type;
+	return type;
+}
+
+// Fold the constant math in a list of expressions.
+static void fold_exprs(fold_ctx_t *fold, exprs_t *exprs) {
+	if (!exprs) return;
+	for (size_t i = 0; i < exprs->num; i++) {
+		fold_expr(fold, &exprs->arr[i]);
+	}
+}
+
+// Fold the constant math in a list of statements, which is also a scope.
+static void fold_stmts(fold_ctx_t *fold, stmts_t *stmts) {
+	size_t vars_len = fold->vars_len;
+	for (size_t i = 0; i < stmts->num; i++) {
+		fold_stmt(fold, &stmts->arr[i]);
+	}
+	fold->vars_len = vars_len;
+}
+
+// Fold the constant math in a statement.
+static void fold_stmt(fold_ctx_t *fold, stmt_t *stmt) {
+	if (!stmt) return;
+	switch (stmt->type) {
+		case STMT_TYPE_MULTI:
+			fold_stmts(fold, stmt->stmts);
+			break;
+		
+		case STMT_TYPE_IF:
+			fold_expr(fold, stmt->cond);
+			fold_stmt(fold, stmt->code_true);
+			fold_stmt(fold, stmt->code_false);
+			break;
+		
+		case STMT_TYPE_WHILE:
+			fold_expr(fold, stmt->cond);
+			fold_stmt(fold, stmt->code_true);
+			break;
+		
+		case STMT_TYPE_FOR: {
+			// The initialiser of a for loop has its own scope.
+			size_t vars_len = fold->vars_len;
+			fold_stmt (fold, stmt->for_init);
+			fold_exprs(fold, stmt->for_cond);
+			fold_stmt (fold, stmt->for_code);
+			fold_exprs(fold, stmt->for_next);
+			fold->vars_len = vars_len;
+		} break;
+		
+		case STMT_TYPE_RET:
+		case STMT_TYPE_EXPR:
+			if (stmt->expr) fold_expr(fold, stmt->expr);
+			break;
+		
+		case STMT_TYPE_VAR:
+			for (size_t i = 0; i < stmt->vars->num; i++) {
+				ident_t *var = &stmt->vars->arr[i];
+				if (var->initialiser) fold_expr(fold, var->initialiser);
+				array_len_cap_concat(fold->ctx->allocator, ident_t *, fold->vars, fold->vars_cap, fold->vars_len, var);
+			}
+			break;
+		
+		default:
+			break;
+	}
+}
+
+// Fold the constant math in a function before code is generated for it.
+// Also moves constants together in chains of math and replaces math with cheaper equivalents, like x*4 with x<<2.
+void gen_fold_function(asm_ctx_t *ctx, funcdef_t *funcdef) {
+	fold_ctx_t fold = {
+		.ctx      = ctx,
+		.vars     = NULL,
+		.vars_len = 0,
+		.vars_cap = 0,
+	};
+	
+	// Parameters are in scope for the entire function.
+	for (size_t i = 0; i < funcdef->args.num; i++) {
+		array_len_cap_concat(ctx->allocator, ident_t *, fold.vars, fold.vars_cap, fold.vars_len, &funcdef->args.arr[i]);
+	}
+	fold_stmts(&fold, funcdef->stmts);
+	
+	xfree(ctx->allocator, fold.vars);
+}
@@ -0,0 +1,11 @@
+
+#ifndef GEN_FOLD_H
+#define GEN_FOLD_H
+
+#include "gen.h"
+
+// Fold the constant math in a function before code is generated for it.
+// Also moves constants together in chains of math and replaces math with cheaper equivalents, like x*4 with x<<2.
+void gen_fold_function(asm_ctx_t *ctx, funcdef_t *funcdef);
+
+#endif //GEN_FOLD_H
@@ -1,13 +1,17 @@
 
 #include "gen_preproc.h"
+#include "gen_util.h"
 #include "malloc.h"
 
+POOL_DEFINE(preproc_data_t)
+POOL_DEFINE(map_t)
+
 static inline void pre_stmt_push(asm_ctx_t *ctx, preproc_data_t **parent, stmt_t *stmt) {
 	// Make some new preprocessing data.
-	stmt->preproc             = xalloc(ctx->allocator, sizeof(preproc_data_t));
+	stmt->preproc             = preproc_data_t_pool_alloc(&ctx->preproc_pool);
 	stmt->preproc->n_children = 0;
 	stmt->preproc->children   = NULL;
-	stmt->preproc->vars       = xalloc(ctx->allocator, sizeof(map_t));
+	stmt->preproc->vars       = map_t_pool_alloc(&ctx->map_pool);
 	map_create(stmt->preproc->vars);
 	// Update the parent.
 	(*parent)->n_children ++;
@@ -21,15 +25,34 @@ static inline void pre_stmt_push(asm_ctx_t *ctx, preproc_data_t **parent, stmt_t
 // Determines recursive nature, number of variables per scope and number of intermidiaries.
 void gen_preproc_function(asm_ctx_t *ctx, funcdef_t *funcdef) {
 	DEBUG_PRE("Preprocessing '%s'\n", funcdef->ident.strval);
-	funcdef->preproc             = xalloc(ctx->allocator, sizeof(preproc_data_t));
+	funcdef->preproc             = preproc_data_t_pool_alloc(&ctx->preproc_pool);
 	funcdef->preproc->n_children = 0;
 	funcdef->preproc->children   = NULL;
-	funcdef->preproc->vars       = xalloc(ctx->allocator, sizeof(map_t));
+	funcdef->preproc->vars       = map_t_pool_alloc(&ctx->map_pool);
 	map_create(funcdef->preproc->vars);
 	gen_preproc_stmt(ctx, funcdef->preproc, funcdef->stmts, true);
 	DEBUG_PRE("Preprocessing done\n");
 }
 
+// Return preprocessing data and everything below it to the context's pools.
+static void gen_preproc_free(asm_ctx_t *ctx, preproc_data_t *data) {
+	for (size_t i = 0; i < data->n_children; i++) {
+		gen_preproc_free(ctx, data->children[i]);
+	}
+	if (data->children) xfree(ctx->allocator, data->children);
+	// The variables are not freed; code generation may have taken them over.
+	map_delete(data->vars);
+	map_t_pool_free(&ctx->map_pool, data->vars);
+	preproc_data_t_pool_free(&ctx->preproc_pool, data);
+}
+
+// Clean up the preprocessing data of a function once code has been generated for it.
+void gen_preproc_function_done(asm_ctx_t *ctx, funcdef_t *funcdef) {
+	if (!funcdef->preproc) return;
+	gen_preproc_free(ctx, funcdef->preproc);
+	funcdef->preproc = NULL;
+}
+
 // Preprocess a statement.
 bool gen_preproc_stmt(asm_ctx_t *ctx, preproc_data_t *parent, void *ptr, bool is_stmts) {
 	preproc_data_t *current = parent;
@@ -90,7 +113,7 @@ bool gen_preproc_stmt(asm_ctx_t *ctx, preproc_data_t *parent, void *ptr, bool is
 				bool do_uninitialised = loc->ctype->simple_type != STYPE_VOID;
 				if (do_uninitialised) {
 					// Mark it as 'not very occupied'.
-					gen_var_t *cur = xalloc(ctx->current_scope->allocator, sizeof(gen_var_t));
+					gen_var_t *cur = gen_var_alloc(ctx);
 					*cur = (gen_var_t) {
 						.type        = VAR_TYPE_UNASSIGNED,
 						.owner       = stmt->vars->arr[i].strval,
@@ -158,6 +181,21 @@ void gen_preproc_expression(asm_ctx_t *ctx, preproc_data_t *parent, expr_t *expr
 			expr->has_side_effects = expr->par_a->has_side_effects || expr->par_b->has_side_effects;
 			expr->uses_pointers    = expr->par_a->uses_pointers    || expr->par_b->uses_pointers;
 			break;
+			
+		case EXPR_TYPE_MATH1A:
+			gen_preproc_expression(ctx, parent, expr->par_a);
+			expr->operation_count  = expr->par_a->operation_count + 1;
+			expr->has_side_effects = true;
+			expr->uses_pointers    = expr->par_a->uses_pointers;
+			break;
+			
+		case EXPR_TYPE_MATH2A:
+			gen_preproc_expression(ctx, parent, expr->par_a);
+			gen_preproc_expression(ctx, parent, expr->par_b);
+			expr->operation_count  = expr->par_a->operation_count  +  expr->par_b->operation_count + 1;
+			expr->has_side_effects = true;
+			expr->uses_pointers    = expr->par_a->uses_pointers    || expr->par_b->uses_pointers;
+			break;
 	}
 }
 
@@ -24,6 +24,8 @@ struct preproc_data {
 // Preprocess a function.
 // Determines recursive nature, number of variables per scope and number of intermidiaries.
 void gen_preproc_function   (asm_ctx_t *ctx, funcdef_t      *funcdef);
+// Clean up the preprocessing data of a function once code has been generated for it.
+void gen_preproc_function_done(asm_ctx_t *ctx, funcdef_t *funcdef);
 // Preprocess a statement.
 // Returns true if an explicit return occurred.
 bool gen_preproc_stmt       (asm_ctx_t *ctx, preproc_data_t *parent, void      *stmt, bool       is_stmts);
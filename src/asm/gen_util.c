@@ -174,12 +174,31 @@ bool ctype_equals(asm_ctx_t *ctx, var_type_t *a, var_type_t *b) {
 }
 
 
+POOL_DEFINE(gen_var_t)
+
+// Allocate a variable from the context's pool.
+gen_var_t *gen_var_alloc(asm_ctx_t *ctx) {
+	return gen_var_t_pool_alloc(&ctx->var_pool);
+}
+
+// Allocate a copy of a variable from the context's pool.
+gen_var_t *gen_var_copy(asm_ctx_t *ctx, gen_var_t *var) {
+	gen_var_t *copy = gen_var_t_pool_alloc(&ctx->var_pool);
+	*copy = *var;
+	return copy;
+}
+
+// Return a variable from gen_var_alloc or gen_var_copy to the context's pool.
+void gen_var_free(asm_ctx_t *ctx, gen_var_t *var) {
+	gen_var_t_pool_free(&ctx->var_pool, var);
+}
 
 // Find and return the location of the variable with the given name.
 gen_var_t *gen_get_variable(asm_ctx_t *ctx, char *label) {
+	// Identifiers are interned, so misses in the inner scopes needn't consult the intern table.
 	asm_scope_t *scope = ctx->current_scope;
 	while (scope) {
-		gen_var_t *var = (gen_var_t *) map_get(&scope->vars, label);
+		gen_var_t *var = (gen_var_t *) map_get_atom(&scope->vars, label);
 		if (var) return var;
 		scope = scope->parent;
 	}
@@ -192,9 +211,9 @@ gen_var_t *gen_arr_decay(asm_ctx_t *ctx, gen_var_t *var, gen_var_t *out_hint) {
 	// If variable is not something memory-resident, store to default location.
 	if (var->type == VAR_TYPE_REG) {
 		gen_mov(ctx, var->default_loc, var);
-		void *to_free = var->default_loc;
+		gen_var_t *to_free = var->default_loc;
 		*var = *var->default_loc;
-		xfree(to_free, ctx->current_scope->allocator);
+		gen_var_free(ctx, to_free);
 	}
 	
 	// Produce a pointer by performing OP_DEREF.
@@ -370,9 +389,10 @@ char *esc_cstr(alloc_ctx_t allocator, const char *cstr, size_t len) {
 
 // New scope.
 void gen_push_scope(asm_ctx_t *ctx) {
-	asm_scope_t *scope = (asm_scope_t *) xalloc(ctx->allocator, sizeof(asm_scope_t));
+	asm_scope_t *scope = asm_scope_t_pool_alloc(&ctx->scope_pool);
 	*scope = *ctx->current_scope;
-	scope->allocator   = alloc_create(ctx->allocator);
+	scope->allocator   = alloc_create_arena(ctx->allocator, ALLOC_ARENA_SMALL_CHUNK);
+	alloc_set_name(scope->allocator, "scope");
 	scope->parent      = ctx->current_scope;
 	map_create(&scope->vars);
 	ctx->current_scope = scope;
@@ -389,6 +409,6 @@ void gen_pop_scope(asm_ctx_t *ctx) {
 	
 	// Unlink it.
 	ctx->current_scope = old->parent;
-	xfree(ctx->allocator, old);
+	asm_scope_t_pool_free(&ctx->scope_pool, old);
 	ctx->current_scope->real_stack_size = real_size;
 }
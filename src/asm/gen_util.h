@@ -28,6 +28,13 @@ var_type_t *ctype_ptr        (asm_ctx_t *ctx, var_type_t   *of);
 // Returns true when exactly equal.
 bool        ctype_equals     (asm_ctx_t *ctx, var_type_t *a, var_type_t *b);
 
+// Allocate a variable from the context's pool.
+gen_var_t *gen_var_alloc     (asm_ctx_t *ctx);
+// Allocate a copy of a variable from the context's pool.
+gen_var_t *gen_var_copy      (asm_ctx_t *ctx, gen_var_t *var);
+// Return a variable from gen_var_alloc or gen_var_copy to the context's pool.
+void       gen_var_free      (asm_ctx_t *ctx, gen_var_t *var);
+
 // Find and return the location of the variable with the given name.
 gen_var_t *gen_get_variable  (asm_ctx_t *ctx, char      *label);
 // Decay some sort of array type into a pointer type.
@@ -0,0 +1,300 @@
+
+#include "lex_bench.h"
+#include <tokeniser.h>
+#include <location.h>
+#include <parser.h>
+#include <ctxalloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+// Kinds of token to generate.
+typedef enum {
+	BENCH_IDENT,
+	BENCH_NUMBER,
+	BENCH_STRING,
+	BENCH_COMMENT,
+	BENCH_OPERATOR,
+	BENCH_N_KINDS,
+} bench_kind_t;
+
+static const char *bench_kind_names[BENCH_N_KINDS] = {
+	"ident", "number", "string", "comment", "operator",
+};
+
+typedef struct {
+	// Approximate size of the generated source in bytes.
+	size_t   size;
+	// Number of times to tokenise the source per path.
+	int      iterations;
+	// Relative amount of each kind of token.
+	int      mix[BENCH_N_KINDS];
+	// Seed for the generator.
+	uint64_t seed;
+	bool     abort;
+} bench_options_t;
+
+// Result of benchmarking one way of feeding the tokeniser.
+typedef struct {
+	size_t tokens;
+	size_t bytes;
+	size_t allocs;
+	double seconds;
+} bench_result_t;
+
+// Simple generator so that inputs are the same every run.
+static uint64_t bench_rng;
+static inline uint32_t bench_rand(uint32_t max) {
+	bench_rng ^= bench_rng << 13;
+	bench_rng ^= bench_rng >> 7;
+	bench_rng ^= bench_rng << 17;
+	return (bench_rng >> 16) % max;
+}
+
+// Growable text buffer.
+typedef struct {
+	char   *data;
+	size_t  len, cap;
+} bench_buf_t;
+
+static void bench_putc(bench_buf_t *buf, char c) {
+	if (buf->len + 1 >= buf->cap) {
+		buf->cap  = buf->cap ? buf->cap * 2 : 4096;
+		buf->data = realloc(buf->data, buf->cap);
+	}
+	buf->data[buf->len++] = c;
+	buf->data[buf->len]   = 0;
+}
+
+static void bench_puts(bench_buf_t *buf, const char *str) {
+	while (*str) bench_putc(buf, *str++);
+}
+
+// Append a random run of characters from a set.
+static void bench_put_run(bench_buf_t *buf, const char *set, int min, int max) {
+	int    len    = min + bench_rand(max - min + 1);
+	size_t set_len = strlen(set);
+	for (int i = 0; i < len; i++) {
+		bench_putc(buf, set[bench_rand(set_len)]);
+	}
+}
+
+// Generate one token of a given kind.
+static void bench_gen_token(bench_buf_t *buf, bench_kind_t kind) {
+	static const char *keywords[] = {
+		"int", "char", "void", "if", "else", "while", "for", "return", "unsigned", "long",
+	};
+	static const char *operators[] = {
+		"+", "-", "*", "/", "%", "=", "==", "!=", "<", "<=", "<<", "<<=", ">", ">>=",
+		"&", "&&", "|", "||", "^", "~", "!", "+=", "++", "--", "(", ")", "{", "}",
+		"[", "]", ";", ",", ":",
+	};
+	static const char *ident_start = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+	static const char *ident_chars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+	static const char *text_chars  = "abcdefghijklmnopqrstuvwxyz      .,-";
+	
+	switch (kind) {
+		case BENCH_IDENT:
+			if (bench_rand(4) == 0) {
+				bench_puts(buf, keywords[bench_rand(sizeof(keywords) / sizeof(*keywords))]);
+			} else {
+				bench_put_run(buf, ident_start, 1, 1);
+				bench_put_run(buf, ident_chars, 0, 15);
+			}
+			break;
+		case BENCH_NUMBER:
+			switch (bench_rand(3)) {
+				case 0: bench_put_run(buf, "123456789", 1, 1); bench_put_run(buf, "0123456789", 0, 4); break;
+				case 1: bench_puts(buf, "0x"); bench_put_run(buf, "0123456789abcdefABCDEF", 1, 4); break;
+				case 2: bench_puts(buf, "0"); bench_put_run(buf, "01234567", 0, 5); break;
+			}
+			break;
+		case BENCH_STRING:
+			bench_putc(buf, '"');
+			bench_put_run(buf, text_chars, 0, 40);
+			if (bench_rand(4) == 0) bench_puts(buf, "\\n");
+			bench_putc(buf, '"');
+			break;
+		case BENCH_COMMENT:
+			if (bench_rand(2)) {
+				bench_puts(buf, "// ");
+				bench_put_run(buf, text_chars, 0, 60);
+				bench_putc(buf, '\n');
+			} else {
+				bench_puts(buf, "/* ");
+				bench_put_run(buf, text_chars, 0, 60);
+				if (bench_rand(2)) bench_puts(buf, "\n * ");
+				bench_put_run(buf, text_chars, 0, 60);
+				bench_puts(buf, " */");
+			}
+			break;
+		case BENCH_OPERATOR:
+			bench_puts(buf, operators[bench_rand(sizeof(operators) / sizeof(*operators))]);
+			break;
+		default:
+			break;
+	}
+}
+
+// Generate a source file of roughly the requested size and mix.
+static char *bench_gen_source(bench_options_t *options, size_t *len_out) {
+	bench_buf_t buf = { NULL, 0, 0 };
+	int total = 0;
+	for (int i = 0; i < BENCH_N_KINDS; i++) total += options->mix[i];
+	
+	bench_rng = options->seed ? options->seed : 1;
+	while (buf.len < options->size) {
+		// Pick a kind of token by weight.
+		int pick = bench_rand(total);
+		bench_kind_t kind = 0;
+		while (pick >= options->mix[kind]) pick -= options->mix[kind++];
+		bench_gen_token(&buf, kind);
+		
+		// Then some whitespace.
+		switch (bench_rand(8)) {
+			case 0:  bench_putc(&buf, '\n'); bench_put_run(&buf, "\t", 0, 3); break;
+			case 1:  bench_puts(&buf, "  "); break;
+			default: bench_putc(&buf, ' '); break;
+		}
+	}
+	
+	*len_out = buf.len;
+	return buf.data;
+}
+
+// Current time in seconds.
+static double bench_time() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Tokenise a context until the end, counting tokens.
+static void bench_run(tokeniser_ctx_t *ctx, bench_result_t *res) {
+	size_t allocs0 = alloc_thread_count;
+	double time0   = bench_time();
+	while (tokenise(ctx)) res->tokens ++;
+	res->seconds += bench_time() - time0;
+	res->allocs  += alloc_thread_count - allocs0;
+	res->bytes   += ctx->index;
+}
+
+// Print the numbers for one way of feeding the tokeniser.
+static void bench_report(const char *name, bench_result_t *res) {
+	printf("%-8s %12.0f %12.2f %12.3f %10.3f\n", name,
+		res->tokens / res->seconds,
+		res->bytes / res->seconds / (1024.0 * 1024.0),
+		(double) res->allocs / res->tokens,
+		res->seconds
+	);
+}
+
+// Parse the benchmark options.
+static void bench_parse_options(bench_options_t *options, int argc, char **argv) {
+	for (int i = 1; i < argc; i++) {
+		if (!strncmp(argv[i], "--size=", 7)) {
+			char *end;
+			options->size = strtoull(argv[i] + 7, &end, 0);
+			if (*end == 'k' || *end == 'K') options->size <<= 10;
+			if (*end == 'm' || *end == 'M') options->size <<= 20;
+		} else if (!strncmp(argv[i], "--iterations=", 13)) {
+			options->iterations = atoi(argv[i] + 13);
+		} else if (!strncmp(argv[i], "--seed=", 7)) {
+			options->seed = strtoull(argv[i] + 7, NULL, 0);
+		} else if (!strncmp(argv[i], "--mix=", 6)) {
+			// Comma-separated weights in the order of bench_kind_names.
+			char *str = argv[i] + 6;
+			for (int kind = 0; kind < BENCH_N_KINDS; kind++) {
+				options->mix[kind] = strtol(str, &str, 0);
+				if (*str == ',') str ++;
+				else if (kind < BENCH_N_KINDS - 1) break;
+			}
+		} else {
+			printf("%s --mode=bench-lex [--size=<bytes>[k|m]] [--iterations=<n>] [--seed=<n>] [--mix=<weights>]\n", *argv);
+			printf("  --mix takes comma-separated weights for: ");
+			for (int kind = 0; kind < BENCH_N_KINDS; kind++) {
+				printf(kind ? ",%s" : "%s", bench_kind_names[kind]);
+			}
+			printf("\n");
+			options->abort = true;
+		}
+	}
+	int total = 0;
+	for (int kind = 0; kind < BENCH_N_KINDS; kind++) {
+		if (options->mix[kind] < 0) options->mix[kind] = 0;
+		total += options->mix[kind];
+	}
+	if (!total) {
+		printf("Error: --mix must have at least one non-zero weight.\n");
+		options->abort = true;
+	}
+}
+
+// Measure tokeniser throughput on generated C sources.
+int perform_lex_bench(int argc, char **argv) {
+	bench_options_t options = {
+		.size       = 1 << 20,
+		.iterations = 5,
+		.mix        = { 4, 2, 1, 2, 4 },
+		.seed       = 1,
+		.abort      = false,
+	};
+	bench_parse_options(&options, argc, argv);
+	if (options.abort) return 1;
+	
+	size_t len;
+	char  *source = bench_gen_source(&options, &len);
+	printf("Source: %zu bytes, mix", len);
+	for (int kind = 0; kind < BENCH_N_KINDS; kind++) {
+		printf(" %s=%d", bench_kind_names[kind], options.mix[kind]);
+	}
+	printf(", %d iterations\n", options.iterations);
+	
+	// The file descriptor path reads through a real file.
+	FILE *fd = tmpfile();
+	if (!fd || fwrite(source, 1, len, fd) != len) {
+		printf("Error: Cannot write temporary file.\n");
+		return 1;
+	}
+	
+	bench_result_t res_fd   = {0};
+	bench_result_t res_cstr = {0};
+	bench_result_t res_map  = {0};
+	for (int i = 0; i < options.iterations; i++) {
+		tokeniser_ctx_t ctx;
+		
+		// Every tokeniser registers the source in the location space again; without this,
+		// large sources run out of locations after a few iterations.
+		srcfile_reset();
+		
+		// Reading character by character from the file.
+		rewind(fd);
+		tokeniser_init_file(&ctx, fd);
+		bench_run(&ctx, &res_fd);
+		tokeniser_destroy(&ctx);
+		
+		// Tokenising a C string in memory.
+		tokeniser_init_cstr(&ctx, source);
+		bench_run(&ctx, &res_cstr);
+		tokeniser_destroy(&ctx);
+		
+		// Mapping the file into memory, as the compiler does.
+		rewind(fd);
+		if (tokeniser_init_mapped(&ctx, fd)) {
+			bench_run(&ctx, &res_map);
+		}
+		tokeniser_destroy(&ctx);
+	}
+	
+	printf("%-8s %12s %12s %12s %10s\n", "path", "tokens/s", "MiB/s", "allocs/tkn", "seconds");
+	bench_report("use_fd", &res_fd);
+	bench_report("cstr",   &res_cstr);
+	bench_report("mapped", &res_map);
+	
+	fclose(fd);
+	free(source);
+	return 0;
+}
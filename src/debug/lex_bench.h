@@ -0,0 +1,8 @@
+
+#ifndef LEX_BENCH_H
+#define LEX_BENCH_H
+
+// Measure tokeniser throughput on generated C sources.
+int perform_lex_bench(int argc, char **argv);
+
+#endif //LEX_BENCH_H
@@ -67,5 +67,14 @@ void pront_expr(expr_t *expr) {
 			pront_expr(expr->par_b);
 			printf("%s ", op_names[expr->oper]);
 			break;
+		case (EXPR_TYPE_MATH1A):
+			pront_expr(expr->par_a);
+			printf("%s ASSIGN ", op_names[expr->oper]);
+			break;
+		case (EXPR_TYPE_MATH2A):
+			pront_expr(expr->par_a);
+			pront_expr(expr->par_b);
+			printf("%s ASSIGN ", op_names[expr->oper]);
+			break;
 	}
 }
@@ -367,7 +367,12 @@ typedef enum expr_type {
 	// Unary math (e.g. !a, -b or *c).
 	EXPR_TYPE_MATH1,
 	// Binary math (e.g. a+b, c*d or e^f).
-	EXPR_TYPE_MATH2
+	EXPR_TYPE_MATH2,
+	
+	// Unary assignment math (e.g. ++a or --b).
+	EXPR_TYPE_MATH1A,
+	// Binary assignment math (e.g. a+=b, c*=d or e^=f).
+	EXPR_TYPE_MATH2A
 } expr_type_t;
 
 // Locations in which a variable can be stored at runtime.
@@ -0,0 +1,95 @@
+
+#include "lex_thread.h"
+#include "sync.h"
+#include <sched.h>
+#include "ctxalloc_warn.h"
+
+// Lexer thread main loop: tokenise until the end of the file or until stopped.
+static void *lex_thread_main(void *arg) {
+	lex_thread_t *lex  = arg;
+	size_t        head = atomic_load_explicit(&lex->head, memory_order_relaxed);
+	
+	while (1) {
+		// Wait for space in the ring.
+		while (head - atomic_load_explicit(&lex->tail, memory_order_acquire) >= LEX_RING_SIZE) {
+			if (atomic_load_explicit(&lex->stop, memory_order_relaxed)) return NULL;
+			sched_yield();
+		}
+		
+		// Preprocess straight into the ring.
+		preproc_ctx_t *pp  = lex->preproc;
+		lex_token_t   *tkn = &lex->ring[head % LEX_RING_SIZE];
+		tkn->id        = preproc_next(pp, &tkn->lval);
+		tkn->diags     = NULL;
+		tkn->diags_len = pp->diags_len;
+		if (pp->diags_len) {
+			// Diagnostics are handed over to the parser thread.
+			tkn->diags = xalloc(pp->allocator, sizeof(pp_diag_t) * pp->diags_len);
+			memcpy(tkn->diags, pp->diags, sizeof(pp_diag_t) * pp->diags_len);
+			pp->diags_len = 0;
+		}
+		
+		// Publish the token.
+		head ++;
+		atomic_store_explicit(&lex->head, head, memory_order_release);
+		if (!tkn->id) return NULL;
+	}
+}
+
+// Start preprocessing and lexing a file on a new thread.
+// The parser must then use lex->view instead of the preprocessor's tokeniser.
+// Returns false if the tokeniser can't be run on another thread.
+bool lex_thread_start(lex_thread_t *lex, preproc_ctx_t *preproc) {
+	// File descriptor sources are read by the error reporting code, so they can't be shared.
+	if (preproc->main->use_fd) return false;
+	
+	lex->preproc       = preproc;
+	lex->view          = *preproc->main;
+	lex->done          = false;
+	atomic_init(&lex->stop, false);
+	atomic_init(&lex->head, 0);
+	atomic_init(&lex->tail, 0);
+	
+	sync_enabled = true;
+	if (pthread_create(&lex->thread, NULL, lex_thread_main, lex)) {
+		sync_enabled = false;
+		return false;
+	}
+	return true;
+}
+
+// Get the next token from the lexer thread, reporting its errors, if any.
+// Behaves like preproc_next followed by preproc_report, but on lex->view.
+int lex_thread_next(lex_thread_t *lex) {
+	if (lex->done) return 0;
+	
+	// Wait for a token.
+	size_t tail = atomic_load_explicit(&lex->tail, memory_order_relaxed);
+	while (atomic_load_explicit(&lex->head, memory_order_acquire) == tail) {
+		sched_yield();
+	}
+	
+	// Copy it out before handing the slot back.
+	lex_token_t tkn = lex->ring[tail % LEX_RING_SIZE];
+	atomic_store_explicit(&lex->tail, tail + 1, memory_order_release);
+	
+	// Catch the parser's view up with this token.
+	// The lexer thread has finished with the tokeniser once it sends the end of the file.
+	tokeniser_view_token(&lex->view, lex->preproc->main, tkn.id, tkn.lval.pos);
+	for (size_t i = 0; i < tkn.diags_len; i++) {
+		report_error(&lex->view, tkn.diags[i].type, tkn.diags[i].pos, tkn.diags[i].msg);
+	}
+	if (!tkn.id) {
+		lex->done = true;
+		return 0;
+	}
+	yylval = tkn.lval;
+	return tkn.id;
+}
+
+// Stop the lexer thread and wait for it to exit.
+void lex_thread_stop(lex_thread_t *lex) {
+	atomic_store_explicit(&lex->stop, true, memory_order_relaxed);
+	pthread_join(lex->thread, NULL);
+	sync_enabled = false;
+}
@@ -0,0 +1,62 @@
+
+#ifndef LEX_THREAD_H
+#define LEX_THREAD_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "tokeniser.h"
+#include "parser.h"
+#include "preproc.h"
+
+// Number of tokens the lexer thread may run ahead of the parser; must be a power of two.
+#define LEX_RING_SIZE 256
+
+struct lex_token;
+struct lex_thread;
+
+typedef struct lex_token lex_token_t;
+typedef struct lex_thread lex_thread_t;
+
+// A token produced ahead of time by the lexer thread.
+struct lex_token {
+	// Token ID, 0 at the end of the file.
+	int           id;
+	// Token value and position.
+	YYSTYPE       lval;
+	// Diagnostics to report once the parser reaches this token.
+	pp_diag_t    *diags;
+	size_t        diags_len;
+};
+
+// A lexer running on its own thread, feeding a single-producer single-consumer ring of tokens.
+struct lex_thread {
+	// The preprocessor run by the lexer thread.
+	preproc_ctx_t   *preproc;
+	// The parser's view of the tokeniser, kept at the last token handed out.
+	tokeniser_ctx_t  view;
+	// The thread running the lexer.
+	pthread_t        thread;
+	// Whether the last token has been handed out.
+	bool             done;
+	// Set to make the lexer thread stop early.
+	atomic_bool      stop;
+	// Index of the next token to be written; only written by the lexer thread.
+	atomic_size_t    head;
+	// Index of the next token to be read; only written by the parser thread.
+	atomic_size_t    tail;
+	// The token ring.
+	lex_token_t      ring[LEX_RING_SIZE];
+};
+
+// Start preprocessing and lexing a file on a new thread.
+// The parser must then use lex->view instead of the preprocessor's tokeniser.
+// Returns false if the tokeniser can't be run on another thread.
+bool lex_thread_start(lex_thread_t *lex, preproc_ctx_t *preproc);
+// Get the next token from the lexer thread, reporting its errors, if any.
+// Behaves like preproc_next followed by preproc_report, but on lex->view.
+int  lex_thread_next (lex_thread_t *lex);
+// Stop the lexer thread and wait for it to exit.
+void lex_thread_stop (lex_thread_t *lex);
+
+#endif // LEX_THREAD_H
@@ -0,0 +1,143 @@
+
+#include "location.h"
+#include "ctxalloc.h"
+#include "array_util.h"
+#include "sync.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "ctxalloc_warn.h"
+
+// Allocator for source files, separate from global_alloc so the lexer thread can use it.
+static alloc_ctx_t srcfile_alloc;
+
+// All files in the location space, sorted by base location.
+static srcfile_t **srcfiles;
+static size_t      srcfiles_len, srcfiles_cap;
+
+// Register a new source file of a given length in the location space.
+// The source text may be NULL if the file isn't held in memory.
+// Source files live until the program exits.
+srcfile_t *srcfile_create(char *filename, const char *source, size_t len) {
+	sync_lock(&sync_mutex);
+	if (!srcfile_alloc) {
+		srcfile_alloc = alloc_create(ALLOC_NO_PARENT);
+		alloc_set_name(srcfile_alloc, "srcfile");
+	}
+	
+	// Files start right after the previous file's end location.
+	uint64_t base = 1;
+	if (srcfiles_len) {
+		srcfile_t *last = srcfiles[srcfiles_len - 1];
+		base = (uint64_t) last->base + last->len + 1;
+	}
+	if (base + len > UINT32_MAX) {
+		fprintf(stderr, "Error: too much source code to number locations in %s\n", filename);
+		abort();
+	}
+	
+	srcfile_t *file = xalloc(srcfile_alloc, sizeof(srcfile_t));
+	*file = (srcfile_t) {
+		.filename        = filename,
+		.source          = source,
+		.base            = base,
+		.len             = len,
+		.line_starts     = NULL,
+		.line_starts_len = 0,
+		.line_starts_cap = 0,
+	};
+	// The first line starts at the start of the file.
+	array_len_cap_concat(srcfile_alloc, size_t, file->line_starts, file->line_starts_cap, file->line_starts_len, 0);
+	
+	array_len_cap_concat(srcfile_alloc, srcfile_t *, srcfiles, srcfiles_cap, srcfiles_len, file);
+	sync_unlock(&sync_mutex);
+	return file;
+}
+
+// Forget all source files, so their location space can be used again.
+// Locations and source files from before become invalid; meant for benchmarks that lex the same input many times.
+void srcfile_reset() {
+	sync_lock(&sync_mutex);
+	if (srcfile_alloc) alloc_clear(srcfile_alloc);
+	srcfiles     = NULL;
+	srcfiles_len = 0;
+	srcfiles_cap = 0;
+	sync_unlock(&sync_mutex);
+}
+
+// Record that a new line of the file starts at the given offset.
+void srcfile_add_line(srcfile_t *file, size_t offset) {
+	sync_lock(&sync_mutex);
+	array_len_cap_concat(srcfile_alloc, size_t, file->line_starts, file->line_starts_cap, file->line_starts_len, offset);
+	sync_unlock(&sync_mutex);
+}
+
+// Find the start of a line, or of the last line seen before it if it hasn't been seen yet.
+// The line number is updated to the line found.
+size_t srcfile_line_start(srcfile_t *file, int *line) {
+	sync_lock(&sync_mutex);
+	if (*line < 1) *line = 1;
+	if (*line > file->line_starts_len) *line = file->line_starts_len;
+	size_t offset = file->line_starts[*line - 1];
+	sync_unlock(&sync_mutex);
+	return offset;
+}
+
+// Find the line number of an offset in the file, without locking.
+static int srcfile_line_int(srcfile_t *file, size_t offset) {
+	// Find the last line start at or before offset.
+	size_t lo = 0, hi = file->line_starts_len;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (file->line_starts[mid] <= offset) lo = mid;
+		else hi = mid;
+	}
+	return lo + 1;
+}
+
+// Find the line number of an offset in the file.
+int srcfile_line(srcfile_t *file, size_t offset) {
+	sync_lock(&sync_mutex);
+	int line = srcfile_line_int(file, offset);
+	sync_unlock(&sync_mutex);
+	return line;
+}
+
+// Find the file a location belongs to, without locking.
+static srcfile_t *srcloc_file_int(srcloc_t loc) {
+	if (!loc || !srcfiles_len) return NULL;
+	
+	// Find the last file starting at or before loc.
+	size_t lo = 0, hi = srcfiles_len;
+	while (hi - lo > 1) {
+		size_t mid = (lo + hi) / 2;
+		if (srcfiles[mid]->base <= loc) lo = mid;
+		else hi = mid;
+	}
+	srcfile_t *file = srcfiles[lo];
+	// The end location of a file is valid, the one after that is not.
+	if (loc < file->base || loc > file->base + file->len) return NULL;
+	return file;
+}
+
+// Find the file a location belongs to.
+// Returns NULL for locations that don't belong to any file.
+srcfile_t *srcloc_file(srcloc_t loc) {
+	sync_lock(&sync_mutex);
+	srcfile_t *file = srcloc_file_int(loc);
+	sync_unlock(&sync_mutex);
+	return file;
+}
+
+// Decode a location into filename, line and column.
+// Returns NULL for locations that don't belong to any file.
+srcfile_t *srcloc_decode(srcloc_t loc, int *line, int *col) {
+	sync_lock(&sync_mutex);
+	srcfile_t *file = srcloc_file_int(loc);
+	if (file) {
+		size_t offset = loc - file->base;
+		*line = srcfile_line_int(file, offset);
+		*col  = offset - file->line_starts[*line - 1] + 1;
+	}
+	sync_unlock(&sync_mutex);
+	return file;
+}
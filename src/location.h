@@ -0,0 +1,54 @@
+
+#ifndef LOCATION_H
+#define LOCATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct srcfile;
+
+// An encoded source location: one offset into the space of all source files.
+// Location 0 never belongs to a file and means "no location".
+typedef uint32_t srcloc_t;
+typedef struct srcfile srcfile_t;
+
+// A source file, mapped into the global location space.
+// Line starts are appended by the tokeniser, which may run on its own thread;
+// other threads must go through the functions below to read them.
+struct srcfile {
+	// Filename, as reported in diagnostics.
+	char       *filename;
+	// Text of the file, if held in memory; used to print diagnostics.
+	const char *source;
+	// Location of the first byte of the file.
+	srcloc_t    base;
+	// Length of the file in bytes.
+	size_t      len;
+	// Offsets of the starts of lines seen so far, indexed by line number - 1.
+	size_t     *line_starts;
+	size_t      line_starts_len, line_starts_cap;
+};
+
+// Register a new source file of a given length in the location space.
+// The source text may be NULL if the file isn't held in memory.
+// Source files live until the program exits.
+srcfile_t *srcfile_create(char *filename, const char *source, size_t len);
+// Forget all source files, so their location space can be used again.
+// Locations and source files from before become invalid; meant for benchmarks that lex the same input many times.
+void       srcfile_reset();
+// Record that a new line of the file starts at the given offset.
+void       srcfile_add_line(srcfile_t *file, size_t offset);
+// Find the start of a line, or of the last line seen before it if it hasn't been seen yet.
+// The line number is updated to the line found.
+size_t     srcfile_line_start(srcfile_t *file, int *line);
+// Find the line number of an offset in the file.
+int        srcfile_line(srcfile_t *file, size_t offset);
+
+// Find the file a location belongs to.
+// Returns NULL for locations that don't belong to any file.
+srcfile_t *srcloc_file(srcloc_t loc);
+// Decode a location into filename, line and column.
+// Returns NULL for locations that don't belong to any file.
+srcfile_t *srcloc_decode(srcloc_t loc, int *line, int *col);
+
+#endif // LOCATION_H
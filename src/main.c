@@ -16,6 +16,10 @@
 
 #include "ctxalloc.h"
 
+#ifdef DEBUG_COMPILER
+#include "lex_bench.h"
+#endif
+
 #include "stdlib.h"
 #include "errno.h"
 
@@ -41,6 +45,12 @@ int main(int argc, char **argv) {
 		argv[1] = argv[0];
 		return mode_addr2line(argc-1, argv+1);
 		
+#ifdef DEBUG_COMPILER
+	} else if (argc >= 2 && !strcmp(argv[1], "--mode=bench-lex")) {
+		argv[1] = argv[0];
+		return perform_lex_bench(argc-1, argv+1);
+		
+#endif
 	}
 	
 	// Check for mode by name.
@@ -31,9 +31,9 @@ struct a2l_pos {
 	char     *abs_path;
 	// Relative filename.
 	char     *rel_path;
-	// Position information encoded.
+	// Position information decoded.
 	// Uses relative filename.
-	pos_t     pos;
+	pos_info_t pos;
 	// Address of position.
 	address_t addr;
 };
@@ -9,6 +9,9 @@
 #include "array_util.h"
 #include "parser.h"
 #include "asm_postproc.h"
+#include "lex_thread.h"
+#include "preproc.h"
+#include "pch.h"
 
 typedef struct options {
 	bool abort;
@@ -20,8 +23,20 @@ typedef struct options {
 	char **includeDirs;
 	char *outputFile;
 	char *linenumFile;
+	char *pchOutFile;
+	char *pchInFile;
+	bool allocStats;
 } options_t;
 
+// Whether to run the lexer on its own thread, set by -fthreaded-lexer.
+static bool threaded_lexer = false;
+// Directories to search for includes, set by -I and --include=.
+static char **include_dirs     = NULL;
+static size_t include_dirs_len = 0;
+// Declaration snapshots to write and to load, set by --pch-out= and --pch-in=.
+static char  *pch_out_file     = NULL;
+static char  *pch_in_file      = NULL;
+
 // Show help on the command line.
 static void show_help     (int argc, char **argv);
 // Parse options using argv.
@@ -44,6 +59,9 @@ int mode_compile(int argc, char **argv) {
 		.includeDirs    = NULL,
 		.outputFile     = NULL,
 		.linenumFile    = NULL,
+		.pchOutFile     = NULL,
+		.pchInFile      = NULL,
+		.allocStats     = false,
 	};
 	
 	parse_options(&options, argc, argv);
@@ -60,6 +78,10 @@ int mode_compile(int argc, char **argv) {
 	if (options.abort) {
 		return 1;
 	}
+	include_dirs     = options.includeDirs;
+	include_dirs_len = options.numIncludeDirs;
+	pch_out_file     = options.pchOutFile;
+	pch_in_file      = options.pchInFile;
 	
 	// Enforce anough inputs.
 	if (options.numSourceFiles == 0) {
@@ -69,6 +91,7 @@ int mode_compile(int argc, char **argv) {
 	
 	// Compile first of the inputs.
 	asm_ctx_t *ctx = compile(options.sourceFiles[0], NULL);
+	if (!ctx) return 1;
 	
 	// Open output file.
 	ctx->out_fd = fopen(options.outputFile, "wb");
@@ -95,6 +118,10 @@ int mode_compile(int argc, char **argv) {
 	fclose(ctx->out_fd);
 	if (ctx->out_addr2line) fclose(ctx->out_addr2line);
 	
+	#ifdef CTXALLOC_STATS
+	if (options.allocStats) alloc_stats_dump();
+	#endif
+	
 	char tmp[34+strlen(options.outputFile)];
 	snprintf(tmp, sizeof(tmp), "hexdump -ve '8/2 \"%%04X \" \"\n\"' '%s'", options.outputFile);
 	system(tmp);
@@ -173,6 +200,24 @@ static void parse_options(options_t *options, int argc, char **argv) {
 			options->includeDirs = (char **) xrealloc(global_alloc, options->includeDirs, sizeof(char *) * options->numIncludeDirs);
 			options->includeDirs[options->numIncludeDirs - 1] = &(argv[argIndex])[10];
 			
+		} else if (!strncmp(argv[argIndex], "--pch-out=", 10)) {
+			// Declaration snapshot to write.
+			options->pchOutFile = &(argv[argIndex])[10];
+			
+		} else if (!strncmp(argv[argIndex], "--pch-in=", 9)) {
+			// Declaration snapshot to load.
+			options->pchInFile = &(argv[argIndex])[9];
+			
+		} else if (!strcmp(argv[argIndex], "--stats=alloc")) {
+			// Allocation statistics.
+			#ifdef CTXALLOC_STATS
+			options->allocStats = true;
+			#else
+			fflush(stdout);
+			fprintf(stderr, "Error: '--stats=alloc' needs a compiler built with CTXALLOC_STATS (make debug STATS=1)\n");
+			options->abort = true;
+			#endif
+			
 		#ifdef HAS_MACHINE_ARGPARSE
 		} else if (!strncmp(argv[argIndex], "-m", 2)) {
 			// Machine option.
@@ -181,11 +226,8 @@ static void parse_options(options_t *options, int argc, char **argv) {
 			}
 		#endif
 			
-		} else if (!strncmp(argv[argIndex], "-f", 2)) {
-			// Machine-independant option.
-			if (!flag_argparse(argv[argIndex]+2)) {
-				options->abort = true;
-			}
+		} else if (!strncmp(argv[argIndex], "-f", 2) && flag_argparse(argv[argIndex]+2)) {
+			// Machine-independant option; unrecognised ones are reported below.
 			
 		} else if (*argv[argIndex] == '-') {
 			// Unknown option.
@@ -215,6 +257,14 @@ static void show_help(int argc, char **argv) {
 	printf("                Specify the output file path.\n");
 	printf("  -I<dir>  --include=<dir>\n");
 	printf("                Add a directory to the include directories.\n");
+	printf("  --pch-out=<file>\n");
+	printf("                Write the function declarations of the input to a snapshot.\n");
+	printf("  --pch-in=<file>\n");
+	printf("                Load function declarations from a snapshot before compiling.\n");
+	printf("  --stats=alloc\n");
+	printf("                Show how much memory each part of the compiler used (make debug STATS=1 only).\n");
+	printf("  -fthreaded-lexer\n");
+	printf("                Run the lexer on its own thread, ahead of the parser.\n");
 }
 
 // Apply default options for options not already set.
@@ -225,7 +275,7 @@ static void apply_defaults(options_t *options) {
 }
 
 // Parse -f arguments, the '-f' removed.
-// Returns true on success.
+// Returns false if the flag is not recognised.
 bool flag_argparse(const char *arg) {
 	if (!strcmp(arg, "pic") || !strcmp(arg, "PIC")) {
 		#ifdef HAS_PIE_OBJ
@@ -243,7 +293,14 @@ bool flag_argparse(const char *arg) {
 		#else
 		printf("Error: -f%s is not supported by %s.", arg, ARCH_ID);
 		#endif
+	} else if (!strcmp(arg, "threaded-lexer")) {
+		threaded_lexer = true;
+	} else if (!strcmp(arg, "no-threaded-lexer")) {
+		threaded_lexer = false;
+	} else {
+		return false;
 	}
+	return true;
 }
 
 
@@ -277,30 +334,75 @@ asm_ctx_t *compile_c(char *filename, tokeniser_ctx_t *tokeniser_ctx) {
 			printf("Cannot open %s: %s\n", filename, strerror(errno));
 			return NULL;
 		}
-		tokeniser_init_file(tokeniser_ctx, fd);
-		tokeniser_ctx->filename = filename;
+		if (!tokeniser_init_mapped(tokeniser_ctx, fd)) {
+			printf("Cannot read %s: %s\n", filename, strerror(errno));
+			tokeniser_destroy(tokeniser_ctx);
+			fclose(fd);
+			return NULL;
+		}
+		tokeniser_ctx->file->filename = filename;
 	}
 	
 	// Init some ctx.
 	parser_ctx_t    ctx;
 	asm_ctx_t       asm_ctx;
-	ctx.tokeniser_ctx = tokeniser_ctx;
+	preproc_ctx_t   preproc;
+	preproc_init(&preproc, tokeniser_ctx, include_dirs, include_dirs_len);
+	// The parser sees the tokeniser as of the last token it was given.
+	tokeniser_ctx_t view = *tokeniser_ctx;
+	ctx.tokeniser_ctx = &view;
 	ctx.asm_ctx       = &asm_ctx;
-	ctx.allocator     = alloc_create(ALLOC_NO_PARENT);
+	ctx.allocator     = alloc_create_arena(ALLOC_NO_PARENT, ALLOC_ARENA_CHUNK);
+	alloc_set_name(ctx.allocator, "parser");
 	ctx.n_const       = 0;
+	map_create(&ctx.scnsts);
+	ctx.preproc       = &preproc;
+	ctx.lex_thread    = NULL;
+	
+	// Lex on another thread, if enabled.
+	if (threaded_lexer) {
+		lex_thread_t *lex = xalloc(ctx.allocator, sizeof(lex_thread_t));
+		if (lex_thread_start(lex, &preproc)) {
+			ctx.lex_thread    = lex;
+			ctx.tokeniser_ctx = &lex->view;
+		} else {
+			xfree(ctx.allocator, lex);
+		}
+	}
+	
 	asm_init(&asm_ctx);
-	asm_ctx.tokeniser_ctx = tokeniser_ctx;
+	asm_ctx.tokeniser_ctx = ctx.tokeniser_ctx;
+	
+	// Start from the snapshot's declarations, if any.
+	bool   ok     = !pch_in_file || pch_read(&asm_ctx, pch_in_file);
+	size_t errors = report_error_count;
 	
 	// Parse and compile C.
-	yyparse(&ctx);
+	if (ok) yyparse(&ctx);
+	scnsts_write(&ctx);
 	
 	// Clean up.
+	if (ctx.lex_thread) {
+		lex_thread_stop(ctx.lex_thread);
+	}
+	// Snapshot the declarations now that all positions are final.
+	// Declarations of a source with errors may be incomplete, so no snapshot is made of them;
+	// an older snapshot is removed so that it isn't mistaken for this one.
+	if (ok && pch_out_file && report_error_count != errors) {
+		remove(pch_out_file);
+	} else if (ok && pch_out_file) {
+		ok = pch_write(&asm_ctx, pch_out_file);
+	}
+	asm_ctx.tokeniser_ctx = tokeniser_ctx;
+	preproc_destroy(&preproc);
+	map_delete(&ctx.scnsts);
 	alloc_destroy(ctx.allocator);
 	if (fd) {
 		fclose(fd);
 		tokeniser_destroy(tokeniser_ctx);
 	}
 	
+	if (!ok) return NULL;
 	return XCOPY(global_alloc, &asm_ctx, asm_ctx_t);
 }
 
@@ -317,8 +419,13 @@ asm_ctx_t *assemble_s(char *filename, tokeniser_ctx_t *tokeniser_ctx) {
 			printf("Cannot open %s: %s\n", filename, strerror(errno));
 			return NULL;
 		}
-		tokeniser_init_file(tokeniser_ctx, fd);
-		tokeniser_ctx->filename = filename;
+		if (!tokeniser_init_mapped(tokeniser_ctx, fd)) {
+			printf("Cannot read %s: %s\n", filename, strerror(errno));
+			tokeniser_destroy(tokeniser_ctx);
+			fclose(fd);
+			return NULL;
+		}
+		tokeniser_ctx->file->filename = filename;
 	}
 	
 	// Init some ctx.
@@ -342,7 +449,10 @@ asm_ctx_t *assemble_s(char *filename, tokeniser_ctx_t *tokeniser_ctx) {
 
 // Callback from bison, asking for more tokens.
 int yylex(parser_ctx_t *ctx) {
-	int tkn = tokenise(ctx->tokeniser_ctx);
+	if (ctx->lex_thread) return lex_thread_next(ctx->lex_thread);
+	int tkn = preproc_next(ctx->preproc, &yylval);
+	tokeniser_view_token(ctx->tokeniser_ctx, ctx->preproc->main, tkn, yylval.pos);
+	preproc_report(ctx->preproc, ctx->tokeniser_ctx);
 	return tkn;
 }
 
@@ -381,7 +491,8 @@ void function_added(parser_ctx_t *ctx, funcdef_t *func) {
 		// Abort code generation.
 		return;
 	} else {
-		// Put in MAP.
+		// Put in MAP; func is on the parser's value stack, so the map gets a copy.
+		func = XCOPY(ctx->asm_ctx->allocator, func, funcdef_t);
 		map_set(&ctx->asm_ctx->functions, func->ident.strval, func);
 	}
 	// Gen some CODE boi.
@@ -12,7 +12,7 @@ int mode_compile(int argc, char **argv);
 // Returns true on success.
 bool machine_argparse(const char *arg);
 // Parse -f arguments, the '-f' removed.
-// Returns true on success.
+// Returns false if the flag is not recognised.
 bool flag_argparse   (const char *arg);
 
 // Compile a file of unknown type.
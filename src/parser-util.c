@@ -1,6 +1,7 @@
 
 #include "parser-util.h"
 #include "gen_util.h"
+#include "array_util.h"
 #include <malloc.h>
 
 // Incomplete function definition (without code).
@@ -35,15 +36,13 @@ stmts_t stmts_empty(parser_ctx_t *ctx) {
 	return (stmts_t) {
 		.arr = NULL,
 		.num = 0,
+		.cap = 0,
 	};
 }
 
-// Concatenate to a list of statements.
-stmts_t stmts_cat(parser_ctx_t *ctx, stmts_t *stmts, stmt_t *stmt) {
-	stmts->num ++;
-	stmts->arr = xrealloc(ctx->allocator, stmts->arr, stmts->num * sizeof(stmt_t));
-	stmts->arr[stmts->num - 1] = *stmt;
-	return *stmts;
+// Concatenate to a list of statements, in place.
+void stmts_cat(parser_ctx_t *ctx, stmts_t *stmts, stmt_t *stmt) {
+	array_len_cap_concat(ctx->allocator, stmt_t, stmts->arr, stmts->cap, stmts->num, *stmt);
 }
 
 
@@ -173,23 +172,22 @@ iasm_reg_t stmt_iasm_reg(parser_ctx_t *ctx, strval_t *symbol, strval_t *mode, ex
 iasm_regs_t iasm_regs_empty(parser_ctx_t *ctx) {
 	return (iasm_regs_t) {
 		.arr = NULL,
-		.num = 0
+		.num = 0,
+		.cap = 0,
 	};
 }
 
-// Concatenate to a list of iasm_reg.
-iasm_regs_t iasm_regs_cat(parser_ctx_t *ctx, iasm_regs_t *iasm_regs, iasm_reg_t *iasm_reg) {
-	iasm_regs->num ++;
-	iasm_regs->arr = xrealloc(ctx->allocator, iasm_regs->arr, iasm_regs->num * sizeof(ident_t));
-	iasm_regs->arr[iasm_regs->num - 1] = *iasm_reg;
-	return *iasm_regs;
+// Concatenate to a list of iasm_reg, in place.
+void iasm_regs_cat(parser_ctx_t *ctx, iasm_regs_t *iasm_regs, iasm_reg_t *iasm_reg) {
+	array_len_cap_concat(ctx->allocator, iasm_reg_t, iasm_regs->arr, iasm_regs->cap, iasm_regs->num, *iasm_reg);
 }
 
 // A list of one iasm_reg.
 iasm_regs_t iasm_regs_one(parser_ctx_t *ctx, iasm_reg_t *iasm_reg) {
 	return (iasm_regs_t) {
 		.arr = XCOPY(ctx->allocator, iasm_reg, iasm_reg_t),
-		.num = 1
+		.num = 1,
+		.cap = 1,
 	};
 }
 
@@ -239,12 +237,13 @@ ident_t ident_of_types(parser_ctx_t *ctx, ident_t *ptrs, ident_t *inner, ident_t
 idents_t idents_empty(parser_ctx_t *ctx) {
 	return (idents_t) {
 		.arr = NULL,
-		.num = 0
+		.num = 0,
+		.cap = 0,
 	};
 }
 
-// Concatenate to a list of identities.
-idents_t idents_cat(parser_ctx_t *ctx, idents_t *idents, int *s_type_ptr, strval_t *name, expr_t *init) {
+// Concatenate to a list of identities, in place.
+void idents_cat(parser_ctx_t *ctx, idents_t *idents, int *s_type_ptr, strval_t *name, expr_t *init) {
 	simple_type_t s_type;
 	if (!s_type_ptr) {
 		s_type = ctx->s_type;
@@ -252,15 +251,13 @@ idents_t idents_cat(parser_ctx_t *ctx, idents_t *idents, int *s_type_ptr, strval
 		s_type = *s_type_ptr;
 	}
 	
-	idents->num ++;
-	idents->arr = xrealloc(ctx->allocator, idents->arr, idents->num * sizeof(ident_t));
-	idents->arr[idents->num - 1] = (ident_t) {
+	ident_t ident = {
 		.pos         = name->pos,
 		.strval      = name->strval,
 		.type        = ctype_simple(ctx->asm_ctx, s_type),
 		.initialiser = init ? XCOPY(ctx->allocator, init, expr_t) : NULL,
 	};
-	return *idents;
+	array_len_cap_concat(ctx->allocator, ident_t, idents->arr, idents->cap, idents->num, ident);
 }
 
 // A list of one identity.
@@ -280,17 +277,15 @@ idents_t idents_one(parser_ctx_t *ctx, int *s_type_ptr, strval_t *name, expr_t *
 	};
 	return (idents_t) {
 		.arr = XCOPY(ctx->allocator, &ident, ident_t),
-		.num = 1
+		.num = 1,
+		.cap = 1,
 	};
 }
 
-// Concatenate to a list of identities (using existing ident_t).
-idents_t idents_cat_ex(parser_ctx_t *ctx, idents_t *idents, ident_t *ident, expr_t *init) {
+// Concatenate to a list of identities (using existing ident_t), in place.
+void idents_cat_ex(parser_ctx_t *ctx, idents_t *idents, ident_t *ident, expr_t *init) {
 	ident->initialiser = init ? XCOPY(ctx->allocator, init, expr_t) : NULL;
-	idents->num ++;
-	idents->arr = xrealloc(ctx->allocator, idents->arr, idents->num * sizeof(ident_t));
-	idents->arr[idents->num - 1] = *ident;
-	return *idents;
+	array_len_cap_concat(ctx->allocator, ident_t, idents->arr, idents->cap, idents->num, *ident);
 }
 
 // A list of one identity (using existing ident_t).
@@ -298,7 +293,8 @@ idents_t idents_one_ex(parser_ctx_t *ctx, ident_t *ident, expr_t *init) {
 	ident->initialiser = init ? XCOPY(ctx->allocator, init, expr_t) : NULL;
 	return (idents_t) {
 		.arr = XCOPY(ctx->allocator, ident, ident_t),
-		.num = 1
+		.num = 1,
+		.cap = 1,
 	};
 }
 
@@ -308,7 +304,8 @@ idents_t idents_one_ex(parser_ctx_t *ctx, ident_t *ident, expr_t *init) {
 exprs_t exprs_empty(parser_ctx_t *ctx) {
 	return (exprs_t) {
 		.arr = NULL,
-		.num = 0
+		.num = 0,
+		.cap = 0,
 	};
 }
 
@@ -316,16 +313,14 @@ exprs_t exprs_empty(parser_ctx_t *ctx) {
 exprs_t exprs_one(parser_ctx_t *ctx, expr_t *expr) {
 	return (exprs_t) {
 		.arr = XCOPY(ctx->allocator, expr, expr_t),
-		.num = 1
+		.num = 1,
+		.cap = 1,
 	};
 }
 
-// Concatenate to a list of expressions.
-exprs_t exprs_cat(parser_ctx_t *ctx, exprs_t *exprs, expr_t *expr) {
-	exprs->num ++;
-	exprs->arr = xrealloc(ctx->allocator, exprs->arr, exprs->num * sizeof(expr_t));
-	exprs->arr[exprs->num - 1] = *expr;
-	return *exprs;
+// Concatenate to a list of expressions, in place.
+void exprs_cat(parser_ctx_t *ctx, exprs_t *exprs, expr_t *expr) {
+	array_len_cap_concat(ctx->allocator, expr_t, exprs->arr, exprs->cap, exprs->num, *expr);
 }
 
 
@@ -341,32 +336,21 @@ uint64_t expr_get_const(parser_ctx_t *ctx, expr_t *expr) {
 // Numeric constant expression.
 expr_t expr_icnst(parser_ctx_t *ctx, ival_t *val) {
 	return (expr_t) {
-		.type     = EXPR_TYPE_CONST,
-		.iconst   = val->ival
+		.type        = EXPR_TYPE_CONST,
+		.iconst      = val->ival,
+		.iconst_type = val->type
 	};
 }
 
 // String constant expression.
 expr_t expr_scnst(parser_ctx_t *ctx, strval_t *val) {
-	// Get a label for this string.
-	asm_label_t label = xalloc(ctx->tokeniser_ctx->allocator, 64);
-	sprintf(label, "__const%zu", ctx->n_const++);
-	
-	// Write the string into .rodata.
-	char *old_id = xstrdup(ctx->allocator, ctx->asm_ctx->current_section_id);
-	asm_use_sect(ctx->asm_ctx, ".rodata", ASM_NOT_ALIGNED);
-	asm_write_label(ctx->asm_ctx, label);
-	for (char *str = val->strval; *str; str++) {
-		asm_write_memword(ctx->asm_ctx, *str);
+	// Identical strings share one label.
+	asm_label_t label = map_get(&ctx->scnsts, val->strval);
+	if (!label) {
+		label = xalloc(ctx->allocator, 64);
+		sprintf(label, "__const%zu", ctx->n_const++);
+		map_set(&ctx->scnsts, val->strval, label);
 	}
-	asm_write_memword(ctx->asm_ctx, 0);
-	char *temp = esc_cstr(ctx->allocator, val->strval, strlen(val->strval));
-	DEBUG_GEN("  .db \"%s\", 0\n", temp);
-	xfree(ctx->allocator, temp);
-	
-	// Switch back to old section.
-	asm_use_sect(ctx->asm_ctx, old_id, ASM_NOT_ALIGNED);
-	xfree(ctx->allocator, old_id);
 	
 	// Package the assembly reference back up.
 	return (expr_t) {
@@ -375,6 +359,101 @@ expr_t expr_scnst(parser_ctx_t *ctx, strval_t *val) {
 	};
 }
 
+// A string constant as it is placed in .rodata.
+typedef struct {
+	const char  *str;
+	size_t       len;
+	asm_label_t  label;
+} scnst_ent_t;
+
+// Sort string constants by their reversed contents.
+// This puts every string directly before the strings it is a suffix of.
+static int scnst_ent_cmp(const void *a, const void *b) {
+	const scnst_ent_t *x = a, *y = b;
+	size_t len = x->len < y->len ? x->len : y->len;
+	for (size_t i = 1; i <= len; i++) {
+		unsigned char cx = x->str[x->len - i];
+		unsigned char cy = y->str[y->len - i];
+		if (cx != cy) return cx < cy ? -1 : 1;
+	}
+	if (x->len != y->len) return x->len < y->len ? -1 : 1;
+	return 0;
+}
+
+// Write part of a string constant into .rodata.
+static void scnst_write_part(parser_ctx_t *ctx, const char *str, size_t len, bool terminate) {
+	for (size_t i = 0; i < len; i++) {
+		asm_write_memword(ctx->asm_ctx, str[i]);
+	}
+	if (terminate) {
+		asm_write_memword(ctx->asm_ctx, 0);
+	}
+	#ifdef ENABLE_DEBUG_LOGS
+	char *temp = esc_cstr(ctx->allocator, str, len);
+	if (terminate) {
+		DEBUG_GEN("  .db \"%s\", 0\n", temp);
+	} else {
+		DEBUG_GEN("  .db \"%s\"\n", temp);
+	}
+	xfree(ctx->allocator, temp);
+	#endif
+}
+
+// Write all string constants into .rodata.
+// Strings that are a suffix of another string are stored as part of that string.
+void scnsts_write(parser_ctx_t *ctx) {
+	size_t num = map_size((&ctx->scnsts));
+	if (!num) return;
+	
+	// Sort the strings so that suffixes come right before the strings containing them.
+	scnst_ent_t *ents = xalloc(ctx->allocator, sizeof(scnst_ent_t) * num);
+	for (size_t i = 0; i < num; i++) {
+		ents[i] = (scnst_ent_t) {
+			.str   = ctx->scnsts.strings[i],
+			.len   = strlen(ctx->scnsts.strings[i]),
+			.label = (asm_label_t) ctx->scnsts.values[i],
+		};
+	}
+	qsort(ents, num, sizeof(scnst_ent_t), scnst_ent_cmp);
+	
+	char *old_id = ctx->asm_ctx->current_section_id ? xstrdup(ctx->allocator, ctx->asm_ctx->current_section_id) : NULL;
+	asm_use_sect(ctx->asm_ctx, ".rodata", ASM_NOT_ALIGNED);
+	
+	size_t start = 0;
+	for (size_t i = 0; i < num; i++) {
+		scnst_ent_t *host = &ents[i];
+		if (i + 1 < num && host->len <= ents[i+1].len
+				&& !memcmp(ents[i+1].str + ents[i+1].len - host->len, host->str, host->len)) {
+			// Stored as part of the next string.
+			continue;
+		}
+		
+		// Strings start..i are all suffixes of this one, longest last.
+		size_t next  = i + 1;
+		size_t piece = 0;
+		for (size_t pos = 0; next > start && pos <= host->len; pos++) {
+			if (host->len - ents[next-1].len != pos) continue;
+			if (pos > piece) {
+				scnst_write_part(ctx, host->str + piece, pos - piece, false);
+				piece = pos;
+			}
+			while (next > start && host->len - ents[next-1].len == pos) {
+				asm_write_label(ctx->asm_ctx, ents[next-1].label);
+				next --;
+			}
+		}
+		scnst_write_part(ctx, host->str + piece, host->len - piece, true);
+		start = i + 1;
+	}
+	
+	// Switch back to old section.
+	if (old_id) {
+		asm_use_sect(ctx->asm_ctx, old_id, ASM_NOT_ALIGNED);
+		xfree(ctx->allocator, old_id);
+	}
+	xfree(ctx->allocator, ents);
+}
+
 // Identity expression (things like variables and functions).
 expr_t expr_ident(parser_ctx_t *ctx, strval_t *ident) {
 	return (expr_t) {
@@ -387,20 +466,25 @@ expr_t expr_ident(parser_ctx_t *ctx, strval_t *ident) {
 expr_t expr_math1(parser_ctx_t *ctx, oper_t type, expr_t *val) {
 	if (val->type == EXPR_TYPE_CONST) {
 		// Optimise out numbers.
+		simple_type_t stype = iconst_promote(val->iconst_type);
 		switch (type) {
 			case OP_0_MINUS:
-				val->iconst = -val->iconst;
+				val->iconst      = iconst_trunc(stype, -(unsigned long) val->iconst);
+				val->iconst_type = stype;
 				break;
 			case OP_BIT_NOT:
-				val->iconst = ~val->iconst;
+				val->iconst      = iconst_trunc(stype, ~val->iconst);
+				val->iconst_type = stype;
 				break;
 			case OP_LOGIC_NOT:
-				val->iconst = !val->iconst;
+				val->iconst      = !val->iconst;
+				val->iconst_type = STYPE_S_INT;
 				break;
 			case OP_ADROF:
 				// This isn't acceptable.
 			case OP_DEREF:
 				// This can't be simplified.
+			default:
 				goto the_usual;
 		}
 		return *val;
@@ -430,16 +514,12 @@ expr_t expr_math1a(parser_ctx_t *ctx, oper_t type, expr_t *val) {
 		return *val;
 	}
 	
-	expr_t *one;
 	the_usual:
-	// This is quite simple: val = val operator 1.
-	one = xalloc(ctx->allocator, sizeof(expr_t));
-	*one = (expr_t) {
-		.type = EXPR_TYPE_CONST,
-		.iconst = 1,
+	return (expr_t) {
+		.type     = EXPR_TYPE_MATH1A,
+		.oper     = type,
+		.par_a    = XCOPY(ctx->allocator, val, expr_t)
 	};
-	expr_t param_b = expr_math2(ctx, type, val, one);
-	return expr_math2(ctx, OP_ASSIGN, val, &param_b);
 }
 
 // Function call expression.
@@ -451,73 +531,151 @@ expr_t expr_call(parser_ctx_t *ctx, expr_t *func, exprs_t *args) {
 	};
 }
 
+// The number of bits in an integer type.
+static unsigned iconst_bits(simple_type_t type) {
+	switch (type >> 1) {
+		case STYPE_U_CHAR  >> 1: return CHAR_BITS;
+		case STYPE_U_SHORT >> 1: return SHORT_BITS;
+		case STYPE_U_INT   >> 1: return INT_BITS;
+		case STYPE_U_LONG  >> 1: return LONG_BITS;
+		default:                 return LONGER_BITS;
+	}
+}
+
+// The type an integer type is promoted to in arithmetic.
+simple_type_t iconst_promote(simple_type_t type) {
+	if (type == STYPE_BOOL) return STYPE_S_INT;
+	if (type >= STYPE_S_INT) return type;
+	// Types as wide as int only fit in unsigned int if they are unsigned.
+	return STYPE_IS_SIGNED(type) || iconst_bits(type) < INT_BITS ? STYPE_S_INT : STYPE_U_INT;
+}
+
+// The type of arithmetic on two integer constants of given types.
+// Promotes both, then picks the higher rank, preferring unsigned unless the signed type is wider.
+simple_type_t iconst_common_type(simple_type_t a, simple_type_t b) {
+	a = iconst_promote(a);
+	b = iconst_promote(b);
+	if (a == b) return a;
+	if (a > STYPE_S_LONGER || b > STYPE_S_LONGER || STYPE_IS_SIGNED(a) == STYPE_IS_SIGNED(b)) {
+		return a > b ? a : b;
+	}
+	simple_type_t u = STYPE_IS_SIGNED(a) ? b : a;
+	simple_type_t s = STYPE_IS_SIGNED(a) ? a : b;
+	if (u >> 1 >= s >> 1) return u;
+	if (iconst_bits(s) > iconst_bits(u)) return s;
+	return s & ~1;
+}
+
+// Wrap an integer constant to the width and signedness of a type.
+long iconst_trunc(simple_type_t type, long val) {
+	if (type == STYPE_BOOL) return !!val;
+	if (type > STYPE_S_LONGER) return val;
+	unsigned bits = iconst_bits(type);
+	if (bits >= sizeof(long) * 8) return val;
+	unsigned long mask = (1ul << bits) - 1;
+	unsigned long uval = (unsigned long) val & mask;
+	if (STYPE_IS_SIGNED(type) && uval >> (bits - 1)) uval |= ~mask;
+	return (long) uval;
+}
+
+// Binary math on two integer constants, done in the given type.
+// The type is that of the left hand side for shifts and the common type otherwise.
+// Returns false if the result is undefined, like for division by zero.
+bool iconst_math2(oper_t oper, simple_type_t type, long a, long b, long *out) {
+	if (type > STYPE_S_LONGER) return false;
+	bool     is_signed = STYPE_IS_SIGNED(type);
+	unsigned bits      = iconst_bits(type);
+	a = iconst_trunc(type, a);
+	// The right hand side of a shift keeps its own type.
+	if (!OP_IS_SHIFT(oper)) b = iconst_trunc(type, b);
+	unsigned long ua = a;
+	unsigned long ub = b;
+	long          o;
+	switch (oper) {
+		case OP_ADD:
+			o = ua + ub;
+			break;
+		case OP_SUB:
+			o = ua - ub;
+			break;
+		case OP_MUL:
+			o = ua * ub;
+			break;
+		case OP_DIV:
+		case OP_MOD:
+			// Division by zero and the overflowing division of the lowest value by -1 are undefined.
+			if (!b) return false;
+			if (is_signed && b == -1 && a == iconst_trunc(type, 1ul << (bits - 1))) return false;
+			if (is_signed) {
+				o = oper == OP_DIV ? a / b : a % b;
+			} else {
+				o = oper == OP_DIV ? ua / ub : ua % ub;
+			}
+			break;
+		case OP_BIT_AND:
+			o = a & b;
+			break;
+		case OP_BIT_OR:
+			o = a | b;
+			break;
+		case OP_BIT_XOR:
+			o = a ^ b;
+			break;
+		case OP_SHIFT_L:
+		case OP_SHIFT_R:
+			// Shifting by the width of the type or more is undefined.
+			if (b < 0 || b >= bits) return false;
+			if (oper == OP_SHIFT_L) {
+				o = ua << b;
+			} else {
+				o = is_signed ? a >> b : (long) (ua >> b);
+			}
+			break;
+		case OP_LOGIC_AND:
+			o = a && b;
+			break;
+		case OP_LOGIC_OR:
+			o = a || b;
+			break;
+		case OP_EQ:
+			o = a == b;
+			break;
+		case OP_NE:
+			o = a != b;
+			break;
+		case OP_LE:
+			o = is_signed ? a <= b : ua <= ub;
+			break;
+		case OP_GE:
+			o = is_signed ? a >= b : ua >= ub;
+			break;
+		case OP_LT:
+			o = is_signed ? a < b : ua < ub;
+			break;
+		case OP_GT:
+			o = is_signed ? a > b : ua > ub;
+			break;
+		default:
+			return false;
+	}
+	*out = iconst_trunc(type, o);
+	return true;
+}
+
 // Binary math expression (things like a + b, c = d and e[f]).
 expr_t expr_math2(parser_ctx_t *ctx, oper_t type, expr_t *val1, expr_t *val2) {
 	if (val1->type == EXPR_TYPE_CONST && val2->type == EXPR_TYPE_CONST) {
 		// Optimise out numbers.
-		address_t a = val1->iconst;
-		address_t b = val2->iconst;
-		address_t o;
-		switch (type) {
-			case OP_ADD:
-				o = a + b;
-				break;
-			case OP_SUB:
-				o = a - b;
-				break;
-			case OP_MUL:
-				o = a * b;
-				break;
-			case OP_DIV:
-				o = a / b;
-				break;
-			case OP_MOD:
-				o = a % b;
-				break;
-			case OP_BIT_AND:
-				o = a & b;
-				break;
-			case OP_BIT_OR:
-				o = a | b;
-				break;
-			case OP_BIT_XOR:
-				o = a ^ b;
-				break;
-			case OP_LOGIC_AND:
-				o = a && b;
-				break;
-			case OP_LOGIC_OR:
-				o = a || b;
-				break;
-			case OP_SHIFT_L:
-				o = a << b;
-				break;
-			case OP_SHIFT_R:
-				o = a >> b;
-				break;
-			case OP_EQ:
-				o = a == b;
-				break;
-			case OP_NE:
-				o = a != b;
-				break;
-			case OP_LE:
-				o = a <= b;
-				break;
-			case OP_GE:
-				o = a >= b;
-				break;
-			case OP_LT:
-				o = a < b;
-				break;
-			case OP_GT:
-				o = a > b;
-				break;
+		simple_type_t stype = OP_IS_SHIFT(type) ? iconst_promote(val1->iconst_type)
+							: iconst_common_type(val1->iconst_type, val2->iconst_type);
+		long o;
+		if (iconst_math2(type, stype, val1->iconst, val2->iconst, &o)) {
+			return (expr_t) {
+				.type        = EXPR_TYPE_CONST,
+				.iconst      = o,
+				.iconst_type = OP_IS_COMP(type) || OP_IS_LOGIC(type) ? STYPE_S_INT : stype
+			};
 		}
-		return (expr_t) {
-			.type   = EXPR_TYPE_CONST,
-			.iconst = o
-		};
 	}
 	return (expr_t) {
 		.type     = EXPR_TYPE_MATH2,
@@ -528,9 +686,12 @@ expr_t expr_math2(parser_ctx_t *ctx, oper_t type, expr_t *val1, expr_t *val2) {
 }
 
 // Assignment math expression (things like a += b, c *= d and e |= f).
-// Generalises to a combination of an assignment and expr_math2.
+// The left hand side is evaluated only once.
 expr_t expr_math2a(parser_ctx_t *ctx, oper_t type, expr_t *val1, expr_t *val2) {
-	// This is quite simple: val1 = val1 operator val2.
-	expr_t param_b = expr_math2(ctx, type, val1, val2);
-	return expr_math2(ctx, OP_ASSIGN, val1, &param_b);
+	return (expr_t) {
+		.type     = EXPR_TYPE_MATH2A,
+		.oper     = type,
+		.par_a    = XCOPY(ctx->allocator, val1, expr_t),
+		.par_b    = XCOPY(ctx->allocator, val2, expr_t)
+	};
 }
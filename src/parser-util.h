@@ -55,10 +55,17 @@ struct parser_ctx {
 	
 	// The number of constants written to .rodata so far.
 	size_t           n_const;
+	// String constants used so far, mapped to their labels.
+	// They are written to .rodata together at the end of the translation unit.
+	map_t            scnsts;
 	// Memory allocator to use.
 	alloc_ctx_t      allocator;
 	// Most recently used simple type.
 	simple_type_t    s_type;
+	// Preprocessor to get tokens from.
+	struct preproc    *preproc;
+	// Lexer thread to get tokens from, if any.
+	struct lex_thread *lex_thread;
 };
 
 // Integer constant; mostly used in expressions.
@@ -66,7 +73,9 @@ struct ival {
 	// File position of this object.
 	pos_t pos;
 	// Integer constant, mostly used in expressions.
-	int   ival;
+	long          ival;
+	// Type of the integer constant, as picked by the tokeniser.
+	simple_type_t type;
 };
 
 // String constant; used either in ident_t or strval_t.
@@ -90,14 +99,23 @@ struct ident {
 };
 
 // Expression; used to represent math operations and alike.
+// Kept to 32 bytes, since expressions are copied by value through the grammar actions.
 struct expr {
 	// File position of this object.
 	pos_t       pos;
 	
 	// Type of expression (math1, math2, call, etc.).
-	expr_type_t type;
+	expr_type_t   type             : 8;
 	// Operator for math expressions.
-	oper_t      oper;
+	oper_t        oper             : 8;
+	// Whether this expression uses pointers.
+	bool          uses_pointers    : 1;
+	// Whether this expression has side effects.
+	bool          has_side_effects : 1;
+	// Integer type of this expression as found by gen_fold_function, or STYPE_VOID.
+	simple_type_t int_type         : 5;
+	// The amount of expressions going down, including this one.
+	uint32_t      operation_count;
 	
 	union {
 		// Integer constant EXPR_TYPE_CONST.
@@ -108,23 +126,18 @@ struct expr {
 		strval_t *ident;
 		// Function for EXPR_TYPE_CALL.
 		expr_t   *func;
-		// Parameter for EXPR_TYPE_MATH2 and EXPR_TYPE_MATH1.
+		// Parameter for EXPR_TYPE_MATH2 and EXPR_TYPE_MATH1, assigned to for EXPR_TYPE_MATH2A and EXPR_TYPE_MATH1A.
 		expr_t   *par_a;
 	};
 	
 	union {
-		// Parameter for EXPR_TYPE_MATH2.
-		expr_t  *par_b;
+		// Parameter for EXPR_TYPE_MATH2 and EXPR_TYPE_MATH2A.
+		expr_t       *par_b;
 		// Arguments for EXPR_TYPE_CALL.
-		exprs_t *args;
+		exprs_t      *args;
+		// Type of the integer constant for EXPR_TYPE_CONST.
+		simple_type_t iconst_type;
 	};
-	
-	// Whether this expression uses pointers.
-	bool uses_pointers;
-	// Whether this expression has side effects.
-	bool has_side_effects;
-	// The amount of expressions going down, including this one.
-	size_t operation_count;
 };
 
 // Statement; used to represent actions to perform, often evaluation of expressions.
@@ -230,6 +243,8 @@ struct iasm_regs {
 	
 	// The amount of iasm_reg_t present in arr.
 	size_t          num;
+	// The amount of iasm_reg_t that fit in arr.
+	size_t          cap;
 	// The referenced variables.
 	iasm_reg_t     *arr;
 };
@@ -259,6 +274,8 @@ struct idents {
 	
 	// The amount of ident_t presen in arr.
 	size_t          num;
+	// The amount of ident_t that fit in arr.
+	size_t          cap;
 	// The symbol references stored.
 	ident_t        *arr;
 };
@@ -270,6 +287,8 @@ struct exprs {
 	
 	// The amount of expr_t stored in arr.
 	size_t          num;
+	// The amount of expr_t that fit in arr.
+	size_t          cap;
 	// The expressions stored.
 	expr_t         *arr;
 };
@@ -281,6 +300,8 @@ struct stmts {
 	
 	// The amount of stmt_t stored in arr.
 	size_t          num;
+	// The amount of stmt_t that fit in arr.
+	size_t          cap;
 	// The statements stored.
 	stmt_t         *arr;
 };
@@ -317,7 +338,7 @@ funcdef_t   funcdef_decl   (parser_ctx_t *ctx, ival_t *type, ident_t *ident,  id
 // An empty list of statements.
 stmts_t     stmts_empty    (parser_ctx_t *ctx);
 // Concatenate to a list of statements.
-stmts_t     stmts_cat      (parser_ctx_t *ctx, stmts_t  *stmts, stmt_t  *stmt);
+void        stmts_cat      (parser_ctx_t *ctx, stmts_t  *stmts, stmt_t  *stmt);
 
 // An emppty statement that does nothing.
 stmt_t      stmt_empty     (parser_ctx_t *ctx);
@@ -346,7 +367,7 @@ iasm_reg_t  stmt_iasm_reg  (parser_ctx_t *ctx, strval_t *symbol, strval_t *mode,
 // An empty list of iasm_reg.
 iasm_regs_t iasm_regs_empty(parser_ctx_t *ctx);
 // Concatenate to a list of iasm_reg.
-iasm_regs_t iasm_regs_cat  (parser_ctx_t *ctx, iasm_regs_t *iasm_regs, iasm_reg_t *iasm_reg);
+void        iasm_regs_cat  (parser_ctx_t *ctx, iasm_regs_t *iasm_regs, iasm_reg_t *iasm_reg);
 // A list of one iasm_reg.
 iasm_regs_t iasm_regs_one  (parser_ctx_t *ctx, iasm_reg_t  *iasm_reg);
 
@@ -360,11 +381,11 @@ ident_t     ident_of_types (parser_ctx_t *ctx, ident_t *ptrs, ident_t  *inner, i
 // An empty list of identities.
 idents_t    idents_empty   (parser_ctx_t *ctx);
 // Concatenate to a list of identities.
-idents_t    idents_cat     (parser_ctx_t *ctx, idents_t *idents, int      *type,  strval_t *ident, expr_t *init);
+void        idents_cat     (parser_ctx_t *ctx, idents_t *idents, int      *type,  strval_t *ident, expr_t *init);
 // A list of one identity.
 idents_t    idents_one     (parser_ctx_t *ctx, int      *type,   strval_t *ident, expr_t   *init);
 // Concatenate to a list of identities (using existing ident_t).
-idents_t    idents_cat_ex  (parser_ctx_t *ctx, idents_t *idents, ident_t  *ident, expr_t   *init);
+void        idents_cat_ex  (parser_ctx_t *ctx, idents_t *idents, ident_t  *ident, expr_t   *init);
 // A list of one identity (using existing ident_t).
 idents_t    idents_one_ex  (parser_ctx_t *ctx, ident_t  *ident,  expr_t   *init);
 
@@ -373,7 +394,19 @@ exprs_t     exprs_empty    (parser_ctx_t *ctx);
 // A list of one expression.
 exprs_t     exprs_one      (parser_ctx_t *ctx, expr_t   *expr);
 // Concatenate to a list of expressions.
-exprs_t     exprs_cat      (parser_ctx_t *ctx, exprs_t  *exprs, expr_t *expr);
+void        exprs_cat      (parser_ctx_t *ctx, exprs_t  *exprs, expr_t *expr);
+
+// The type an integer type is promoted to in arithmetic.
+simple_type_t iconst_promote    (simple_type_t type);
+// The type of arithmetic on two integer constants of given types.
+// Promotes both, then picks the higher rank, preferring unsigned unless the signed type is wider.
+simple_type_t iconst_common_type(simple_type_t a, simple_type_t b);
+// Wrap an integer constant to the width and signedness of a type.
+long          iconst_trunc      (simple_type_t type, long val);
+// Binary math on two integer constants, done in the given type.
+// The type is that of the left hand side for shifts and the common type otherwise.
+// Returns false if the result is undefined, like for division by zero.
+bool          iconst_math2      (oper_t oper, simple_type_t type, long a, long b, long *out);
 
 // Enforce that the expression is constant and get it's value.
 uint64_t    expr_get_const (parser_ctx_t *ctx, expr_t   *expr);
@@ -381,18 +414,22 @@ uint64_t    expr_get_const (parser_ctx_t *ctx, expr_t   *expr);
 expr_t      expr_icnst     (parser_ctx_t *ctx, ival_t   *val);
 // String constant expression.
 expr_t      expr_scnst     (parser_ctx_t *ctx, strval_t *val);
+// Write all string constants into .rodata.
+// Strings that are a suffix of another string are stored as part of that string.
+void        scnsts_write   (parser_ctx_t *ctx);
 // Identity expression (things like variables and functions).
 expr_t      expr_ident     (parser_ctx_t *ctx, strval_t *ident);
 // Unary math expression non-additive (things like &a, *b and !c).
 expr_t      expr_math1     (parser_ctx_t *ctx, oper_t    type,   expr_t   *val);
 // Unary math expression additive (things like ++a and --b).
+// The operand is evaluated only once.
 expr_t      expr_math1a    (parser_ctx_t *ctx, oper_t    type,   expr_t   *val);
 // Function call expression.
 expr_t      expr_call      (parser_ctx_t *ctx, expr_t   *func,   exprs_t  *args);
 // Binary math expression (things like a + b, c = d and e[f]).
 expr_t      expr_math2     (parser_ctx_t *ctx, oper_t    type,   expr_t   *val1, expr_t *val2);
 // Assignment math expression (things like a += b, c *= d and e |= f).
-// Generalises to a combination of an assignment and expr_math2.
+// The left hand side is evaluated only once.
 expr_t      expr_math2a    (parser_ctx_t *ctx, oper_t    type,   expr_t   *val1, expr_t *val2);
 
 // Compile a function after parsing.
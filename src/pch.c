@@ -0,0 +1,336 @@
+
+#include "pch.h"
+#include "gen_util.h"
+#include "intern.h"
+#include "array_util.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "ctxalloc_warn.h"
+
+// Index of the first derived type; lower indices are simple types.
+#define PCH_TYPES_BASE (STYPE_VOID + 1)
+
+// State of the snapshot writer.
+typedef struct {
+	alloc_ctx_t   allocator;
+	// Path of the snapshot, used in errors.
+	const char   *path;
+	// Whether something could not be stored.
+	bool          error;
+	pch_type_t   *types;
+	size_t        types_len, types_cap;
+	srcfile_t   **files;
+	size_t        files_len, files_cap;
+	pch_func_t   *funcs;
+	size_t        funcs_len, funcs_cap;
+	pch_arg_t    *args;
+	size_t        args_len, args_cap;
+	char         *strings;
+	size_t        strings_len, strings_cap;
+} pch_writer_t;
+
+
+
+// Add a string to the snapshot and get its offset.
+static uint32_t pch_put_string(pch_writer_t *w, const char *str) {
+	uint32_t off = w->strings_len;
+	do {
+		array_len_cap_concat(w->allocator, char, w->strings, w->strings_cap, w->strings_len, *str);
+	} while (*str++);
+	return off;
+}
+
+// Add a position to the snapshot, adding its file if it isn't there yet.
+static pch_pos_t pch_put_pos(pch_writer_t *w, pos_t pos) {
+	srcfile_t *file = srcloc_file(pos.start);
+	if (!file) return (pch_pos_t) { PCH_NONE, 0, 0 };
+	
+	size_t i;
+	for (i = 0; i < w->files_len && w->files[i] != file; i++);
+	if (i == w->files_len) {
+		array_len_cap_concat(w->allocator, srcfile_t *, w->files, w->files_cap, w->files_len, file);
+	}
+	srcloc_t end = pos.end;
+	if (end < pos.start || end > file->base + file->len) end = file->base + file->len;
+	return (pch_pos_t) {
+		.file  = i,
+		.start = pos.start - file->base,
+		.end   = end - file->base,
+	};
+}
+
+// Add a type to the snapshot and get its index.
+static uint32_t pch_put_type(pch_writer_t *w, var_type_t *type, const char *name) {
+	if (type->category == TYPE_CAT_SIMPLE) return type->simple_type;
+	if (type->category != TYPE_CAT_POINTER && type->category != TYPE_CAT_ARRAY) {
+		printf("%s: Cannot store the types of '%s'.\n", w->path, name);
+		w->error = true;
+		return PCH_NONE;
+	}
+	pch_type_t ent = {
+		.size        = type->size,
+		.underlying  = pch_put_type(w, type->underlying, name),
+		.category    = type->category,
+		.simple_type = type->simple_type,
+		.is_complete = type->is_complete,
+		.padding     = 0,
+	};
+	array_len_cap_concat(w->allocator, pch_type_t, w->types, w->types_cap, w->types_len, ent);
+	return PCH_TYPES_BASE + w->types_len - 1;
+}
+
+// Add a function declaration to the snapshot.
+static void pch_put_func(pch_writer_t *w, funcdef_t *func) {
+	pch_func_t ent = {
+		.pos      = pch_put_pos(w, func->pos),
+		.name_pos = pch_put_pos(w, func->ident.pos),
+		.args_pos = pch_put_pos(w, func->args.pos),
+		.name     = pch_put_string(w, func->ident.strval),
+		.returns  = pch_put_type(w, func->returns, func->ident.strval),
+		.args     = w->args_len,
+		.args_len = func->args.num,
+	};
+	for (size_t i = 0; i < func->args.num; i++) {
+		ident_t  *arg = &func->args.arr[i];
+		pch_arg_t a   = {
+			.pos  = pch_put_pos(w, arg->pos),
+			.name = pch_put_string(w, arg->strval),
+			.type = pch_put_type(w, arg->type, func->ident.strval),
+		};
+		array_len_cap_concat(w->allocator, pch_arg_t, w->args, w->args_cap, w->args_len, a);
+	}
+	array_len_cap_concat(w->allocator, pch_func_t, w->funcs, w->funcs_cap, w->funcs_len, ent);
+}
+
+// Write the declarations in an assembly context to a snapshot file.
+// Functions are stored as prototypes; their code, if any, is not.
+// Returns false, printing an error, on failure.
+bool pch_write(asm_ctx_t *ctx, const char *path) {
+	pch_writer_t w = {
+		.allocator = alloc_create(ALLOC_NO_PARENT),
+		.path      = path,
+		.error     = false,
+	};
+	alloc_set_name(w.allocator, "pch");
+	pch_header_t header = {
+		.magic   = PCH_MAGIC,
+		.version = PCH_VERSION,
+		.arch    = pch_put_string(&w, ARCH_ID),
+	};
+	for (size_t i = 0; i < ctx->functions.numEntries; i++) {
+		pch_put_func(&w, (funcdef_t *) ctx->functions.values[i]);
+	}
+	
+	// Collect the files and their line starts.
+	pch_file_t *files = xalloc(w.allocator, sizeof(pch_file_t) * w.files_len);
+	uint32_t   *lines = NULL;
+	size_t      lines_len = 0, lines_cap = 0;
+	for (size_t i = 0; i < w.files_len; i++) {
+		srcfile_t *file = w.files[i];
+		files[i] = (pch_file_t) {
+			.name      = pch_put_string(&w, file->filename),
+			.len       = file->len,
+			.lines     = lines_len,
+			.lines_len = file->line_starts_len,
+		};
+		for (size_t x = 0; x < file->line_starts_len; x++) {
+			array_len_cap_concat(w.allocator, uint32_t, lines, lines_cap, lines_len, file->line_starts[x]);
+		}
+	}
+	header.types_len   = w.types_len;
+	header.files_len   = w.files_len;
+	header.lines_len   = lines_len;
+	header.funcs_len   = w.funcs_len;
+	header.args_len    = w.args_len;
+	header.strings_len = w.strings_len;
+	
+	if (w.error) {
+		alloc_destroy(w.allocator);
+		return false;
+	}
+	
+	// Write it all out.
+	FILE *fd = fopen(path, "wb");
+	if (!fd) {
+		printf("Cannot open %s: %s\n", path, strerror(errno));
+		alloc_destroy(w.allocator);
+		return false;
+	}
+	fwrite(&header, sizeof(header),      1,             fd);
+	fwrite(w.types, sizeof(pch_type_t),  w.types_len,   fd);
+	fwrite(files,   sizeof(pch_file_t),  w.files_len,   fd);
+	fwrite(lines,   sizeof(uint32_t),    lines_len,     fd);
+	fwrite(w.funcs, sizeof(pch_func_t),  w.funcs_len,   fd);
+	fwrite(w.args,  sizeof(pch_arg_t),   w.args_len,    fd);
+	fwrite(w.strings, 1,                 w.strings_len, fd);
+	bool ok = !ferror(fd);
+	if (fclose(fd) || !ok) {
+		printf("Cannot write %s: %s\n", path, strerror(errno));
+		ok = false;
+	}
+	
+	alloc_destroy(w.allocator);
+	return ok;
+}
+
+
+
+// Get a string from a snapshot, or NULL if the offset is invalid.
+static const char *pch_get_string(const pch_header_t *header, const char *strings, uint32_t off) {
+	return off < header->strings_len ? strings + off : NULL;
+}
+
+// Convert a position from a snapshot.
+static bool pch_get_pos(srcfile_t **files, const pch_header_t *header, pch_pos_t in, pos_t *out) {
+	if (in.file == PCH_NONE) {
+		*out = (pos_t) { 0, 0 };
+		return true;
+	}
+	if (in.file >= header->files_len) return false;
+	srcfile_t *file = files[in.file];
+	if (in.start > in.end || in.end > file->len) return false;
+	*out = (pos_t) {
+		.start = file->base + in.start,
+		.end   = file->base + in.end,
+	};
+	return true;
+}
+
+// Convert a type index from a snapshot; only types before limit may be referred to.
+static var_type_t *pch_get_type(asm_ctx_t *ctx, var_type_t *types, uint32_t index, uint32_t limit) {
+	if (index < PCH_TYPES_BASE) return ctype_simple(ctx, index);
+	if (index - PCH_TYPES_BASE >= limit) return NULL;
+	return &types[index - PCH_TYPES_BASE];
+}
+
+// Report that a file is not a valid snapshot.
+static bool pch_invalid(const char *path) {
+	printf("%s: Not a declaration snapshot.\n", path);
+	return false;
+}
+
+// Load the contents of a mapped snapshot into an assembly context.
+// Returns false, printing an error, if the snapshot is invalid.
+static bool pch_load(asm_ctx_t *ctx, const char *path, const char *data, size_t len) {
+	// Check the header and find the sections.
+	const pch_header_t *header = (const pch_header_t *) data;
+	if (len < sizeof(pch_header_t) || memcmp(header->magic, PCH_MAGIC, sizeof(PCH_MAGIC))
+		|| header->version != PCH_VERSION) {
+		return pch_invalid(path);
+	}
+	const pch_type_t *types   = (const pch_type_t *) (header + 1);
+	const pch_file_t *files   = (const pch_file_t *) (types + header->types_len);
+	const uint32_t   *lines   = (const uint32_t *)   (files + header->files_len);
+	const pch_func_t *funcs   = (const pch_func_t *) (lines + header->lines_len);
+	const pch_arg_t  *args    = (const pch_arg_t *)  (funcs + header->funcs_len);
+	const char       *strings = (const char *)       (args  + header->args_len);
+	uint64_t expected = sizeof(pch_header_t)
+		+ (uint64_t) header->types_len * sizeof(pch_type_t)
+		+ (uint64_t) header->files_len * sizeof(pch_file_t)
+		+ (uint64_t) header->lines_len * sizeof(uint32_t)
+		+ (uint64_t) header->funcs_len * sizeof(pch_func_t)
+		+ (uint64_t) header->args_len  * sizeof(pch_arg_t)
+		+ header->strings_len;
+	if (expected != len || !header->strings_len || strings[header->strings_len - 1]) return pch_invalid(path);
+	const char *arch = pch_get_string(header, strings, header->arch);
+	if (!arch || strcmp(arch, ARCH_ID)) {
+		printf("%s: Declarations are for %s, not " ARCH_ID ".\n", path, arch ? arch : "another architecture");
+		return false;
+	}
+	
+	// Register the source files so positions can be reported.
+	srcfile_t **srcfiles = xalloc(ctx->allocator, sizeof(srcfile_t *) * header->files_len);
+	for (uint32_t i = 0; i < header->files_len; i++) {
+		const char *name = pch_get_string(header, strings, files[i].name);
+		if (!name || files[i].lines > header->lines_len || header->lines_len - files[i].lines < files[i].lines_len) {
+			return pch_invalid(path);
+		}
+		srcfiles[i] = srcfile_create((char *) intern(name), NULL, files[i].len);
+		// The first line start is always there already.
+		for (uint32_t x = 1; x < files[i].lines_len; x++) {
+			srcfile_add_line(srcfiles[i], lines[files[i].lines + x]);
+		}
+	}
+	
+	// Bulk-load the types, underlying types first.
+	var_type_t *ctypes = xalloc(ctx->allocator, sizeof(var_type_t) * header->types_len);
+	for (uint32_t i = 0; i < header->types_len; i++) {
+		var_type_t *underlying = pch_get_type(ctx, ctypes, types[i].underlying, i);
+		if (!underlying || (types[i].category != TYPE_CAT_POINTER && types[i].category != TYPE_CAT_ARRAY)
+			|| types[i].simple_type > STYPE_VOID) {
+			return pch_invalid(path);
+		}
+		ctypes[i] = (var_type_t) {
+			.size        = types[i].size,
+			.simple_type = types[i].simple_type,
+			.is_complete = types[i].is_complete,
+			.category    = types[i].category,
+			.underlying  = underlying,
+		};
+	}
+	
+	// Bulk-load the parameters.
+	ident_t *cargs = xalloc(ctx->allocator, sizeof(ident_t) * header->args_len);
+	for (uint32_t i = 0; i < header->args_len; i++) {
+		const char *name = pch_get_string(header, strings, args[i].name);
+		cargs[i] = (ident_t) {
+			.strval      = name ? (char *) intern(name) : NULL,
+			.type        = pch_get_type(ctx, ctypes, args[i].type, header->types_len),
+			.initialiser = NULL,
+		};
+		if (!name || !cargs[i].type || !pch_get_pos(srcfiles, header, args[i].pos, &cargs[i].pos)) return pch_invalid(path);
+	}
+	
+	// Bulk-load the functions.
+	funcdef_t *cfuncs = xalloc(ctx->allocator, sizeof(funcdef_t) * header->funcs_len);
+	memset(cfuncs, 0, sizeof(funcdef_t) * header->funcs_len);
+	for (uint32_t i = 0; i < header->funcs_len; i++) {
+		const pch_func_t *in   = &funcs[i];
+		funcdef_t        *func = &cfuncs[i];
+		const char       *name = pch_get_string(header, strings, in->name);
+		if (!name || in->args > header->args_len || header->args_len - in->args < in->args_len) return pch_invalid(path);
+		func->ident.strval = (char *) intern(name);
+		func->returns      = pch_get_type(ctx, ctypes, in->returns, header->types_len);
+		func->args.num     = in->args_len;
+		func->args.arr     = in->args_len ? &cargs[in->args] : NULL;
+		func->stmts        = NULL;
+		func->preproc      = NULL;
+		if (!func->returns
+			|| !pch_get_pos(srcfiles, header, in->pos, &func->pos)
+			|| !pch_get_pos(srcfiles, header, in->name_pos, &func->ident.pos)
+			|| !pch_get_pos(srcfiles, header, in->args_pos, &func->args.pos)) {
+			return pch_invalid(path);
+		}
+		map_set(&ctx->functions, func->ident.strval, func);
+	}
+	return true;
+}
+
+// Load the declarations from a snapshot file into an assembly context.
+// Returns false, printing an error, on failure.
+bool pch_read(asm_ctx_t *ctx, const char *path) {
+	FILE *fd = fopen(path, "rb");
+	if (!fd) {
+		printf("Cannot open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	struct stat info;
+	if (fstat(fileno(fd), &info) || !S_ISREG(info.st_mode) || info.st_size < (off_t) sizeof(pch_header_t)) {
+		fclose(fd);
+		return pch_invalid(path);
+	}
+	void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno(fd), 0);
+	fclose(fd);
+	if (data == MAP_FAILED) {
+		printf("Cannot read %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	
+	// Everything that is kept is copied or interned, so the mapping can go right away.
+	bool ok = pch_load(ctx, path, data, info.st_size);
+	munmap(data, info.st_size);
+	return ok;
+}
@@ -0,0 +1,103 @@
+
+#ifndef PCH_H
+#define PCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "asm.h"
+#include "parser-util.h"
+
+// Identifies a declaration snapshot file.
+#define PCH_MAGIC   "lilypch"
+// Version of the snapshot format; files of other versions are rejected.
+#define PCH_VERSION 1
+// Index that refers to nothing, e.g. the file of a position without one.
+#define PCH_NONE    UINT32_MAX
+
+struct pch_header;
+struct pch_pos;
+struct pch_file;
+struct pch_type;
+struct pch_func;
+struct pch_arg;
+
+typedef struct pch_header pch_header_t;
+typedef struct pch_pos pch_pos_t;
+typedef struct pch_file pch_file_t;
+typedef struct pch_type pch_type_t;
+typedef struct pch_func pch_func_t;
+typedef struct pch_arg pch_arg_t;
+
+// A declaration snapshot consists of, in this order and in native byte order:
+//  - The header.
+//  - Derived types; simple types are not stored and have their simple_type_t as index.
+//  - Source files the positions refer to, then their line starts.
+//  - Functions, then their parameters.
+//  - Strings, each NUL-terminated and referred to by offset.
+
+// Start of a declaration snapshot.
+struct pch_header {
+	// PCH_MAGIC, NUL-padded.
+	char          magic[8];
+	uint32_t      version;
+	// Offset of the ARCH_ID the snapshot was made for.
+	uint32_t      arch;
+	// Number of entries of each kind.
+	uint32_t      types_len;
+	uint32_t      files_len;
+	uint32_t      lines_len;
+	uint32_t      funcs_len;
+	uint32_t      args_len;
+	uint32_t      strings_len;
+};
+
+// A position, relative to the start of a source file.
+struct pch_pos {
+	uint32_t      file;
+	uint32_t      start, end;
+};
+
+// A source file that positions refer to; only the filename and the line starts are kept.
+struct pch_file {
+	uint32_t      name;
+	uint32_t      len;
+	uint32_t      lines, lines_len;
+};
+
+// A pointer or array type.
+struct pch_type {
+	uint64_t      size;
+	// Index of the underlying type, which always comes first.
+	uint32_t      underlying;
+	uint8_t       category;
+	uint8_t       simple_type;
+	uint8_t       is_complete;
+	uint8_t       padding;
+};
+
+// A function declaration.
+struct pch_func {
+	pch_pos_t     pos;
+	pch_pos_t     name_pos;
+	pch_pos_t     args_pos;
+	uint32_t      name;
+	uint32_t      returns;
+	uint32_t      args, args_len;
+};
+
+// A function parameter.
+struct pch_arg {
+	pch_pos_t     pos;
+	uint32_t      name;
+	uint32_t      type;
+};
+
+// Write the declarations in an assembly context to a snapshot file.
+// Functions are stored as prototypes; their code, if any, is not.
+// Returns false, printing an error, on failure.
+bool pch_write(asm_ctx_t *ctx, const char *path);
+// Load the declarations from a snapshot file into an assembly context.
+// Returns false, printing an error, on failure.
+bool pch_read (asm_ctx_t *ctx, const char *path);
+
+#endif // PCH_H
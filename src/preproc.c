@@ -0,0 +1,1384 @@
+
+#include "preproc.h"
+#include "intern.h"
+#include "array_util.h"
+#include "main.h"
+#include "scan.h"
+#include <stdarg.h>
+#include "ctxalloc_warn.h"
+
+// A growable list of tokens.
+typedef struct {
+	pp_token_t *arr;
+	size_t      len, cap;
+} pp_tokens_t;
+
+// State of the #if expression evaluator.
+typedef struct {
+	preproc_ctx_t *pp;
+	pp_token_t    *toks;
+	size_t         len, index;
+	// Position of the directive.
+	pos_t          pos;
+	// Whether an error was reported.
+	bool           error;
+	// Whether the operand being evaluated is not used, e.g. the right of a false &&.
+	int            unused;
+} pp_eval_t;
+
+// Included files by every path they were reached through, and by their canonical path.
+// Paths of files that could not be read are also kept.
+// Entries live until the program exits.
+static map_t       include_cache;
+// Allocation context for the include cache.
+static alloc_ctx_t include_alloc;
+
+static int  pp_expand_next(preproc_ctx_t *pp, pp_token_t *out);
+
+
+
+// Format a string on the preprocessor's allocator.
+static char *pp_format(preproc_ctx_t *pp, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	size_t len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	char  *buf = xalloc(pp->allocator, len + 1);
+	va_start(args, fmt);
+	vsnprintf(buf, len + 1, fmt, args);
+	va_end(args);
+	return buf;
+}
+
+// Add a diagnostic to be reported later.
+static void pp_diag(preproc_ctx_t *pp, error_type_t type, pos_t pos, char *msg) {
+	pp_diag_t diag = {
+		.type = type,
+		.pos  = pos,
+		.msg  = msg,
+	};
+	array_len_cap_concat(pp->allocator, pp_diag_t, pp->diags, pp->diags_cap, pp->diags_len, diag);
+}
+
+// Empty position at the tokeniser's current position.
+static pos_t pp_here(tokeniser_ctx_t *tkn) {
+	srcloc_t loc = tkn->file->base + tkn->index;
+	return (pos_t) {
+		.start = loc,
+		.end   = loc,
+	};
+}
+
+// Add a token to a list.
+static void pp_tokens_add(preproc_ctx_t *pp, pp_tokens_t *list, pp_token_t tok) {
+	array_len_cap_concat(pp->allocator, pp_token_t, list->arr, list->cap, list->len, tok);
+}
+
+
+
+// Get the macro table bucket for an interned name.
+static size_t pp_macro_bucket(preproc_ctx_t *pp, const char *name) {
+	uint64_t hash = (uint64_t) (uintptr_t) name * 0x9E3779B97F4A7C15llu;
+	return (size_t) (hash >> 32) & (pp->macros_cap - 1);
+}
+
+// Find a macro by its interned name.
+static pp_macro_t *pp_macro_find(preproc_ctx_t *pp, const char *name) {
+	if (!name) return NULL;
+	pp_macro_t *macro = pp->macros[pp_macro_bucket(pp, name)];
+	while (macro && macro->name != name) macro = macro->next;
+	return macro;
+}
+
+// Double the number of buckets in the macro table.
+static void pp_macro_grow(preproc_ctx_t *pp) {
+	pp_macro_t **old     = pp->macros;
+	size_t       old_cap = pp->macros_cap;
+	pp->macros_cap *= 2;
+	pp->macros      = xalloc(pp->allocator, sizeof(pp_macro_t *) * pp->macros_cap);
+	memset(pp->macros, 0, sizeof(pp_macro_t *) * pp->macros_cap);
+	for (size_t i = 0; i < old_cap; i++) {
+		pp_macro_t *macro = old[i];
+		while (macro) {
+			pp_macro_t *next   = macro->next;
+			size_t      bucket = pp_macro_bucket(pp, macro->name);
+			macro->next        = pp->macros[bucket];
+			pp->macros[bucket] = macro;
+			macro              = next;
+		}
+	}
+	xfree(pp->allocator, old);
+}
+
+// Add a macro to the table, replacing and returning the macro of the same name, if any.
+static pp_macro_t *pp_macro_set(preproc_ctx_t *pp, pp_macro_t *macro) {
+	pp_macro_t **link = &pp->macros[pp_macro_bucket(pp, macro->name)];
+	while (*link && (*link)->name != macro->name) link = &(*link)->next;
+	pp_macro_t *old = *link;
+	if (old) {
+		macro->next = old->next;
+		*link       = macro;
+		return old;
+	}
+	macro->next = NULL;
+	*link       = macro;
+	if (++pp->macros_len > pp->macros_cap) pp_macro_grow(pp);
+	return NULL;
+}
+
+// Remove a macro from the table by its interned name.
+// Returns the macro that was removed, if any.
+static pp_macro_t *pp_macro_remove(preproc_ctx_t *pp, const char *name) {
+	if (!name) return NULL;
+	pp_macro_t **link = &pp->macros[pp_macro_bucket(pp, name)];
+	while (*link && (*link)->name != name) link = &(*link)->next;
+	pp_macro_t *old = *link;
+	if (old) {
+		*link = old->next;
+		pp->macros_len --;
+	}
+	return old;
+}
+
+
+
+// Get the contents of a file through the include cache.
+// Different paths to the same file, like "o.h" and "./o.h", give the same entry.
+// Returns NULL if the file can't be read.
+static pp_cached_t *pp_read_cached(char *path) {
+	if (!include_alloc) {
+		include_alloc = alloc_create(ALLOC_NO_PARENT);
+		alloc_set_name(include_alloc, "include cache");
+		map_create(&include_cache);
+	}
+	pp_cached_t *ent = map_get(&include_cache, path);
+	if (ent) return ent->data ? ent : NULL;
+	
+	// Not reached through this path before; look for the file under its canonical path.
+	char *real = realpath(path, NULL);
+	ent = real ? map_get(&include_cache, real) : NULL;
+	if (ent) {
+		free(real);
+		map_set(&include_cache, path, ent);
+		return ent->data ? ent : NULL;
+	}
+	
+	// Not seen before; read the entire file.
+	ent = xalloc(include_alloc, sizeof(pp_cached_t));
+	*ent = (pp_cached_t) {
+		.path  = (char *) intern(real ? real : path),
+		.data  = NULL,
+		.len   = 0,
+		.guard = NULL,
+		.once  = false,
+	};
+	free(real);
+	FILE *fd = isdir(path) ? NULL : fopen(path, "rb");
+	if (fd) {
+		size_t cap = 4096;
+		char  *buf = xalloc(include_alloc, cap);
+		while (1) {
+			if (ent->len == cap) {
+				cap *= 2;
+				buf  = xrealloc(include_alloc, buf, cap);
+			}
+			size_t n = fread(buf + ent->len, 1, cap - ent->len, fd);
+			if (!n) break;
+			ent->len += n;
+		}
+		fclose(fd);
+		ent->data = buf;
+	}
+	map_set(&include_cache, path, ent);
+	map_set(&include_cache, ent->path, ent);
+	return ent->data ? ent : NULL;
+}
+
+// Get the directory part of a path, without the trailing slash.
+static char *pp_dirname(preproc_ctx_t *pp, const char *path) {
+	const char *slash = strrchr(path, '/');
+	size_t      len   = slash ? slash - path : 0;
+	if (slash == path) len = 1;
+	char *dir = xalloc(pp->allocator, len + 1);
+	memcpy(dir, path, len);
+	dir[len] = 0;
+	return dir;
+}
+
+// Join a directory and a relative path.
+static char *pp_join(preproc_ctx_t *pp, const char *dir, const char *name) {
+	if (!*dir) return xstrdup(pp->allocator, name);
+	return pp_format(pp, "%s/%s", dir, name);
+}
+
+// Get the tokeniser of the file currently being read.
+static tokeniser_ctx_t *pp_tokeniser(preproc_ctx_t *pp) {
+	return pp->files_len ? &pp->files[pp->files_len - 1]->tkn : pp->main;
+}
+
+// Get the number of conditionals that were open when the current file was entered.
+static size_t pp_conds_base(preproc_ctx_t *pp) {
+	return pp->files_len ? pp->files[pp->files_len - 1]->conds_base : 0;
+}
+
+// Start reading an included file, unless it is known to have no effect.
+// Files are skipped if they have #pragma once and were included before, or if their include guard is defined.
+// The path is the one the file was found through, which diagnostics and "" includes in the file use.
+static void pp_push_file(preproc_ctx_t *pp, pp_cached_t *ent, const char *path) {
+	if (ent->once && map_get(&pp->included, ent->path)) return;
+	if (ent->guard && pp_macro_find(pp, ent->guard)) return;
+	map_set(&pp->included, ent->path, ent);
+	
+	pp_file_t *file = xalloc(pp->allocator, sizeof(pp_file_t));
+	tokeniser_init_buf(&file->tkn, ent->data, ent->len);
+	file->tkn.file->filename = (char *) intern(path);
+	file->tkn.directives     = true;
+	file->cached             = ent;
+	file->dir                = pp_dirname(pp, path);
+	file->conds_base         = pp->conds_len;
+	file->started            = false;
+	file->guard              = NULL;
+	file->guard_closed       = false;
+	array_len_cap_concat(pp->allocator, pp_file_t *, pp->files, pp->files_cap, pp->files_len, file);
+}
+
+// Note a token or directive in the current file, which spoils its include guard if it comes after the #endif.
+// Returns whether it is the first in the file.
+static bool pp_guard_track(preproc_ctx_t *pp) {
+	if (!pp->files_len) return false;
+	pp_file_t *file  = pp->files[pp->files_len - 1];
+	bool       first = !file->started;
+	if (file->guard_closed) file->guard = NULL;
+	file->started = true;
+	return first;
+}
+
+
+
+// Lex a token straight from a tokeniser.
+static int pp_lex(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pp_token_t *out) {
+	YYSTYPE       lval;
+	error_type_t  err_type;
+	char         *err_msg;
+	int id = tokenise_into(tkn, &lval, &err_type, &err_msg);
+	if (!id) return 0;
+	if (err_msg) pp_diag(pp, err_type, lval.pos, err_msg);
+	
+	*out = (pp_token_t) {
+		.id        = id,
+		.pos       = lval.pos,
+		.strval    = NULL,
+		.ival      = 0,
+		.type      = 0,
+		.spell     = NULL,
+		.spell_len = 0,
+		.space     = tkn->line_start,
+		.hide      = NULL,
+	};
+	if (id == TKN_IDENT) {
+		out->strval = lval.ident.strval;
+	} else if (id == TKN_STRVAL) {
+		out->strval = lval.strval.strval;
+	} else if (id == TKN_IVAL) {
+		out->ival   = lval.ival.ival;
+		out->type   = lval.ival.type;
+	}
+	if (!tkn->use_fd) {
+		// Memory-resident sources also give the spelling.
+		size_t off     = lval.pos.start - tokeniser_base(tkn);
+		out->spell     = tkn->source + off;
+		out->spell_len = lval.pos.end - lval.pos.start;
+		out->space    |= off && (is_space(tkn->source[off - 1]) || tkn->source[off - 1] == '/');
+	}
+	return id;
+}
+
+// Get the name of an identifier or keyword token, or NULL for other tokens.
+static const char *pp_name(pp_token_t *tok) {
+	if (tok->id == TKN_IDENT) return tok->strval;
+	return tokeniser_keyword(tok->id);
+}
+
+// Get the spelling of a token.
+static const char *pp_spell(preproc_ctx_t *pp, pp_token_t *tok, size_t *len) {
+	const char *spell = tok->spell;
+	if (!spell) {
+		spell = pp_name(tok);
+		if (!spell && tok->id == TKN_IVAL) spell = pp_format(pp, "%ld", tok->ival);
+		if (!spell) spell = "";
+		*len = strlen(spell);
+	} else {
+		*len = tok->spell_len;
+	}
+	return spell;
+}
+
+// Get the interned name of an identifier or keyword token, or NULL if no such name was interned.
+static const char *pp_atom(pp_token_t *tok) {
+	if (tok->id == TKN_IDENT) return tok->strval;
+	const char *keyword = tokeniser_keyword(tok->id);
+	return keyword ? intern_find(keyword) : NULL;
+}
+
+// Find the macro a token names, if any.
+static pp_macro_t *pp_lookup(preproc_ctx_t *pp, pp_token_t *tok) {
+	if (!pp->macros_len) return NULL;
+	if (tok->id == TKN_IDENT) return pp_macro_find(pp, tok->strval);
+	if (!pp->keyword_macros) return NULL;
+	return pp_macro_find(pp, pp_atom(tok));
+}
+
+// Whether a hide-set contains a macro name.
+static bool pp_hideset_has(pp_hideset_t *set, const char *name) {
+	for (; set; set = set->next) {
+		if (set->name == name) return true;
+	}
+	return false;
+}
+
+// Get the union of a hide-set and a single name.
+static pp_hideset_t *pp_hideset_add(preproc_ctx_t *pp, pp_hideset_t *set, const char *name) {
+	if (pp_hideset_has(set, name)) return set;
+	pp_hideset_t *node = xalloc(pp->allocator, sizeof(pp_hideset_t));
+	node->name = name;
+	node->next = set;
+	return node;
+}
+
+// Get the union of two hide-sets.
+static pp_hideset_t *pp_hideset_union(preproc_ctx_t *pp, pp_hideset_t *a, pp_hideset_t *b) {
+	if (!a || a == b) return b;
+	if (!b) return a;
+	for (; a; a = a->next) {
+		b = pp_hideset_add(pp, b, a->name);
+	}
+	return b;
+}
+
+// Get the intersection of two hide-sets.
+static pp_hideset_t *pp_hideset_intersect(preproc_ctx_t *pp, pp_hideset_t *a, pp_hideset_t *b) {
+	if (a == b) return a;
+	pp_hideset_t *res = NULL;
+	for (; a; a = a->next) {
+		if (pp_hideset_has(b, a->name)) res = pp_hideset_add(pp, res, a->name);
+	}
+	return res;
+}
+
+
+
+// Find the end of the logical line at the tokeniser's position, skipping comments and quoted text.
+static size_t pp_line_end(tokeniser_ctx_t *tkn) {
+	const char *src = tkn->source;
+	size_t      len = tkn->source_len;
+	size_t      i   = tkn->index;
+	while (i < len) {
+		char c    = src[i];
+		char next = i + 1 < len ? src[i + 1] : 0;
+		if (c == '\r' || c == '\n') {
+			return i;
+		} else if (c == '\\' && (next == '\r' || next == '\n')) {
+			// A backslash joins lines.
+			i += 2;
+			if (next == '\r' && i < len && src[i] == '\n') i ++;
+		} else if (c == '/' && next == '*') {
+			// Block comments may span lines.
+			i += 2;
+			size_t end = scan_block_end(src + i, len - i);
+			i += end < len - i ? end + 2 : end;
+		} else if (c == '/' && next == '/') {
+			// Line comment.
+			return i + scan_eol(src + i, len - i);
+		} else if (c == '"' || c == '\'') {
+			// Quoted text.
+			for (i ++; i < len && src[i] != c && src[i] != '\r' && src[i] != '\n'; i++) {
+				if (src[i] == '\\' && i + 1 < len) i ++;
+			}
+			if (i < len && src[i] == c) i ++;
+		} else {
+			i ++;
+		}
+	}
+	return len;
+}
+
+// Limit the tokeniser to the rest of the current logical line.
+// Returns the length to restore with pp_line_finish.
+static size_t pp_line_begin(tokeniser_ctx_t *tkn) {
+	size_t saved    = tkn->source_len;
+	tkn->source_len = pp_line_end(tkn);
+	return saved;
+}
+
+// Skip the rest of the line limited by pp_line_begin and lift the limit.
+static void pp_line_finish(tokeniser_ctx_t *tkn, size_t saved) {
+	tokeniser_advance(tkn, tkn->source_len - tkn->index);
+	tkn->source_len = saved;
+}
+
+// Skip spaces and tabs, as well as backslashes that join lines.
+static void pp_skip_blank(tokeniser_ctx_t *tkn) {
+	const char *src = tkn->source;
+	size_t      i   = tkn->index;
+	while (i < tkn->source_len) {
+		if (src[i] == ' ' || src[i] == '\t' || src[i] == '\f' || src[i] == '\v') {
+			i ++;
+		} else if (src[i] == '\\' && i + 1 < tkn->source_len && (src[i + 1] == '\r' || src[i + 1] == '\n')) {
+			i += 2;
+		} else {
+			break;
+		}
+	}
+	tokeniser_advance(tkn, i - tkn->index);
+}
+
+
+
+// Push a list of tokens to be read back.
+static void pp_push(preproc_ctx_t *pp, pp_token_t *tokens, size_t len, bool barrier) {
+	pp_expansion_t exp = {
+		.tokens  = tokens,
+		.len     = len,
+		.index   = 0,
+		.barrier = barrier,
+	};
+	array_len_cap_concat(pp->allocator, pp_expansion_t, pp->exps, pp->exps_cap, pp->exps_len, exp);
+}
+
+// Get the next token, from a macro expansion or from the source files, handling directives.
+// Returns 0 at the end of the input, or at the end of a barrier.
+static int pp_get(preproc_ctx_t *pp, pp_token_t *out);
+
+// Macro-expand a list of tokens on its own, as is done for arguments and #if expressions.
+static pp_tokens_t pp_expand_list(preproc_ctx_t *pp, pp_token_t *tokens, size_t len) {
+	pp_tokens_t res = { NULL, 0, 0 };
+	pp_push(pp, tokens, len, true);
+	pp_token_t tok;
+	while (pp_expand_next(pp, &tok)) {
+		pp_tokens_add(pp, &res, tok);
+	}
+	// Everything above the barrier has been read.
+	pp->exps_len --;
+	return res;
+}
+
+// Turn a macro argument into a string constant.
+static pp_token_t pp_stringize(preproc_ctx_t *pp, pp_tokens_t *arg, pos_t pos) {
+	// Measure the spelling.
+	size_t len = 0, quoted_len = 2;
+	for (size_t i = 0; i < arg->len; i++) {
+		size_t      tlen;
+		const char *spell = pp_spell(pp, &arg->arr[i], &tlen);
+		bool        quote = arg->arr[i].id == TKN_STRVAL || (tlen && *spell == '\'');
+		if (i && arg->arr[i].space) {
+			len ++;
+			quoted_len ++;
+		}
+		len += tlen;
+		quoted_len += tlen;
+		for (size_t x = 0; quote && x < tlen; x++) {
+			if (spell[x] == '"' || spell[x] == '\\') quoted_len ++;
+		}
+	}
+	
+	// The value is the spelling, the string constant escapes it.
+	char *value  = xalloc(pp->allocator, len + 1);
+	char *quoted = xalloc(pp->allocator, quoted_len + 1);
+	char *v = value, *q = quoted;
+	*q++ = '"';
+	for (size_t i = 0; i < arg->len; i++) {
+		size_t      tlen;
+		const char *spell = pp_spell(pp, &arg->arr[i], &tlen);
+		bool        quote = arg->arr[i].id == TKN_STRVAL || (tlen && *spell == '\'');
+		if (i && arg->arr[i].space) {
+			*v++ = ' ';
+			*q++ = ' ';
+		}
+		for (size_t x = 0; x < tlen; x++) {
+			*v++ = spell[x];
+			if (quote && (spell[x] == '"' || spell[x] == '\\')) *q++ = '\\';
+			*q++ = spell[x];
+		}
+	}
+	*q++ = '"';
+	*v = 0;
+	*q = 0;
+	
+	return (pp_token_t) {
+		.id        = TKN_STRVAL,
+		.pos       = pos,
+		.strval    = value,
+		.spell     = quoted,
+		.spell_len = quoted_len,
+	};
+}
+
+// Paste two tokens into one.
+// Returns false, reporting an error, if the result is not a single token.
+static bool pp_paste(preproc_ctx_t *pp, pp_token_t *lhs, pp_token_t *rhs, pos_t pos) {
+	size_t      len0, len1;
+	const char *spell0 = pp_spell(pp, lhs, &len0);
+	const char *spell1 = pp_spell(pp, rhs, &len1);
+	char       *buf    = xalloc(pp->allocator, len0 + len1 + 1);
+	memcpy(buf, spell0, len0);
+	memcpy(buf + len0, spell1, len1);
+	buf[len0 + len1] = 0;
+	
+	// Lex the result; errors from the tokeniser are replaced by our own.
+	// The pasted text isn't a source file, so it takes no room in the location space.
+	tokeniser_ctx_t tkn;
+	tokeniser_init_scratch(&tkn, buf, len0 + len1, pp->allocator);
+	// Pasting may form '#' or '##', which are otherwise lexed as the start of a comment.
+	tkn.directives = true;
+	size_t     diags_len = pp->diags_len;
+	pp_token_t res;
+	int  id = pp_lex(pp, &tkn, &res);
+	bool ok = id && id != TKN_GARBAGE && tkn.index == tkn.source_len && pp->diags_len == diags_len;
+	pp->diags_len = diags_len;
+	tokeniser_destroy(&tkn);
+	
+	if (!ok) {
+		pp_diag(pp, E_ERROR, pos, pp_format(pp, "Pasting \"%.*s\" and \"%.*s\" does not give a valid token.", (int) len0, spell0, (int) len1, spell1));
+		return false;
+	}
+	res.pos      = pos;
+	res.space    = lhs->space;
+	res.hide     = pp_hideset_intersect(pp, lhs->hide, rhs->hide);
+	*lhs         = res;
+	return true;
+}
+
+// Find the index of the macro parameter a token names, or -1 if it doesn't name one.
+static ptrdiff_t pp_param(pp_macro_t *macro, pp_token_t *tok) {
+	if (!macro->is_func || tok->id != TKN_IDENT) return -1;
+	for (size_t i = 0; i < macro->params_len; i++) {
+		if (macro->params[i] == tok->strval) return i;
+	}
+	return -1;
+}
+
+// Collect the arguments of a function-like macro invocation, the opening parenthesis already read.
+// Returns false, reporting an error, if they don't match the macro's parameters.
+// The closing parenthesis is stored in rpar.
+static bool pp_collect_args(preproc_ctx_t *pp, pp_macro_t *macro, pp_token_t *name, pp_tokens_t **args_out, pp_token_t *rpar) {
+	pp_tokens_t *args     = NULL;
+	size_t       args_len = 0, args_cap = 0;
+	pp_tokens_t  arg      = { NULL, 0, 0 };
+	int          depth    = 0;
+	
+	while (1) {
+		pp_token_t tok;
+		if (!pp_get(pp, &tok)) {
+			pp_diag(pp, E_ERROR, name->pos, pp_format(pp, "Unterminated argument list invoking macro '%s'.", macro->name));
+			return false;
+		}
+		if (tok.id == TKN_LPAR) {
+			depth ++;
+		} else if (tok.id == TKN_RPAR) {
+			if (!depth) {
+				*rpar = tok;
+				break;
+			}
+			depth --;
+		} else if (tok.id == TKN_COMMA && !depth && !(macro->variadic && args_len + 1 >= macro->params_len)) {
+			// Next argument.
+			array_len_cap_concat(pp->allocator, pp_tokens_t, args, args_cap, args_len, arg);
+			arg = (pp_tokens_t) { NULL, 0, 0 };
+			continue;
+		}
+		pp_tokens_add(pp, &arg, tok);
+	}
+	array_len_cap_concat(pp->allocator, pp_tokens_t, args, args_cap, args_len, arg);
+	
+	// Check the number of arguments.
+	if (macro->params_len == 0 && args_len == 1 && !args[0].len) {
+		args_len = 0;
+	} else if (macro->variadic && args_len == macro->params_len - 1) {
+		// No variadic arguments.
+		arg = (pp_tokens_t) { NULL, 0, 0 };
+		array_len_cap_concat(pp->allocator, pp_tokens_t, args, args_cap, args_len, arg);
+	}
+	if (args_len != macro->params_len) {
+		pp_diag(pp, E_ERROR, name->pos, pp_format(pp, "Macro '%s' takes %zu arguments, but %zu were given.", macro->name, macro->params_len, args_len));
+		return false;
+	}
+	*args_out = args;
+	return true;
+}
+
+// Expand a macro invocation, the name already read.
+// Returns false if the name should be kept as-is, i.e. when a function-like macro is not followed by '('.
+static bool pp_invoke(preproc_ctx_t *pp, pp_macro_t *macro, pp_token_t *name) {
+	pp_tokens_t  *args = NULL;
+	pp_hideset_t *hide = name->hide;
+	if (macro->is_func) {
+		pp_token_t next;
+		if (!pp_get(pp, &next)) return false;
+		if (next.id != TKN_LPAR) {
+			// Not an invocation; put the token back.
+			pp_token_t *copy = xalloc(pp->allocator, sizeof(pp_token_t));
+			*copy = next;
+			pp_push(pp, copy, 1, false);
+			return false;
+		}
+		pp_token_t rpar;
+		if (!pp_collect_args(pp, macro, name, &args, &rpar)) return true;
+		// Only macros hidden at both the name and the ')' stay hidden.
+		hide = pp_hideset_intersect(pp, name->hide, rpar.hide);
+	}
+	hide = pp_hideset_add(pp, hide, macro->name);
+	
+	// Substitute the arguments.
+	pp_tokens_t out         = { NULL, 0, 0 };
+	bool        placemarker = false;
+	for (size_t i = 0; i < macro->body_len; i++) {
+		pp_token_t *tok   = &macro->body[i];
+		ptrdiff_t   param = i + 1 < macro->body_len ? pp_param(macro, &macro->body[i + 1]) : -1;
+		
+		if (macro->is_func && tok->id == TKN_HASH && param >= 0) {
+			// Stringize an argument.
+			pp_tokens_add(pp, &out, pp_stringize(pp, &args[param], name->pos));
+			placemarker = false;
+			i ++;
+		
+		} else if (tok->id == TKN_HASHHASH && i + 1 < macro->body_len) {
+			// Paste with the next token or argument, which isn't expanded first.
+			pp_token_t *rhs     = &macro->body[i + 1];
+			size_t      rhs_len = 1;
+			if (param >= 0) {
+				rhs     = args[param].arr;
+				rhs_len = args[param].len;
+			}
+			i ++;
+			if (!rhs_len) continue;
+			size_t first = 0;
+			if (!placemarker && out.len && pp_paste(pp, &out.arr[out.len - 1], &rhs[0], name->pos)) {
+				first = 1;
+			}
+			for (size_t x = first; x < rhs_len; x++) {
+				pp_tokens_add(pp, &out, rhs[x]);
+			}
+			placemarker = false;
+		
+		} else if ((param = pp_param(macro, tok)) >= 0) {
+			// Substitute an argument; it is only expanded if it is not being pasted.
+			pp_tokens_t arg = args[param];
+			if (i + 1 >= macro->body_len || macro->body[i + 1].id != TKN_HASHHASH) {
+				arg = pp_expand_list(pp, arg.arr, arg.len);
+			}
+			for (size_t x = 0; x < arg.len; x++) {
+				pp_token_t sub = arg.arr[x];
+				if (x == 0) sub.space = tok->space;
+				pp_tokens_add(pp, &out, sub);
+			}
+			placemarker = !arg.len;
+		
+		} else {
+			pp_tokens_add(pp, &out, *tok);
+			placemarker = false;
+		}
+	}
+	
+	// The expansion takes the position of the invocation and hides the macro from itself.
+	for (size_t i = 0; i < out.len; i++) {
+		out.arr[i].pos  = name->pos;
+		out.arr[i].hide = pp_hideset_union(pp, out.arr[i].hide, hide);
+	}
+	if (out.len) out.arr[0].space = name->space;
+	pp_push(pp, out.arr, out.len, false);
+	return true;
+}
+
+// Replace __LINE__ and __FILE__ by their values.
+// Returns false if the token is not one of them.
+static bool pp_builtin(preproc_ctx_t *pp, pp_token_t *tok) {
+	if (tok->strval[0] != '_' || tok->strval[1] != '_') return false;
+	if (!strcmp(tok->strval, "__LINE__")) {
+		int line = 0, col;
+		srcloc_decode(tok->pos.start, &line, &col);
+		tok->id     = TKN_IVAL;
+		tok->ival   = line;
+		tok->type   = STYPE_S_INT;
+		tok->strval = NULL;
+		tok->spell  = pp_format(pp, "%d", line);
+	} else if (!strcmp(tok->strval, "__FILE__")) {
+		srcfile_t *file = srcloc_file(tok->pos.start);
+		tok->id     = TKN_STRVAL;
+		tok->strval = file ? file->filename : "";
+		tok->spell  = pp_format(pp, "\"%s\"", tok->strval);
+	} else {
+		return false;
+	}
+	tok->spell_len = strlen(tok->spell);
+	return true;
+}
+
+// Get the next fully macro-expanded token.
+// Returns 0 at the end of the input, or at the end of a barrier.
+static int pp_expand_next(preproc_ctx_t *pp, pp_token_t *out) {
+	while (pp_get(pp, out)) {
+		if (out->id == TKN_IDENT && pp_builtin(pp, out)) return out->id;
+		pp_macro_t *macro = pp_lookup(pp, out);
+		// Macros are not expanded again within their own expansion.
+		if (!macro || pp_hideset_has(out->hide, macro->name)) return out->id;
+		if (!pp_invoke(pp, macro, out)) return out->id;
+	}
+	return 0;
+}
+
+
+
+// Evaluate a binary expression in #if, with operators of at least a given precedence.
+static long long pp_eval_binary(pp_eval_t *ev, int min_prec);
+
+// Report an error in an #if expression, unless one was already reported.
+static void pp_eval_error(pp_eval_t *ev, pos_t pos, char *msg) {
+	if (!ev->error) pp_diag(ev->pp, E_ERROR, pos, msg);
+	ev->error = true;
+}
+
+// Get the precedence of a binary operator in #if, or 0 if the token is not a binary operator.
+static int pp_eval_prec(int id) {
+	switch (id) {
+		case TKN_LOGIC_OR:  return 1;
+		case TKN_LOGIC_AND: return 2;
+		case TKN_OR:        return 3;
+		case TKN_XOR:       return 4;
+		case TKN_AMP:       return 5;
+		case TKN_EQ:
+		case TKN_NE:        return 6;
+		case TKN_LT:
+		case TKN_LE:
+		case TKN_GT:
+		case TKN_GE:        return 7;
+		case TKN_SHL:
+		case TKN_SHR:       return 8;
+		case TKN_ADD:
+		case TKN_SUB:       return 9;
+		case TKN_MUL:
+		case TKN_DIV:
+		case TKN_REM:       return 10;
+		default:            return 0;
+	}
+}
+
+// Evaluate a unary expression in #if.
+static long long pp_eval_unary(pp_eval_t *ev) {
+	if (ev->index >= ev->len) {
+		pp_eval_error(ev, ev->pos, "Expected an expression in #if.");
+		return 0;
+	}
+	pp_token_t *tok = &ev->toks[ev->index++];
+	switch (tok->id) {
+		case TKN_IVAL: return tok->ival;
+		case TKN_ADD:  return  pp_eval_unary(ev);
+		case TKN_SUB:  return -pp_eval_unary(ev);
+		case TKN_NOT:  return !pp_eval_unary(ev);
+		case TKN_INV:  return ~pp_eval_unary(ev);
+		case TKN_LPAR: {
+			long long value = pp_eval_binary(ev, 1);
+			if (ev->index >= ev->len || ev->toks[ev->index].id != TKN_RPAR) {
+				pp_eval_error(ev, tok->pos, "Missing ')' in #if.");
+			} else {
+				ev->index ++;
+			}
+			return value;
+		}
+		default:
+			// Identifiers that are not macros are 0.
+			if (pp_name(tok)) return 0;
+			pp_eval_error(ev, tok->pos, "Invalid token in #if.");
+			return 0;
+	}
+}
+
+// Evaluate a binary expression in #if, with operators of at least a given precedence.
+static long long pp_eval_binary(pp_eval_t *ev, int min_prec) {
+	long long lhs = pp_eval_unary(ev);
+	while (ev->index < ev->len) {
+		pp_token_t *op   = &ev->toks[ev->index];
+		int         prec = pp_eval_prec(op->id);
+		if (!prec || prec < min_prec) break;
+		ev->index ++;
+		
+		// The right of && and || is not used if the left decides the result.
+		bool      unused = (op->id == TKN_LOGIC_AND && !lhs) || (op->id == TKN_LOGIC_OR && lhs);
+		ev->unused += unused;
+		long long rhs = pp_eval_binary(ev, prec + 1);
+		ev->unused -= unused;
+		
+		switch (op->id) {
+			case TKN_LOGIC_OR:  lhs = lhs || rhs; break;
+			case TKN_LOGIC_AND: lhs = lhs && rhs; break;
+			case TKN_OR:        lhs = lhs |  rhs; break;
+			case TKN_XOR:       lhs = lhs ^  rhs; break;
+			case TKN_AMP:       lhs = lhs &  rhs; break;
+			case TKN_EQ:        lhs = lhs == rhs; break;
+			case TKN_NE:        lhs = lhs != rhs; break;
+			case TKN_LT:        lhs = lhs <  rhs; break;
+			case TKN_LE:        lhs = lhs <= rhs; break;
+			case TKN_GT:        lhs = lhs >  rhs; break;
+			case TKN_GE:        lhs = lhs >= rhs; break;
+			case TKN_SHL:       lhs = rhs < 0 || rhs >= 64 ? 0 : (long long) ((unsigned long long) lhs << rhs); break;
+			case TKN_SHR:       lhs = rhs < 0 || rhs >= 64 ? 0 : lhs >> rhs; break;
+			case TKN_ADD:       lhs = (long long) ((unsigned long long) lhs + rhs); break;
+			case TKN_SUB:       lhs = (long long) ((unsigned long long) lhs - rhs); break;
+			case TKN_MUL:       lhs = (long long) ((unsigned long long) lhs * rhs); break;
+			case TKN_DIV:
+			case TKN_REM:
+				if (!rhs) {
+					if (!ev->unused) pp_eval_error(ev, op->pos, "Division by zero in #if.");
+					lhs = 0;
+				} else if (rhs == -1) {
+					lhs = op->id == TKN_DIV ? (long long) (0 - (unsigned long long) lhs) : 0;
+				} else {
+					lhs = op->id == TKN_DIV ? lhs / rhs : lhs % rhs;
+				}
+				break;
+		}
+	}
+	return lhs;
+}
+
+// Evaluate the rest of the line as the expression of #if or #elif.
+static bool pp_eval_line(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t pos) {
+	// Collect the tokens, resolving defined before macros are expanded.
+	pp_tokens_t line = { NULL, 0, 0 };
+	pp_token_t  tok;
+	while (pp_lex(pp, tkn, &tok)) {
+		if (tok.id == TKN_IDENT && !strcmp(tok.strval, "defined")) {
+			pp_token_t name;
+			bool       paren = false;
+			bool       ok    = pp_lex(pp, tkn, &name);
+			if (ok && name.id == TKN_LPAR) {
+				paren = true;
+				ok    = pp_lex(pp, tkn, &name);
+			}
+			ok = ok && pp_name(&name);
+			pp_token_t rpar;
+			if (ok && paren && (!pp_lex(pp, tkn, &rpar) || rpar.id != TKN_RPAR)) ok = false;
+			if (!ok) {
+				pp_diag(pp, E_ERROR, tok.pos, "Expected a macro name after 'defined'.");
+				return false;
+			}
+			tok.id   = TKN_IVAL;
+			tok.ival = pp_macro_find(pp, pp_atom(&name)) != NULL;
+			tok.type = STYPE_S_INT;
+		}
+		pp_tokens_add(pp, &line, tok);
+	}
+	if (!line.len) {
+		pp_diag(pp, E_ERROR, pos, "Expected an expression in #if.");
+		return false;
+	}
+	
+	// Expand macros and evaluate.
+	pp_tokens_t expanded = pp_expand_list(pp, line.arr, line.len);
+	pp_eval_t   ev = {
+		.pp     = pp,
+		.toks   = expanded.arr,
+		.len    = expanded.len,
+		.index  = 0,
+		.pos    = pos,
+		.error  = false,
+		.unused = 0,
+	};
+	long long value = pp_eval_binary(&ev, 1);
+	if (ev.index < ev.len) {
+		pp_eval_error(&ev, ev.toks[ev.index].pos, "Missing binary operator in #if.");
+	}
+	return !ev.error && value;
+}
+
+
+
+// Parse the parameter list of a function-like macro, the opening parenthesis already read.
+static bool pp_define_params(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pp_macro_t *macro) {
+	const char *src = tkn->source;
+	while (1) {
+		pp_skip_blank(tkn);
+		size_t i = tkn->index;
+		if (i < tkn->source_len && src[i] == ')' && !macro->params_len) {
+			tokeniser_advance(tkn, 1);
+			return true;
+		}
+		
+		const char *param;
+		if (i + 2 < tkn->source_len && src[i] == '.' && src[i + 1] == '.' && src[i + 2] == '.') {
+			// Variadic arguments.
+			param = intern("__VA_ARGS__");
+			macro->variadic = true;
+			tokeniser_advance(tkn, 3);
+		} else {
+			size_t len = 0;
+			while (i + len < tkn->source_len && is_alphanumeric(src[i + len])) len ++;
+			if (!len || is_numeric(src[i])) {
+				pp_diag(pp, E_ERROR, pp_here(tkn), "Expected a parameter name.");
+				return false;
+			}
+			param = intern_n(src + i, len);
+			tokeniser_advance(tkn, len);
+		}
+		array_len_concat(pp->allocator, const char *, macro->params, macro->params_len, param);
+		
+		pp_skip_blank(tkn);
+		i = tkn->index;
+		if (i < tkn->source_len && src[i] == ')') {
+			tokeniser_advance(tkn, 1);
+			return true;
+		} else if (i < tkn->source_len && src[i] == ',' && !macro->variadic) {
+			tokeniser_advance(tkn, 1);
+		} else {
+			pp_diag(pp, E_ERROR, pp_here(tkn), "Expected ',' or ')' in macro parameters.");
+			return false;
+		}
+	}
+}
+
+// Whether two definitions of a macro are the same.
+static bool pp_macro_same(preproc_ctx_t *pp, pp_macro_t *a, pp_macro_t *b) {
+	if (a->is_func != b->is_func || a->variadic != b->variadic) return false;
+	if (a->params_len != b->params_len || a->body_len != b->body_len) return false;
+	for (size_t i = 0; i < a->params_len; i++) {
+		if (a->params[i] != b->params[i]) return false;
+	}
+	for (size_t i = 0; i < a->body_len; i++) {
+		size_t      len0, len1;
+		const char *spell0 = pp_spell(pp, &a->body[i], &len0);
+		const char *spell1 = pp_spell(pp, &b->body[i], &len1);
+		if (len0 != len1 || memcmp(spell0, spell1, len0)) return false;
+		if (i && a->body[i].space != b->body[i].space) return false;
+	}
+	return true;
+}
+
+// Handle #define.
+static void pp_define(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t pos) {
+	pp_token_t name;
+	if (!pp_lex(pp, tkn, &name) || !pp_name(&name)) {
+		pp_diag(pp, E_ERROR, pos, "Expected a macro name.");
+		return;
+	}
+	if (!strcmp(pp_name(&name), "defined")) {
+		pp_diag(pp, E_ERROR, name.pos, "'defined' cannot be used as a macro name.");
+		return;
+	}
+	pp_macro_t *macro = xalloc(pp->allocator, sizeof(pp_macro_t));
+	*macro = (pp_macro_t) {
+		.name       = intern(pp_name(&name)),
+		.pos        = name.pos,
+		.is_func    = false,
+		.variadic   = false,
+		.params     = NULL,
+		.params_len = 0,
+		.body       = NULL,
+		.body_len   = 0,
+		.next       = NULL,
+	};
+	
+	// A parenthesis right after the name makes a function-like macro.
+	if (tkn->index < tkn->source_len && tkn->source[tkn->index] == '(') {
+		macro->is_func = true;
+		tokeniser_advance(tkn, 1);
+		if (!pp_define_params(pp, tkn, macro)) return;
+	}
+	
+	// The rest of the line is the replacement list.
+	pp_tokens_t body = { NULL, 0, 0 };
+	pp_token_t  tok;
+	while (pp_lex(pp, tkn, &tok)) {
+		pp_tokens_add(pp, &body, tok);
+	}
+	macro->body     = body.arr;
+	macro->body_len = body.len;
+	if (body.len && (body.arr[0].id == TKN_HASHHASH || body.arr[body.len - 1].id == TKN_HASHHASH)) {
+		pp_diag(pp, E_ERROR, name.pos, "'##' cannot be at either end of a macro.");
+		return;
+	}
+	for (size_t i = 0; macro->is_func && i < body.len; i++) {
+		if (body.arr[i].id == TKN_HASH && (i + 1 >= body.len || pp_param(macro, &body.arr[i + 1]) < 0)) {
+			pp_diag(pp, E_ERROR, body.arr[i].pos, "'#' is not followed by a macro parameter.");
+			return;
+		}
+	}
+	
+	// Replace the old definition, if any.
+	pp_macro_t *old = pp_macro_set(pp, macro);
+	if (old && !pp_macro_same(pp, old, macro)) {
+		pp_diag(pp, E_WARN, name.pos, pp_format(pp, "'%s' redefined.", macro->name));
+		pp_diag(pp, E_NOTE, old->pos, "Previous definition is here.");
+	}
+	if (!old && name.id != TKN_IDENT) pp->keyword_macros ++;
+}
+
+// Handle #undef.
+static void pp_undef(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t pos) {
+	pp_token_t name;
+	if (!pp_lex(pp, tkn, &name) || !pp_name(&name)) {
+		pp_diag(pp, E_ERROR, pos, "Expected a macro name.");
+		return;
+	}
+	if (pp_macro_remove(pp, pp_atom(&name)) && name.id != TKN_IDENT) {
+		pp->keyword_macros --;
+	}
+}
+
+// Handle #include.
+// Returns the file to include, if found, and stores the path it was found through in path.
+static pp_cached_t *pp_include(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t pos, char **path) {
+	pp_skip_blank(tkn);
+	const char *src = tkn->source;
+	size_t      i   = tkn->index;
+	char       *name;
+	bool        angled;
+	
+	if (i < tkn->source_len && (src[i] == '"' || src[i] == '<')) {
+		// The filename is taken literally.
+		char   term = src[i] == '<' ? '>' : '"';
+		size_t end  = i + 1;
+		while (end < tkn->source_len && src[end] != term) end ++;
+		if (end >= tkn->source_len) {
+			pp_diag(pp, E_ERROR, pos, pp_format(pp, "Missing terminating %c in #include.", term));
+			return NULL;
+		}
+		name   = xalloc(pp->allocator, end - i);
+		memcpy(name, src + i + 1, end - i - 1);
+		name[end - i - 1] = 0;
+		angled = term == '>';
+		pos    = (pos_t) {
+			.start = tkn->file->base + i,
+			.end   = tkn->file->base + end + 1,
+		};
+		tokeniser_advance(tkn, end + 1 - i);
+	
+	} else {
+		// The filename comes from a macro.
+		pp_tokens_t line = { NULL, 0, 0 };
+		pp_token_t  tok;
+		while (pp_lex(pp, tkn, &tok)) {
+			pp_tokens_add(pp, &line, tok);
+		}
+		pp_tokens_t expanded = pp_expand_list(pp, line.arr, line.len);
+		if (expanded.len != 1 || expanded.arr[0].id != TKN_STRVAL) {
+			pp_diag(pp, E_ERROR, pos, "#include expects \"FILENAME\" or <FILENAME>.");
+			return NULL;
+		}
+		name   = expanded.arr[0].strval;
+		angled = false;
+	}
+	
+	if (pp->files_len >= PP_MAX_INCLUDE_DEPTH) {
+		pp_diag(pp, E_ERROR, pos, "#include nested too deeply.");
+		return NULL;
+	}
+	
+	// Quoted includes look next to the current file first, then everything looks in the include directories.
+	pp_cached_t *ent = NULL;
+	if (*name == '/') {
+		*path = name;
+		ent   = pp_read_cached(*path);
+	} else {
+		if (!angled) {
+			const char *dir = pp->files_len ? pp->files[pp->files_len - 1]->dir : pp->main_dir;
+			*path = pp_join(pp, dir, name);
+			ent   = pp_read_cached(*path);
+		}
+		for (size_t x = 0; !ent && x < pp->include_dirs_len; x++) {
+			*path = pp_join(pp, pp->include_dirs[x], name);
+			ent   = pp_read_cached(*path);
+		}
+	}
+	if (!ent) {
+		pp_diag(pp, E_ERROR, pos, pp_format(pp, "Cannot find include file '%s'.", name));
+	}
+	return ent;
+}
+
+// Report the rest of the line as given by #error or #warning.
+static void pp_message(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, error_type_t type, pos_t pos) {
+	pp_skip_blank(tkn);
+	size_t len = tkn->source_len - tkn->index;
+	while (len && is_space(tkn->source[tkn->index + len - 1])) len --;
+	pp_diag(pp, type, pos, pp_format(pp, "%.*s", (int) len, tkn->source + tkn->index));
+}
+
+// Open a conditional.
+static void pp_cond_push(preproc_ctx_t *pp, pos_t pos, bool active) {
+	pp_cond_t cond = {
+		.pos       = pos,
+		.active    = active,
+		.taken     = active,
+		.seen_else = false,
+	};
+	array_len_cap_concat(pp->allocator, pp_cond_t, pp->conds, pp->conds_cap, pp->conds_len, cond);
+}
+
+// Handle #elif or #else.
+// Returns whether the group it starts is compiled.
+static bool pp_cond_else(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t pos, bool is_else) {
+	if (pp->conds_len <= pp_conds_base(pp)) {
+		pp_diag(pp, E_ERROR, pos, is_else ? "#else without #if." : "#elif without #if.");
+		return true;
+	}
+	pp_cond_t *cond = &pp->conds[pp->conds_len - 1];
+	if (pp->files_len && pp->conds_len - 1 == pp->files[pp->files_len - 1]->conds_base) {
+		// Include guards have no #else.
+		pp->files[pp->files_len - 1]->guard = NULL;
+	}
+	if (cond->seen_else) {
+		pp_diag(pp, E_ERROR, pos, is_else ? "#else after #else." : "#elif after #else.");
+	}
+	cond->seen_else |= is_else;
+	
+	// Only the first group whose condition holds is compiled.
+	if (cond->taken) {
+		cond->active = false;
+	} else {
+		cond->active = is_else || pp_eval_line(pp, tkn, pos);
+		cond->taken  = cond->active;
+	}
+	return cond->active;
+}
+
+// Handle #endif.
+static void pp_cond_end(preproc_ctx_t *pp, pos_t pos) {
+	if (pp->conds_len <= pp_conds_base(pp)) {
+		pp_diag(pp, E_ERROR, pos, "#endif without #if.");
+		return;
+	}
+	pp->conds_len --;
+	if (pp->files_len && pp->conds_len == pp->files[pp->files_len - 1]->conds_base) {
+		pp->files[pp->files_len - 1]->guard_closed = true;
+	}
+}
+
+// Skip a group whose condition does not hold, up to and including the directive that ends it.
+static void pp_skip_group(preproc_ctx_t *pp, tokeniser_ctx_t *tkn) {
+	size_t depth = 0;
+	while (tkn->index < tkn->source_len) {
+		pp_skip_blank(tkn);
+		if (tkn->index >= tkn->source_len || tkn->source[tkn->index] != '#') {
+			// Not a directive.
+			tokeniser_advance(tkn, pp_line_end(tkn) - tkn->index);
+			tokeniser_readchar(tkn);
+			continue;
+		}
+		
+		// Look at the directive's name; errors in skipped lines are not reported.
+		size_t     saved     = pp_line_begin(tkn);
+		size_t     diags_len = pp->diags_len;
+		pp_token_t hash, name;
+		pp_lex(pp, tkn, &hash);
+		const char *dname = pp_lex(pp, tkn, &name) ? pp_name(&name) : NULL;
+		pp->diags_len = diags_len;
+		
+		bool done = false;
+		if (!dname) {
+			// Not a directive that matters here.
+		} else if (!strcmp(dname, "if") || !strcmp(dname, "ifdef") || !strcmp(dname, "ifndef")) {
+			depth ++;
+		} else if (!strcmp(dname, "endif")) {
+			if (depth) {
+				depth --;
+			} else {
+				pp_cond_end(pp, name.pos);
+				done = true;
+			}
+		} else if (!depth && (!strcmp(dname, "elif") || !strcmp(dname, "else"))) {
+			done = pp_cond_else(pp, tkn, name.pos, !strcmp(dname, "else"));
+		}
+		pp_line_finish(tkn, saved);
+		if (done) return;
+	}
+}
+
+// Handle a directive on the current line, the '#' already read.
+// First tells whether the directive is the first thing in an included file, which makes it a possible include guard.
+// Returns whether a group must be skipped after the directive's line.
+static bool pp_directive(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t hash_pos, bool first, pp_cached_t **include, char **include_path) {
+	pp_token_t name;
+	if (!pp_lex(pp, tkn, &name)) return false;
+	const char *dname = pp_name(&name);
+	pos_t       pos   = pos_merge(hash_pos, name.pos);
+	
+	if (!dname) {
+		// Line markers such as `# 1 "file.c"` are ignored.
+		if (name.id != TKN_IVAL) pp_diag(pp, E_ERROR, pos, "Invalid preprocessor directive.");
+	} else if (!strcmp(dname, "define")) {
+		pp_define(pp, tkn, pos);
+	} else if (!strcmp(dname, "undef")) {
+		pp_undef(pp, tkn, pos);
+	} else if (!strcmp(dname, "include")) {
+		*include = pp_include(pp, tkn, pos, include_path);
+	} else if (!strcmp(dname, "if")) {
+		pp_cond_push(pp, pos, pp_eval_line(pp, tkn, pos));
+		return !pp->conds[pp->conds_len - 1].active;
+	} else if (!strcmp(dname, "ifdef") || !strcmp(dname, "ifndef")) {
+		pp_token_t macro;
+		bool       defined = false;
+		if (!pp_lex(pp, tkn, &macro) || !pp_name(&macro)) {
+			pp_diag(pp, E_ERROR, pos, "Expected a macro name.");
+		} else {
+			defined = pp_macro_find(pp, pp_atom(&macro)) != NULL;
+			if (first && !strcmp(dname, "ifndef")) {
+				// This may be an include guard.
+				pp->files[pp->files_len - 1]->guard = intern(pp_name(&macro));
+			}
+		}
+		pp_cond_push(pp, pos, defined == !strcmp(dname, "ifdef"));
+		return !pp->conds[pp->conds_len - 1].active;
+	} else if (!strcmp(dname, "elif") || !strcmp(dname, "else")) {
+		// The group before was compiled, so this one isn't.
+		if (pp->conds_len > pp_conds_base(pp)) pp->conds[pp->conds_len - 1].taken = true;
+		return !pp_cond_else(pp, tkn, pos, !strcmp(dname, "else"));
+	} else if (!strcmp(dname, "endif")) {
+		pp_cond_end(pp, pos);
+	} else if (!strcmp(dname, "error")) {
+		pp_message(pp, tkn, E_ERROR, pos);
+	} else if (!strcmp(dname, "warning")) {
+		pp_message(pp, tkn, E_WARN, pos);
+	} else if (!strcmp(dname, "pragma")) {
+		// Only #pragma once is supported.
+		pp_token_t pragma;
+		if (pp_lex(pp, tkn, &pragma) && pragma.id == TKN_IDENT && !strcmp(pragma.strval, "once") && pp->files_len) {
+			pp->files[pp->files_len - 1]->cached->once = true;
+		}
+	} else if (!strcmp(dname, "line")) {
+		// Ignored.
+	} else {
+		pp_diag(pp, E_ERROR, pos, pp_format(pp, "Invalid preprocessor directive '#%s'.", dname));
+	}
+	return false;
+}
+
+// Handle a directive line, the '#' already read.
+static void pp_handle_directive(preproc_ctx_t *pp, tokeniser_ctx_t *tkn, pos_t hash_pos) {
+	pp_cached_t *include = NULL;
+	char        *path    = NULL;
+	bool         first   = pp_guard_track(pp);
+	size_t       saved   = pp_line_begin(tkn);
+	bool         skip    = pp_directive(pp, tkn, hash_pos, first, &include, &path);
+	pp_line_finish(tkn, saved);
+	if (skip) pp_skip_group(pp, tkn);
+	if (include) pp_push_file(pp, include, path);
+}
+
+// Get the next token, from a macro expansion or from the source files, handling directives.
+// Returns 0 at the end of the input, or at the end of a barrier.
+static int pp_get(preproc_ctx_t *pp, pp_token_t *out) {
+	while (1) {
+		if (pp->exps_len) {
+			// Read back expanded tokens.
+			pp_expansion_t *exp = &pp->exps[pp->exps_len - 1];
+			if (exp->index < exp->len) {
+				*out = exp->tokens[exp->index++];
+				return out->id;
+			}
+			if (exp->barrier) return 0;
+			pp->exps_len --;
+			continue;
+		}
+		
+		tokeniser_ctx_t *tkn = pp_tokeniser(pp);
+		if (!pp_lex(pp, tkn, out)) {
+			// End of a file.
+			size_t base = pp_conds_base(pp);
+			if (pp->conds_len > base) {
+				pp_diag(pp, E_ERROR, pp->conds[base].pos, "Unterminated conditional.");
+				pp->conds_len = base;
+			}
+			if (!pp->files_len) return 0;
+			pp_file_t *file = pp->files[--pp->files_len];
+			if (file->guard && file->guard_closed) {
+				// The entire file is inside the include guard.
+				file->cached->guard = file->guard;
+			}
+			array_len_cap_concat(pp->allocator, pp_file_t *, pp->closed, pp->closed_cap, pp->closed_len, file);
+			continue;
+		}
+		if (out->id == TKN_HASH && tkn->line_start) {
+			pp_handle_directive(pp, tkn, out->pos);
+			continue;
+		}
+		pp_guard_track(pp);
+		return out->id;
+	}
+}
+
+
+
+// Initialise a preprocessor reading from a tokeniser.
+// Directives are only recognised in memory-resident sources; in others, '#' starts a comment.
+void preproc_init(preproc_ctx_t *pp, tokeniser_ctx_t *tokeniser_ctx, char **include_dirs, size_t include_dirs_len) {
+	*pp = (preproc_ctx_t) {
+		.allocator        = alloc_create(ALLOC_NO_PARENT),
+		.main             = tokeniser_ctx,
+		.files            = NULL,
+		.files_len        = 0,
+		.files_cap        = 0,
+		.closed           = NULL,
+		.closed_len       = 0,
+		.closed_cap       = 0,
+		.include_dirs     = include_dirs,
+		.include_dirs_len = include_dirs_len,
+		.macros           = NULL,
+		.macros_len       = 0,
+		.macros_cap       = PP_MACRO_BUCKETS,
+		.keyword_macros   = 0,
+		.conds            = NULL,
+		.conds_len        = 0,
+		.conds_cap        = 0,
+		.exps             = NULL,
+		.exps_len         = 0,
+		.exps_cap         = 0,
+		.diags            = NULL,
+		.diags_len        = 0,
+		.diags_cap        = 0,
+	};
+	alloc_set_name(pp->allocator, "preproc");
+	pp->macros = xalloc(pp->allocator, sizeof(pp_macro_t *) * pp->macros_cap);
+	memset(pp->macros, 0, sizeof(pp_macro_t *) * pp->macros_cap);
+	map_create(&pp->included);
+	pp->main_dir = pp_dirname(pp, tokeniser_ctx->file->filename);
+	// Directives are read a line at a time, which needs the source in memory.
+	tokeniser_ctx->directives = !tokeniser_ctx->use_fd;
+}
+
+// Clean up a preprocessor, including the tokenisers of included files.
+// Strings returned by preproc_next are no longer valid afterwards.
+void preproc_destroy(preproc_ctx_t *pp) {
+	for (size_t i = 0; i < pp->files_len; i++) {
+		tokeniser_destroy(&pp->files[i]->tkn);
+	}
+	for (size_t i = 0; i < pp->closed_len; i++) {
+		tokeniser_destroy(&pp->closed[i]->tkn);
+	}
+	map_delete(&pp->included);
+	alloc_destroy(pp->allocator);
+}
+
+// Grab next preprocessed token, storing its value in lval.
+// Diagnostics are added to pp->diags instead of being reported.
+int preproc_next(preproc_ctx_t *pp, YYSTYPE *lval) {
+	pp_token_t tok;
+	int id = pp_expand_next(pp, &tok);
+	if (!id) return 0;
+	lval->pos = tok.pos;
+	if (id == TKN_IDENT) {
+		lval->ident.strval  = tok.strval;
+	} else if (id == TKN_STRVAL) {
+		lval->strval.strval = tok.strval;
+	} else if (id == TKN_IVAL) {
+		lval->ival.ival     = tok.ival;
+		lval->ival.type     = tok.type;
+	}
+	return id;
+}
+
+// Report and clear the diagnostics collected so far.
+void preproc_report(preproc_ctx_t *pp, tokeniser_ctx_t *tokeniser_ctx) {
+	for (size_t i = 0; i < pp->diags_len; i++) {
+		report_error(tokeniser_ctx, pp->diags[i].type, pp->diags[i].pos, pp->diags[i].msg);
+	}
+	pp->diags_len = 0;
+}
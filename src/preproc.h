@@ -0,0 +1,189 @@
+
+#ifndef PREPROC_H
+#define PREPROC_H
+
+#include <stdbool.h>
+#include "tokeniser.h"
+#include "parser.h"
+#include "strmap.h"
+
+// Maximum depth of nested includes.
+#define PP_MAX_INCLUDE_DEPTH 200
+// Initial number of buckets in the macro table; must be a power of two.
+#define PP_MACRO_BUCKETS     64
+
+struct pp_hideset;
+struct pp_token;
+struct pp_cached;
+struct pp_macro;
+struct pp_file;
+struct pp_cond;
+struct pp_expansion;
+struct pp_diag;
+struct preproc;
+
+typedef struct pp_hideset pp_hideset_t;
+typedef struct pp_token pp_token_t;
+typedef struct pp_cached pp_cached_t;
+typedef struct pp_macro pp_macro_t;
+typedef struct pp_file pp_file_t;
+typedef struct pp_cond pp_cond_t;
+typedef struct pp_expansion pp_expansion_t;
+typedef struct pp_diag pp_diag_t;
+typedef struct preproc preproc_ctx_t;
+
+// A set of macro names, shared between tokens and never modified once made.
+// Tokens are never expanded by a macro in their hide-set, which stops macros from expanding themselves.
+struct pp_hideset {
+	// Interned name of the macro.
+	const char    *name;
+	// The rest of the set, if any.
+	pp_hideset_t  *next;
+};
+
+// A token as seen by the preprocessor; a compact subset of YYSTYPE.
+struct pp_token {
+	// Token ID.
+	int            id;
+	// Position of the token, or of the macro invocation it came from.
+	pos_t          pos;
+	// Identifier or string constant.
+	char          *strval;
+	// Integer constant and its type.
+	long           ival;
+	simple_type_t  type;
+	// Spelling of the token in the source, if known; used by # and ##.
+	const char    *spell;
+	size_t         spell_len;
+	// Whether the token is preceded by whitespace.
+	bool           space;
+	// Macros the token must not be expanded by.
+	pp_hideset_t  *hide;
+};
+
+// A file read by #include, kept so that including it again doesn't read it again.
+struct pp_cached {
+	// Canonical path of the file, which identifies it however it was included.
+	char          *path;
+	// Contents of the file, or NULL if it could not be read.
+	char          *data;
+	size_t         len;
+	// Macro that guards the entire file, if any.
+	const char    *guard;
+	// Whether the file contains #pragma once.
+	bool           once;
+};
+
+// A macro definition.
+struct pp_macro {
+	// Interned name of the macro.
+	const char    *name;
+	// Position of the definition.
+	pos_t          pos;
+	// Whether the macro takes arguments.
+	bool           is_func;
+	// Whether the last parameter is __VA_ARGS__.
+	bool           variadic;
+	// Interned parameter names.
+	const char   **params;
+	size_t         params_len;
+	// Replacement list.
+	pp_token_t    *body;
+	size_t         body_len;
+	// Next macro in the same bucket of the macro table.
+	pp_macro_t    *next;
+};
+
+// A source file on the include stack.
+struct pp_file {
+	// Cache entry the file was read from.
+	pp_cached_t    *cached;
+	// Tokeniser for this file.
+	tokeniser_ctx_t tkn;
+	// Directory the file is in, used to resolve "" includes.
+	char           *dir;
+	// Number of open conditionals when the file was entered.
+	size_t          conds_base;
+	// Whether a token or directive was seen in the file yet.
+	bool            started;
+	// Macro of the #ifndef that started the file, while everything seen so far is inside it.
+	const char     *guard;
+	// Whether the #endif that matches the guard was seen.
+	bool            guard_closed;
+};
+
+// An open conditional (#if, #ifdef or #ifndef).
+struct pp_cond {
+	// Position of the directive that opened it.
+	pos_t          pos;
+	// Whether the current group is being compiled.
+	bool           active;
+	// Whether any group so far was compiled.
+	bool           taken;
+	// Whether #else was seen.
+	bool           seen_else;
+};
+
+// A list of tokens being read back, e.g. the result of a macro expansion.
+struct pp_expansion {
+	pp_token_t    *tokens;
+	size_t         len, index;
+	// Whether reading stops at the end of this list instead of continuing below it.
+	bool           barrier;
+};
+
+// A diagnostic produced by the preprocessor, to be reported by the parser thread.
+struct pp_diag {
+	error_type_t   type;
+	pos_t          pos;
+	char          *msg;
+};
+
+// Preprocessor state for one translation unit.
+struct preproc {
+	// Allocation context for everything owned by the preprocessor.
+	alloc_ctx_t      allocator;
+	// Tokeniser of the main file.
+	tokeniser_ctx_t *main;
+	// Stack of included files, not including the main file.
+	pp_file_t      **files;
+	size_t           files_len, files_cap;
+	// Files that have been fully read, kept because their strings may still be in use.
+	pp_file_t      **closed;
+	size_t           closed_len, closed_cap;
+	// Directory the main file is in.
+	char            *main_dir;
+	// Directories to search for includes.
+	char           **include_dirs;
+	size_t           include_dirs_len;
+	// Hash table of macros, keyed by their interned names.
+	pp_macro_t     **macros;
+	size_t           macros_len, macros_cap;
+	// Map of canonical path to pp_cached_t of every file included so far.
+	map_t            included;
+	// Number of macros named after keywords.
+	size_t           keyword_macros;
+	// Stack of open conditionals.
+	pp_cond_t       *conds;
+	size_t           conds_len, conds_cap;
+	// Stack of token lists being read back.
+	pp_expansion_t  *exps;
+	size_t           exps_len, exps_cap;
+	// Diagnostics not yet reported.
+	pp_diag_t       *diags;
+	size_t           diags_len, diags_cap;
+};
+
+// Initialise a preprocessor reading from a tokeniser.
+// Directives are only recognised in memory-resident sources; in others, '#' starts a comment.
+void preproc_init(preproc_ctx_t *pp, tokeniser_ctx_t *tokeniser_ctx, char **include_dirs, size_t include_dirs_len);
+// Clean up a preprocessor, including the tokenisers of included files.
+// Strings returned by preproc_next are no longer valid afterwards.
+void preproc_destroy(preproc_ctx_t *pp);
+// Grab next preprocessed token, storing its value in lval.
+// Diagnostics are added to pp->diags instead of being reported.
+int  preproc_next(preproc_ctx_t *pp, YYSTYPE *lval);
+// Report and clear the diagnostics collected so far.
+void preproc_report(preproc_ctx_t *pp, tokeniser_ctx_t *tokeniser_ctx);
+
+#endif // PREPROC_H
@@ -1,84 +1,218 @@
 
 #include "tokeniser.h"
 #include "parser.h"
+#include "array_util.h"
+#include "keywords.h"
+#include "intern.h"
+#include "scan.h"
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "ctxalloc_warn.h"
 
+// Size of the blocks the string slab is made of.
+#define TKN_SLAB_SIZE 4096
+
+// Merge two positions into one spanning both.
 pos_t pos_merge(pos_t one, pos_t two) {
-	if (one.index0 > two.index0) {
+	if (one.start > two.start) {
 		pos_t temp = one;
 		one = two;
 		two = temp;
 	}
-	pos_t out = {
-		.filename = one.filename,
-		.x0 = one.x0,
-		.y0 = one.y0,
-		.x1 = two.x1,
-		.y1 = two.y1,
-		.index0 = one.index0,
-		.index1 = two.index1
+	return (pos_t) {
+		.start = one.start,
+		.end   = two.end,
 	};
-	// print_pos(one);
-	// printf(", ");
-	// print_pos(two);
-	// printf(" => ");
-	// print_pos(out);
-	// printf("\n");
-	return out;
 }
 
+// Location of the start of the tokeniser's source; 0 for scratch contexts.
+srcloc_t tokeniser_base(tokeniser_ctx_t *ctx) {
+	return ctx->file ? ctx->file->base : 0;
+}
+
+// Empty position at the last character read.
 pos_t pos_empty(tokeniser_ctx_t *ctx) {
+	srcloc_t loc = tokeniser_base(ctx) + (ctx->index ? ctx->index - 1 : 0);
 	return (pos_t) {
-		.filename = ctx->filename,
-		.x0 = ctx->x,
-		.y0 = ctx->y,
-		.x1 = ctx->x,
-		.y1 = ctx->y,
-		.index0 = ctx->index,
-		.index1 = ctx->index
+		.start = loc,
+		.end   = loc,
 	};
 }
 
+// Decode a position into filename, lines and columns.
+pos_info_t pos_decode(pos_t pos) {
+	pos_info_t info = {
+		.filename = NULL,
+		.x0 = 0, .y0 = 0,
+		.x1 = 0, .y1 = 0,
+	};
+	srcfile_t *file = srcloc_decode(pos.start, &info.y0, &info.x0);
+	if (!file) return info;
+	info.filename = file->filename;
+	if (!srcloc_decode(pos.end, &info.y1, &info.x1)) {
+		info.y1 = info.y0;
+		info.x1 = info.x0;
+	}
+	return info;
+}
+
 void print_pos(tokeniser_ctx_t *ctx, pos_t pos) {
 	// Print just the pos.
-	printf("%s:%d:%d -> %d:%d\n", pos.filename, pos.y0, pos.x0, pos.y1, pos.x1);
+	pos_info_t info = pos_decode(pos);
+	printf("%s:%d:%d -> %d:%d\n", info.filename, info.y0, info.x0, info.y1, info.x1);
 }
 
 // Initialise a context, given c-string.
 void tokeniser_init_cstr(tokeniser_ctx_t *ctx, char *raw) {
 	*ctx = (tokeniser_ctx_t) {
-		.filename = "<anonymous>",
 		.source_len = strlen(raw),
+		.use_mmap = false,
 		.fd = NULL,
 		.use_fd = false,
 		.index = 0,
 		.x = 0,
 		.y = 1,
-		.allocator = alloc_create(ALLOC_NO_PARENT),
+		.allocator = alloc_create_arena(ALLOC_NO_PARENT, ALLOC_ARENA_SMALL_CHUNK),
 	};
-	ctx->source = xalloc(ctx->allocator, strlen(raw));
+	alloc_set_name(ctx->allocator, "tokeniser");
+	ctx->source = xalloc(ctx->allocator, strlen(raw) + 1);
 	strcpy(ctx->source, raw);
+	ctx->file = srcfile_create("<anonymous>", ctx->source, ctx->source_len);
+}
+
+// Initialise a context, given a buffer that outlives the context.
+// The buffer need not be NUL-terminated.
+void tokeniser_init_buf(tokeniser_ctx_t *ctx, const char *buf, size_t len) {
+	*ctx = (tokeniser_ctx_t) {
+		.source = (char *) buf,
+		.source_len = len,
+		.borrowed = true,
+		.use_mmap = false,
+		.fd = NULL,
+		.use_fd = false,
+		.index = 0,
+		.x = 0,
+		.y = 1,
+		.allocator = alloc_create_arena(ALLOC_NO_PARENT, ALLOC_ARENA_SMALL_CHUNK),
+	};
+	alloc_set_name(ctx->allocator, "tokeniser");
+	ctx->file = srcfile_create("<anonymous>", ctx->source, ctx->source_len);
+}
+
+// Initialise a scratch context for a short buffer that isn't a source file, e.g. the result of token pasting.
+// Nothing is added to the location space, so token positions are offsets into the buffer.
+// The buffer and the allocation context must outlive the context.
+void tokeniser_init_scratch(tokeniser_ctx_t *ctx, const char *buf, size_t len, alloc_ctx_t allocator) {
+	*ctx = (tokeniser_ctx_t) {
+		.file = NULL,
+		.source = (char *) buf,
+		.source_len = len,
+		.borrowed = true,
+		.use_mmap = false,
+		.fd = NULL,
+		.use_fd = false,
+		.index = 0,
+		.x = 0,
+		.y = 1,
+		.allocator = allocator,
+	};
+}
+
+// Read the rest of a file into the context's source buffer and register it as a source file.
+// Returns false if the file could not be read.
+static bool tokeniser_read_all(tokeniser_ctx_t *ctx, FILE *file) {
+	size_t cap = 4096;
+	ctx->source     = xalloc(ctx->allocator, cap);
+	ctx->source_len = 0;
+	ctx->use_fd     = false;
+	while (1) {
+		size_t n = fread(ctx->source + ctx->source_len, 1, cap - ctx->source_len - 1, file);
+		ctx->source_len += n;
+		if (ctx->source_len < cap - 1) break;
+		cap *= 2;
+		ctx->source = xrealloc(ctx->allocator, ctx->source, cap);
+	}
+	ctx->source[ctx->source_len] = 0;
+	ctx->file = srcfile_create("<anonymous>", ctx->source, ctx->source_len);
+	return !ferror(file);
 }
 
 // Initialise a context, given a file descriptor.
+// Files that can't be measured up front, like pipes, are read into memory instead.
 void tokeniser_init_file(tokeniser_ctx_t *ctx, FILE *file) {
 	*ctx = (tokeniser_ctx_t) {
-		.filename = "<anonymous>",
 		.source = NULL,
 		.source_len = 0,
+		.use_mmap = false,
 		.fd = file,
 		.use_fd = true,
 		.index = 0,
 		.x = 0,
 		.y = 1,
-		.allocator = alloc_create(ALLOC_NO_PARENT),
+		.allocator = alloc_create_arena(ALLOC_NO_PARENT, ALLOC_ARENA_SMALL_CHUNK),
+	};
+	alloc_set_name(ctx->allocator, "tokeniser");
+	
+	// Measure the file to reserve its locations.
+	struct stat info;
+	long pos = ftell(file);
+	if (fstat(fileno(file), &info) || !S_ISREG(info.st_mode) || pos < 0 || fseek(file, 0, SEEK_END)) {
+		// Reading it all is the only way to know how many locations it needs.
+		tokeniser_read_all(ctx, file);
+		return;
+	}
+	long len = ftell(file);
+	fseek(file, pos, SEEK_SET);
+	ctx->file = srcfile_create("<anonymous>", NULL, len > 0 ? len : 0);
+}
+
+// Initialise a context, given a file descriptor, buffering the entire file in memory.
+// Regular files are memory mapped, other files (e.g. pipes) are read into a buffer.
+// Returns false if the file could not be read.
+bool tokeniser_init_mapped(tokeniser_ctx_t *ctx, FILE *file) {
+	*ctx = (tokeniser_ctx_t) {
+		.source = NULL,
+		.source_len = 0,
+		.use_mmap = false,
+		.fd = file,
+		.use_fd = false,
+		.index = 0,
+		.x = 0,
+		.y = 1,
+		.allocator = alloc_create_arena(ALLOC_NO_PARENT, ALLOC_ARENA_SMALL_CHUNK),
 	};
+	alloc_set_name(ctx->allocator, "tokeniser");
+	
+	// Try to map regular files directly.
+	struct stat info;
+	int fileno_ = fileno(file);
+	if (!fstat(fileno_, &info) && S_ISREG(info.st_mode) && info.st_size > 0) {
+		void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fileno_, 0);
+		if (mapped != MAP_FAILED) {
+			ctx->source     = mapped;
+			ctx->source_len = info.st_size;
+			ctx->use_mmap   = true;
+			ctx->file       = srcfile_create("<anonymous>", ctx->source, ctx->source_len);
+			return true;
+		}
+	}
+	
+	// Fall back to reading the whole thing into a buffer.
+	return tokeniser_read_all(ctx, file);
 }
 
 // Clean up a tokeniser context.
 void tokeniser_destroy(tokeniser_ctx_t *ctx) {
+	// Scratch contexts borrow everything.
+	if (!ctx->file) return;
+	// The source text is about to go away.
+	if (!ctx->borrowed) ctx->file->source = NULL;
+	if (ctx->use_mmap) {
+		munmap(ctx->source, ctx->source_len);
+	}
 	alloc_destroy(ctx->allocator);
 }
 
@@ -119,6 +253,16 @@ bool is_alphanumeric(char c) {
 }
 
 
+// Account for a newline that was just read.
+static inline void tokeniser_newline(tokeniser_ctx_t *ctx) {
+	ctx->y ++;
+	ctx->x = 0;
+	// Remember where this line starts.
+	if (ctx->file && ctx->file->line_starts_len == ctx->y - 1) {
+		srcfile_add_line(ctx->file, ctx->index);
+	}
+}
+
 // Read a single character.
 char tokeniser_readchar(tokeniser_ctx_t *ctx) {
 	char c;
@@ -135,15 +279,60 @@ char tokeniser_readchar(tokeniser_ctx_t *ctx) {
 	ctx->x ++;
 	if (c == '\r') {
 		c = '\n';
-		if (tokeniser_nextchar(ctx) == '\n') tokeniser_readchar(ctx);
+		// Look at the raw next character; tokeniser_nextchar turns carriage returns into line feeds.
+		bool crlf = ctx->use_fd
+			? tokeniser_nextchar(ctx) == '\n'
+			: ctx->index < ctx->source_len && ctx->source[ctx->index] == '\n';
+		if (crlf) {
+			// Consume the line feed as part of the same newline.
+			if (ctx->use_fd) fread(&c, 1, 1, ctx->fd);
+			ctx->index ++;
+			c = '\n';
+		}
 	}
 	if (c == '\n') {
-		ctx->y ++;
-		ctx->x = 0;
+		tokeniser_newline(ctx);
 	}
 	return c;
 }
 
+// Move forward n characters in a memory-resident source, keeping track of lines.
+// A carriage return at the end is consumed along with the line feed after it, if any.
+void tokeniser_advance(tokeniser_ctx_t *ctx, size_t n) {
+	const char *src = ctx->source;
+	size_t      end = ctx->index + n;
+	while (ctx->index < end) {
+		size_t eol = ctx->index + scan_eol(src + ctx->index, end - ctx->index);
+		if (eol >= end) {
+			ctx->x    += end - ctx->index;
+			ctx->index = end;
+			return;
+		}
+		ctx->index = eol + 1;
+		if (src[eol] == '\r' && ctx->index < ctx->source_len && src[ctx->index] == '\n') {
+			// Consume the line feed as part of the same newline.
+			ctx->index ++;
+		}
+		tokeniser_newline(ctx);
+	}
+}
+
+// Skip the rest of a line comment in a memory-resident source, including the newline that ends it.
+// A backslash before the newline continues the comment onto the next line.
+static void tokeniser_skip_line_comment(tokeniser_ctx_t *ctx) {
+	while (ctx->index < ctx->source_len) {
+		size_t eol = ctx->index + scan_eol(ctx->source + ctx->index, ctx->source_len - ctx->index);
+		if (eol >= ctx->source_len) {
+			// Comment runs until the end of the file.
+			tokeniser_advance(ctx, eol - ctx->index);
+			return;
+		}
+		bool cont = eol > ctx->index && ctx->source[eol - 1] == '\\';
+		tokeniser_advance(ctx, eol - ctx->index + 1);
+		if (!cont) return;
+	}
+}
+
 // Identical to tokeniser_nextchar_no(0).
 char tokeniser_nextchar(tokeniser_ctx_t *ctx) {
 	return tokeniser_nextchar_no(ctx, 0);
@@ -177,13 +366,28 @@ static inline int8_t unhex_char(char c) {
 			-1;
 }
 
+// Append a character to the string being built at the end of the string slab.
+// If it no longer fits, the string so far is moved to a new block; earlier strings stay where they are.
+static void tokeniser_slab_append(tokeniser_ctx_t *ctx, size_t *start, char c) {
+	if (ctx->str_slab_len >= ctx->str_slab_cap) {
+		size_t used = ctx->str_slab_len - *start;
+		size_t cap  = TKN_SLAB_SIZE;
+		while (cap < used * 2) cap *= 2;
+		char *block = xalloc(ctx->allocator, cap);
+		if (used) memcpy(block, ctx->str_slab + *start, used);
+		ctx->str_slab     = block;
+		ctx->str_slab_len = used;
+		ctx->str_slab_cap = cap;
+		*start            = 0;
+	}
+	ctx->str_slab[ctx->str_slab_len++] = c;
+}
+
 // Unescape an escaped c-string.
+// The string lives in the string slab until the context is destroyed and must not be freed.
 char *tokeniser_getstr(tokeniser_ctx_t *ctx, char term) {
-	// Make the buf.
-	size_t buf_len   = 256;
-	size_t buf_index = 0;
-	char *buf = xalloc(ctx->allocator, sizeof(char) * buf_len);
-	*buf = 0;
+	// The string is built at the end of the string slab.
+	size_t start = ctx->str_slab_len;
 	// Grab str.
 	while (1) {
 		char c = tokeniser_readchar(ctx);
@@ -280,22 +484,12 @@ char *tokeniser_getstr(tokeniser_ctx_t *ctx, char term) {
 		}
 		
 		appendit:
-		{
-			// Append the funy.
-			if (buf_index >= buf_len) {
-				buf_len *= 2;
-				buf = xrealloc(ctx->allocator, buf, buf_len);
-			}
-			// TODO: Charset encode.
-			buf[buf_index] = toappend;
-			buf_index ++;
-			buf[buf_index] = 0;
-		}
+		// Append the funy.
+		// TODO: Charset encode.
+		tokeniser_slab_append(ctx, &start, toappend);
 	}
-	// Shrik to fit.
-	buf_len = strlen(buf) + 1;
-	buf = xrealloc(ctx->allocator, buf, buf_len);
-	return buf;
+	tokeniser_slab_append(ctx, &start, 0);
+	return ctx->str_slab + start;
 }
 
 typedef struct {
@@ -325,23 +519,141 @@ static const keyw_map_t keyw_map[] = {
 	(keyw_map_t) { .keyw=TKN_VOLATILE, .str="volatile" },
 	(keyw_map_t) { .keyw=TKN_INLINE,   .str="inline" },
 };
-static const size_t keyw_map_len = sizeof(keyw_map) / sizeof(keyw_map_t);
+static keyw_table_t keyw_table = KEYW_TABLE_FIELD(keyw_map, str, false);
+// Identifiers up to this length are checked for keywords without being copied.
+#define KEYW_PEEK_LEN 16
 
 // The error type returned by tokenise_int, if any.
-static error_type_t tkn_int_err_type;
+static _Thread_local error_type_t tkn_int_err_type;
 // The error message returned by tokenise_int, if any.
-static char        *tkn_int_err_msg;
-// Whether or not to free tkn_int_err_msg.
-static bool         tkn_int_err_do_free;
+static _Thread_local char        *tkn_int_err_msg;
+// Where tokenise_int stores the token's value.
+static _Thread_local YYSTYPE     *tkn_lval;
+
+// Largest value representable in LONGER_BITS bits.
+#if LONGER_BITS >= 64
+#define ICONST_MAX UINT64_MAX
+#else
+#define ICONST_MAX ((UINT64_C(1) << LONGER_BITS) - 1)
+#endif
+
+// Whether an integer constant fits in a type of a given width.
+static inline bool iconst_fits(uint64_t value, int bits, bool is_signed) {
+	if (is_signed) bits --;
+	return bits >= 64 || value < (UINT64_C(1) << bits);
+}
+
+// Pick the narrowest type for an integer constant, like C does.
+// Decimal constants without a 'u' suffix only try signed types.
+static simple_type_t iconst_type(uint64_t value, bool is_decimal, bool is_unsigned, int n_long) {
+	static const struct {
+		int           bits;
+		simple_type_t s_type, u_type;
+	} ranks[] = {
+		{ INT_BITS,    STYPE_S_INT,    STYPE_U_INT    },
+		{ LONG_BITS,   STYPE_S_LONG,   STYPE_U_LONG   },
+		{ LONGER_BITS, STYPE_S_LONGER, STYPE_U_LONGER },
+	};
+	for (int i = n_long; i < 3; i++) {
+		if (!is_unsigned && iconst_fits(value, ranks[i].bits, true)) {
+			return ranks[i].s_type;
+		}
+		if ((is_unsigned || !is_decimal) && iconst_fits(value, ranks[i].bits, false)) {
+			return ranks[i].u_type;
+		}
+	}
+	// Too large for a signed type.
+	if (!is_unsigned && !tkn_int_err_msg) {
+		tkn_int_err_msg     = "Integer constant is so large that it is unsigned.";
+		tkn_int_err_type    = E_WARN;
+	}
+	return STYPE_U_LONGER;
+}
+
+// Lex an integer constant in a single pass, straight into the token value.
+// Honours the 'u', 'l' and 'll' suffixes and detects overflow of LONGER_BITS.
+static int tokenise_iconst(tokeniser_ctx_t *ctx, char c) {
+	uint64_t value      = 0;
+	bool     overflow   = false;
+	bool     bad_digit  = false;
+	int      base;
+	
+	// Determine the base.
+	char next = tokeniser_nextchar(ctx);
+	if (c == '0' && (next == 'x' || next == 'X')) {
+		// Skip the x.
+		tokeniser_readchar(ctx);
+		base = 16;
+	} else {
+		value = c - '0';
+		base  = c == '0' ? 8 : 10;
+	}
+	
+	// Accumulate digits.
+	while (1) {
+		next = tokeniser_nextchar(ctx);
+		int digit = unhex_char(next);
+		if (digit < 0 || (base != 16 && digit > 9)) break;
+		if (digit >= base) bad_digit = true;
+		if (value > (ICONST_MAX - digit) / base) overflow = true;
+		value = value * base + digit;
+		tokeniser_readchar(ctx);
+	}
+	
+	// Parse the suffix.
+	bool is_unsigned = false;
+	int  n_long      = 0;
+	bool bad_suffix  = false;
+	while (is_alphanumeric(next = tokeniser_nextchar(ctx))) {
+		if ((next == 'u' || next == 'U') && !is_unsigned) {
+			is_unsigned = true;
+		} else if ((next == 'l' || next == 'L') && !n_long) {
+			n_long = 1;
+			if (tokeniser_nextchar_no(ctx, 1) == next) {
+				tokeniser_readchar(ctx);
+				n_long = 2;
+			}
+		} else {
+			bad_suffix = true;
+		}
+		tokeniser_readchar(ctx);
+	}
+	
+	// Report the problems, if any.
+	if (bad_suffix) {
+		tkn_int_err_msg     = "Invalid suffix on integer constant.";
+		tkn_int_err_type    = E_ERROR;
+	} else if (bad_digit) {
+		tkn_int_err_msg     = "Invalid digit in octal constant.";
+		tkn_int_err_type    = E_ERROR;
+	} else if (overflow) {
+		tkn_int_err_msg     = "Integer constant is too large for its type.";
+		tkn_int_err_type    = E_WARN;
+	}
+	
+	tkn_lval->ival.ival = value & ICONST_MAX;
+	tkn_lval->ival.type = iconst_type(value & ICONST_MAX, base == 10, is_unsigned, n_long);
+	DEBUG_TKN("ival  %llu\n", (unsigned long long) (value & ICONST_MAX));
+	return TKN_IVAL;
+}
 
 // Grab next non-space token (internal method).
 static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 	// Get the first non-space character.
 	char c;
 	retry:
+	if (!ctx->use_fd) {
+		// Skip whitespace in bulk.
+		tokeniser_advance(ctx, scan_space(ctx->source + ctx->index, ctx->source_len - ctx->index));
+	}
 	do {
 		c = tokeniser_readchar(ctx);
 	} while(is_space(c));
+	if (c == '\\' && tokeniser_nextchar(ctx) == '\n') {
+		// A backslash joins lines.
+		tokeniser_readchar(ctx);
+		goto retry;
+	}
 	if (!c) return 0;
 	*i0 = ctx->index;
 	*x0 = ctx->x;
@@ -417,7 +729,14 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 			}
 			break;
 		case ('#'):
-			goto linecomment;
+			if (!ctx->directives) goto linecomment;
+			if (next == '#') {
+				tokeniser_readchar(ctx);
+				ret = TKN_HASHHASH;
+			} else {
+				ret = TKN_HASH;
+			}
+			break;
 		case ('/'):
 			if (next == '=') {
 				tokeniser_readchar(ctx);
@@ -425,7 +744,11 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 			} else if (next == '/') {
 				// This starts a line commment.
 				linecomment:
-				for (long i = 1; c != '\r' && c != '\n'; i++) {
+				if (!ctx->use_fd) {
+					tokeniser_skip_line_comment(ctx);
+					goto retry;
+				}
+				for (long i = 1; c && c != '\r' && c != '\n'; i++) {
 					c = tokeniser_readchar(ctx);
 					char next = tokeniser_nextchar(ctx);
 					if (c == '\\' && (next == '\r' || next == '\n')) {
@@ -436,6 +759,17 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 				goto retry;
 			} else if (next == '*') {
 				// This starts a block commment.
+				if (!ctx->use_fd) {
+					size_t left = ctx->source_len - ctx->index;
+					size_t end  = scan_block_end(ctx->source + ctx->index, left);
+					if (end < left) {
+						// End the block comment.
+						tokeniser_advance(ctx, end + 2);
+						goto retry;
+					}
+					tokeniser_advance(ctx, left);
+					c = 0;
+				}
 				for (long i = 1; c != 0; i++) {
 					char q = tokeniser_readchar(ctx);
 					char next = tokeniser_nextchar(ctx);
@@ -550,83 +884,71 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 		return ret;
 	}
     
-	// This could be hexadecimal.
-	if (c == '0' && (next == 'x' || next == 'X')) {
-		int offs = 1;
-		while (is_hexadecimal(tokeniser_nextchar_no(ctx, offs))) offs++;
-		// Skip the x.
-		tokeniser_readchar(ctx);
-		// Now, grab it.
-		char *strval = (char *) xalloc(ctx->allocator, sizeof(char) * offs);
-		strval[offs-1] = 0;
-		for (int i = 0; i < offs-1; i++) {
-			strval[i] = tokeniser_readchar(ctx);
-		}
-		// Turn it into a number, hexadecimal.
-		int ival = strtoull(strval, NULL, 16);
-		DEBUG_TKN("ival  %d (0x%s)\n", ival, strval);
-		xfree(ctx->allocator, strval);
-		yylval.ival.ival = ival;
-		return TKN_IVAL;
-	}
-	
 	// This could be a number.
 	if (is_numeric(c)) {
-		// Check how many of these we get.
-		int offs = 0;
-		while (is_alphanumeric(tokeniser_nextchar_no(ctx, offs))) offs++;
-		offs ++;
-		// Now, grab it.
-		char *strval = (char *) xalloc(ctx->allocator, sizeof(char) * (offs + 1));
-		*strval = c;
-		strval[offs] = 0;
-		for (int i = 1; i < offs; i++) {
-			strval[i] = tokeniser_readchar(ctx);
-		}
-		// Turn it into a number, respecting octal.
-		int ival = strtoull(strval, NULL, c == '0' ? 8 : 10);
-		DEBUG_TKN("ival  %d (%s)\n", ival, strval);
-		xfree(ctx->allocator, strval);
-		yylval.ival.ival = ival;
-		return TKN_IVAL;
+		return tokenise_iconst(ctx, c);
 	}
     
 	// Or an ident or keyword.
 	if (is_alphanumeric(c)) {
 		// Check how many of these we get.
 		int offs = 0;
-		while (is_alphanumeric(tokeniser_nextchar_no(ctx, offs))) offs++;
-		offs ++;
-		// Now, grab it.
-		char *strval = (char *) xalloc(ctx->allocator, sizeof(char) * (offs + 1));
-		*strval = c;
-		strval[offs] = 0;
-		for (int i = 1; i < offs; i++) {
-			strval[i] = tokeniser_readchar(ctx);
+		if (ctx->use_fd) {
+			while (is_alphanumeric(tokeniser_nextchar_no(ctx, offs))) offs++;
+		} else {
+			offs = scan_ident(ctx->source + ctx->index, ctx->source_len - ctx->index);
 		}
-		// Next, check for keywords.
-		int keyw = 0;
-		for (int i = 0; i < keyw_map_len; i++) {
-			if (!strcmp(strval, keyw_map[i].str)) {
-				keyw = keyw_map[i].keyw;
-				break;
+		offs ++;
+		// Check for keywords before copying anything.
+		if (offs <= KEYW_PEEK_LEN) {
+			char  peek_buf[KEYW_PEEK_LEN];
+			char *peek = peek_buf;
+			if (ctx->use_fd) {
+				peek_buf[0] = c;
+				for (int i = 1; i < offs; i++) {
+					peek_buf[i] = tokeniser_nextchar_no(ctx, i - 1);
+				}
+			} else {
+				peek = ctx->source + ctx->index - 1;
+			}
+			int keyw = keyw_lookup(&keyw_table, peek, offs);
+			if (keyw != -1) {
+				DEBUG_TKN("token '%s'\n", keyw_map[keyw].str);
+				if (ctx->use_fd) {
+					for (int i = 1; i < offs; i++) {
+						tokeniser_readchar(ctx);
+					}
+				} else {
+					tokeniser_advance(ctx, offs - 1);
+				}
+				return keyw_map[keyw].keyw;
 			}
 		}
-		// Return the appropriate alternative.
-		if (keyw) {
-			DEBUG_TKN("token '%s'\n", strval);
-			xfree(ctx->allocator, strval);
-			return keyw;
+		// Now, intern it.
+		// Interned identifiers are shared and must not be modified.
+		char *strval;
+		if (ctx->use_fd) {
+			char *buf = (char *) xalloc(ctx->allocator, sizeof(char) * (offs + 1));
+			*buf = c;
+			buf[offs] = 0;
+			for (int i = 1; i < offs; i++) {
+				buf[i] = tokeniser_readchar(ctx);
+			}
+			strval = (char *) intern_n(buf, offs);
+			xfree(ctx->allocator, buf);
+		} else {
+			strval = (char *) intern_n(ctx->source + ctx->index - 1, offs);
+			tokeniser_advance(ctx, offs - 1);
 		}
 		DEBUG_TKN("ident '%s'\n", strval);
-		yylval.ident.strval = strval;
+		tkn_lval->ident.strval = strval;
 		return TKN_IDENT;
 	}
 	
 	// Or a string value.
 	if (c == '"') {
 		char *strval = tokeniser_getstr(ctx, '"');
-		yylval.strval.strval = strval;
+		tkn_lval->strval.strval = strval;
 		DEBUG_TKN("str   \"%s\"\n", strval);
 		return TKN_STRVAL;
 	}
@@ -640,12 +962,10 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 			// Warn if the constant is too long.
 			tkn_int_err_msg     = "Multi-character character constant.";
 			tkn_int_err_type    = E_WARN;
-			tkn_int_err_do_free = false;
 		} else if (!*strval) {
 			// Error if the constant is empty.
 			tkn_int_err_msg     = "Empty character constant.";
 			tkn_int_err_type    = E_ERROR;
-			tkn_int_err_do_free = false;
 		}
 		
 		// Turn into an int.
@@ -653,7 +973,8 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 			ival = (ival << 8) | (unsigned char) *strval;
 			strval ++;
 		}
-		yylval.ival.ival = ival;
+		tkn_lval->ival.ival = ival;
+		tkn_lval->ival.type = STYPE_S_INT;
 		DEBUG_TKN("char  '%c'\n", ival);
 		return TKN_IVAL;
 	}
@@ -666,72 +987,130 @@ static int tokenise_int(tokeniser_ctx_t *ctx, int *i0, int *x0, int *y0) {
 	DEBUG_TKN("???   '%c'\n", c);
 	tkn_int_err_msg     = "Unrecognised token.";
 	tkn_int_err_type    = E_ERROR;
-	tkn_int_err_do_free = false;
 	return TKN_GARBAGE;
 }
 
-// Grab next non-space token.
-int tokenise(tokeniser_ctx_t *ctx) {
+// Get the spelling of a keyword token, or NULL if the token is not a keyword.
+const char *tokeniser_keyword(int tkn_id) {
+	for (size_t i = 0; i < sizeof(keyw_map) / sizeof(keyw_map_t); i++) {
+		if (keyw_map[i].keyw == tkn_id) return keyw_map[i].str;
+	}
+	return NULL;
+}
+
+// Grab next non-space token, storing its value in lval instead of yylval.
+// Errors are returned through err_type and err_msg instead of being reported; err_msg is NULL if there are none.
+int tokenise_into(tokeniser_ctx_t *ctx, union YYSTYPE *lval, error_type_t *err_type, char **err_msg) {
 	// Clear error.
 	tkn_int_err_msg = NULL;
+	tkn_lval        = lval;
 	
 	// Pre-token position.
 	int i0, x0, y0;
 	// Get token data.
 	int tkn_id = tokenise_int(ctx, &i0, &x0, &y0);
+	*err_msg  = tkn_int_err_msg;
+	*err_type = tkn_int_err_type;
 	if (!tkn_id) return 0;
+	ctx->line_start = y0 != ctx->last_y;
+	ctx->last_y     = ctx->y;
 	// Post-token position.
 	int i1 = ctx->index;
-	int x1 = ctx->x;
-	int y1 = ctx->y;
 	
 	// Return token after setting pos.
-	yylval.pos = (pos_t) {
-		.filename = ctx->filename,
-		.index0   = i0,
-		.index1   = i1+1,
-		.x0       = x0,
-		.y0       = y0,
-		.x1       = x1+1,
-		.y1       = y1
+	lval->pos = (pos_t) {
+		.start = tokeniser_base(ctx) + i0 - 1,
+		.end   = tokeniser_base(ctx) + i1,
 	};
-	if (tkn_int_err_msg) {
+	return tkn_id;
+}
+
+// Move a view of a tokeniser to just after a token handed out by someone else, e.g. the preprocessor.
+// At the end of the input, when tkn_id is 0, the view is moved to where the tokeniser stopped.
+void tokeniser_view_token(tokeniser_ctx_t *view, tokeniser_ctx_t *ctx, int tkn_id, pos_t pos) {
+	srcfile_t *file = tkn_id ? srcloc_file(pos.start) : NULL;
+	if (file) {
+		view->file  = file;
+		view->index = pos.end - file->base;
+	} else {
+		view->file  = ctx->file;
+		view->index = ctx->index;
+	}
+}
+
+// Grab next non-space token.
+int tokenise(tokeniser_ctx_t *ctx) {
+	error_type_t err_type;
+	char        *err_msg;
+	int tkn_id = tokenise_into(ctx, &yylval, &err_type, &err_msg);
+	if (tkn_id && err_msg) {
 		// Report error messages.
-		report_error(ctx, tkn_int_err_type, yylval.pos, tkn_int_err_msg);
-		// Free memory if required.
-		if (tkn_int_err_do_free) free(tkn_int_err_msg);
+		report_error(ctx, err_type, yylval.pos, err_msg);
 	}
 	return tkn_id;
 }
 
-static void print_src(tokeniser_ctx_t *ctx, FILE *outfile, int line, int x0, int x1, char *col, int *outX0, int *outX1) {
+// Find the offset at which a line starts.
+// Lines not yet seen by the tokeniser are found by scanning ahead of the last known line.
+static size_t tokeniser_line_start(tokeniser_ctx_t *ctx, srcfile_t *file, int line) {
+	if (line < 1) line = 1;
+	int    known  = line;
+	size_t offset = srcfile_line_start(file, &known);
+	if (known == line) return offset;
+	
+	// Scan from the last known line start.
+	line -= known;
+	if (!file->source) {
+		// File descriptor source.
+		long pos = ftell(ctx->fd);
+		fseek(ctx->fd, offset, SEEK_SET);
+		while (line) {
+			int c = fgetc(ctx->fd);
+			if (c == EOF) break;
+			if (c == '\r') {
+				int next = fgetc(ctx->fd);
+				if (next != '\n') fseek(ctx->fd, -1, SEEK_CUR);
+				line --;
+			} else if (c == '\n') {
+				line --;
+			}
+		}
+		offset = ftell(ctx->fd);
+		fseek(ctx->fd, pos, SEEK_SET);
+	} else {
+		// C-string source.
+		while (line && offset < file->len) {
+			char c = file->source[offset++];
+			if (c == '\r') {
+				if (offset < file->len && file->source[offset] == '\n') offset ++;
+				line --;
+			} else if (c == '\n') {
+				line --;
+			}
+		}
+	}
+	return offset;
+}
+
+static void print_src(tokeniser_ctx_t *ctx, srcfile_t *file, FILE *outfile, int line, int x0, int x1, char *col, int *outX0, int *outX1) {
 	int dummy;
 	if (!outX0) outX0 = &dummy;
 	if (!outX1) outX1 = &dummy;
 	
 	int tab_size = 4;
 	
-	if (ctx->use_fd) {
+	if (!file || (!file->source && !(ctx && ctx->use_fd && ctx->file == file))) {
+		// The text of the file is no longer available.
+	} else if (!file->source) {
 		// File descriptor source.
 		// Save the stream position.
 		long pos = ftell(ctx->fd);
-		fseek(ctx->fd, 0, SEEK_SET);
 		
 		// Find the line.
-		line --;
-		while (line && !feof(ctx->fd)) {
-			char c = fgetc(ctx->fd);
-			if (c == '\r') {
-				char next = fgetc(ctx->fd);
-				if (next != '\n') fseek(ctx->fd, -1, SEEK_CUR);
-				line --;
-			} else if (c == '\n') {
-				line --;
-			}
-		}
+		long line_start = tokeniser_line_start(ctx, file, line);
+		fseek(ctx->fd, line_start, SEEK_SET);
 		
 		// Find the line's length.
-		long line_start = ftell(ctx->fd);
 		while (!feof(ctx->fd)) {
 			char c = fgetc(ctx->fd);
 			if (c == '\r' || c == '\n') {
@@ -776,28 +1155,13 @@ static void print_src(tokeniser_ctx_t *ctx, FILE *outfile, int line, int x0, int
 	} else {
 		// C-string source.
 		// Find the line.
-		char *index = ctx->source;
-		line --;
-		for (size_t i = 0; i < ctx->source_len && line; i++) {
-			char *ptr = &ctx->source[i];
-			if (*ptr == '\r') {
-				if (ptr[1] == '\n') index = ptr + 2;
-				else index = ptr + 1;
-				line --;
-			} else if (*ptr == '\n') {
-				index = ptr + 1;
-				line --;
-			}
-		}
+		const char *index = file->source + tokeniser_line_start(ctx, file, line);
+		const char *end   = file->source + file->len;
 		
 		// Find line's length.
-		char *a = strchr(index, '\r');
-		char *b = strchr(index, '\n');
-		if (b < a || !a && b) {
-			a = b;
-		} else if (!a) {
-			a = index + strlen(index);
-		}
+		// The source need not be NUL-terminated (e.g. when memory mapped).
+		const char *a = index;
+		while (a < end && *a && *a != '\r' && *a != '\n') a++;
 		
 		// Print the line.
 		int printed_x = 0;
@@ -807,16 +1171,16 @@ static void print_src(tokeniser_ctx_t *ctx, FILE *outfile, int line, int x0, int
 				fputs(col, outfile);
 				*outX0 = printed_x + 1;
 			}
-			if (c < 0x20 || c >= 0x7f) {
-				fputc(' ', outfile);
-				printed_x ++;
-			} else if (c == '\t') {
+			if (c == '\t') {
 				int error = printed_x % tab_size;
 				while (error < tab_size) {
 					fputc(' ', outfile);
 					error ++;
 					printed_x ++;
 				}
+			} else if (c < 0x20 || c >= 0x7f) {
+				fputc(' ', outfile);
+				printed_x ++;
 			} else {
 				fputc(c, outfile);
 				printed_x ++;
@@ -841,6 +1205,9 @@ static void print_pos_range(int x0, int x1) {
 	fputc('\n', stderr);
 }
  
+// Number of errors reported so far, not counting warnings and notes.
+size_t report_error_count = 0;
+
 void report_error(tokeniser_ctx_t *tokeniser_ctx, error_type_t e_type, pos_t pos, char *message) {
 	char *col  = "\033[91m";
 	char *type = "error";
@@ -848,9 +1215,11 @@ void report_error(tokeniser_ctx_t *tokeniser_ctx, error_type_t e_type, pos_t pos
 	switch (e_type) {
 		case E_ERROR:
 		default:
+			report_error_count ++;
 			break;
 		case E_SYNTAX:
 			type = "syntax error";
+			report_error_count ++;
 			break;
 		case E_WARN:
 			type = "warning";
@@ -862,11 +1231,12 @@ void report_error(tokeniser_ctx_t *tokeniser_ctx, error_type_t e_type, pos_t pos
 			break;
 	}
 	
+	pos_info_t info = pos_decode(pos);
 	fflush(stdout);
-	fprintf(stderr, "in %s:%d:%d %s%s:\033[0m %s\n", pos.filename, pos.y0, pos.x0, col, type, message);
-	fprintf(stderr, "%5d | ", pos.y0);
-	int offset0 = pos.x0, offset1 = pos.x1;
-	print_src(tokeniser_ctx, stderr, pos.y0, pos.x0, pos.x1, col, &offset0, &offset1);
+	fprintf(stderr, "in %s:%d:%d %s%s:\033[0m %s\n", info.filename, info.y0, info.x0, col, type, message);
+	fprintf(stderr, "%5d | ", info.y0);
+	int offset0 = info.x0, offset1 = info.x1;
+	print_src(tokeniser_ctx, srcloc_file(pos.start), stderr, info.y0, info.x0, info.x1, col, &offset0, &offset1);
 	fprintf(stderr, "      | ");
 	fputs(col, stderr);
 	print_pos_range(offset0, offset1);
@@ -876,5 +1246,5 @@ void report_error(tokeniser_ctx_t *tokeniser_ctx, error_type_t e_type, pos_t pos
 
 // Prints a numbered line of the source code.
 void print_line(tokeniser_ctx_t *ctx, int line) {
-	print_src(ctx, stdout, line, 0, 65535, "", NULL, NULL);
+	print_src(ctx, ctx->file, stdout, line, 0, 65535, "", NULL, NULL);
 }
@@ -4,9 +4,12 @@
 
 struct tokeniser_ctx;
 struct pos;
+struct pos_info;
+union YYSTYPE;
 
 typedef struct tokeniser_ctx tokeniser_ctx_t;
 typedef struct pos pos_t;
+typedef struct pos_info pos_info_t;
 
 typedef enum {
 	E_ERROR,
@@ -19,39 +22,66 @@ typedef enum {
 #include <stdlib.h>
 #include <stdbool.h>
 #include "ctxalloc.h"
+#include "location.h"
 
-// Contins position information for tokens.
-// Both 'filename' and 'y' can be changed by #line statements.
+// Contains position information for tokens.
+// Encoded as a range in the global location space, see location.h.
 struct pos {
+	srcloc_t start, end;
+};
+
+// Contains decoded position information, used for diagnostics and line numbers.
+struct pos_info {
 	char *filename;
 	int x0, y0;
 	int x1, y1;
-	size_t index0, index1;
 };
 
 // Contains info required to tokenise a source file.
 struct tokeniser_ctx {
-	// Filename.
-	char      *filename;
+	// Source file in the location space, which also holds the filename.
+	// NULL for scratch contexts, which borrow their source and allocator.
+	srcfile_t  *file;
 	// For raw string inputs.
 	char       *source;
 	size_t      source_len;
+	// Whether source belongs to someone else and outlives the context.
+	bool        borrowed;
+	// Whether source is a memory mapping of the input file.
+	bool        use_mmap;
 	// For file descriptor inputs.
 	FILE       *fd;
 	bool        use_fd;
 	// Current position.
 	size_t      index;
 	int         x, y;
+	// Whether '#' starts a preprocessor directive instead of a line comment.
+	bool        directives;
+	// Whether the last token was the first on its line.
+	bool        line_start;
+	// Line the last token ended on.
+	int         last_y;
 	// Allocation context to use for e.g. strings.
 	alloc_ctx_t allocator;
+	// Current block of the string slab, which string literals are stored in.
+	char       *str_slab;
+	size_t      str_slab_len, str_slab_cap;
 };
 
 #include <parser-util.h>
 
+// Merge two positions into one spanning both.
 pos_t pos_merge(pos_t one, pos_t two);
+// Location of the start of the tokeniser's source; 0 for scratch contexts.
+srcloc_t tokeniser_base(tokeniser_ctx_t *ctx);
+// Empty position at the last character read.
 pos_t pos_empty(tokeniser_ctx_t *ctx);
+// Decode a position into filename, lines and columns.
+pos_info_t pos_decode(pos_t pos);
 // void  print_pos(tokeniser_ctx_t *ctx, pos_t pos);
 void  report_error(tokeniser_ctx_t *ctx, error_type_t type, pos_t pos, char *message);
+// Number of errors reported so far, not counting warnings and notes.
+extern size_t report_error_count;
 // Prints a numbered line of the source code.
 void print_line(tokeniser_ctx_t *ctx, int lineno);
 
@@ -65,8 +95,20 @@ void print_line(tokeniser_ctx_t *ctx, int lineno);
 
 // Initialise a context, given c-string.
 void tokeniser_init_cstr(tokeniser_ctx_t *ctx, char *raw);
+// Initialise a context, given a buffer that outlives the context.
+// The buffer need not be NUL-terminated.
+void tokeniser_init_buf(tokeniser_ctx_t *ctx, const char *buf, size_t len);
+// Initialise a scratch context for a short buffer that isn't a source file, e.g. the result of token pasting.
+// Nothing is added to the location space, so token positions are offsets into the buffer.
+// The buffer and the allocation context must outlive the context.
+void tokeniser_init_scratch(tokeniser_ctx_t *ctx, const char *buf, size_t len, alloc_ctx_t allocator);
 // Initialise a context, given a file descriptor.
+// Files that can't be measured up front, like pipes, are read into memory instead.
 void tokeniser_init_file(tokeniser_ctx_t *ctx, FILE *file);
+// Initialise a context, given a file descriptor, buffering the entire file in memory.
+// Regular files are memory mapped, other files (e.g. pipes) are read into a buffer.
+// Returns false if the file could not be read.
+bool tokeniser_init_mapped(tokeniser_ctx_t *ctx, FILE *file);
 // Clean up a tokeniser context.
 void tokeniser_destroy(tokeniser_ctx_t *ctx);
 
@@ -81,6 +123,9 @@ bool is_hexadecimal(char c);
 
 // Read a single character.
 char tokeniser_readchar(tokeniser_ctx_t *ctx);
+// Move forward n characters in a memory-resident source, keeping track of lines.
+// A carriage return at the end is consumed along with the line feed after it, if any.
+void tokeniser_advance(tokeniser_ctx_t *ctx, size_t n);
 // Next character.
 // Identical to tokeniser_nextchar_no(0).
 char tokeniser_nextchar(tokeniser_ctx_t *ctx);
@@ -88,9 +133,18 @@ char tokeniser_nextchar(tokeniser_ctx_t *ctx);
 char tokeniser_nextchar_no(tokeniser_ctx_t *ctx, int no);
 
 // Unescape an escaped c-string.
+// The string lives in the string slab until the context is destroyed and must not be freed.
 char *tokeniser_getstr(tokeniser_ctx_t *ctx, char term);
 
 // Grab next non-space token.
 int tokenise(tokeniser_ctx_t *ctx);
+// Move a view of a tokeniser to just after a token handed out by someone else, e.g. the preprocessor.
+// At the end of the input, when tkn_id is 0, the view is moved to where the tokeniser stopped.
+void tokeniser_view_token(tokeniser_ctx_t *view, tokeniser_ctx_t *ctx, int tkn_id, pos_t pos);
+// Get the spelling of a keyword token, or NULL if the token is not a keyword.
+const char *tokeniser_keyword(int tkn_id);
+// Grab next non-space token, storing its value in lval instead of yylval.
+// Errors are returned through err_type and err_msg instead of being reported; err_msg is NULL if there are none.
+int tokenise_into(tokeniser_ctx_t *ctx, union YYSTYPE *lval, error_type_t *err_type, char **err_msg);
 
 #endif // TOKENISER_H
@@ -4,6 +4,10 @@
 #include "ctxalloc.h"
 #include <malloc.h>
 #include <stdlib.h>
+#include <stdio.h>
+#ifdef CTXALLOC_STATS
+#include "sync.h"
+#endif
 
 #define ALLOC_BIT_MAGIC1 0x536018e5280f35adLLU
 #define ALLOC_BIT_MAGIC2 0x4839678fcf3d0596LLU
@@ -12,6 +16,12 @@
 
 alloc_ctx_t global_alloc = NULL;
 
+#ifdef DEBUG_COMPILER
+// Number of allocations and re-allocations made by the current thread, for benchmarks.
+_Thread_local size_t alloc_thread_count = 0;
+#endif
+
+#ifdef CTXALLOC_CHECKED
 // Checks the magic values for a alloc bit.
 static inline bool alloc_bit_magic_check(alloc_bit_t *bit) {
 	return bit->magic1 == ALLOC_BIT_MAGIC1 && bit->magic2 == ALLOC_BIT_MAGIC2;
@@ -77,10 +87,234 @@ static bool alloc_is_child(alloc_ctx_t parent, alloc_ctx_t child) {
 	} while(0)
 #endif
 
+#else //CTXALLOC_CHECKED
+
+#define ALLOC_BIT_MAGIC_ASSERT(bit) do {} while(0)
+#define ALLOC_CTX_MAGIC_ASSERT(ctx) do {} while(0)
+#define ALLOC_BIT_OWNER_ASSERT(bit, ctx) do {} while(0)
+
+#endif //CTXALLOC_CHECKED
+
+#ifdef CTXALLOC_STATS
+// Number of call sites shown per context by alloc_stats_dump.
+#define ALLOC_STATS_SITES 3
+
+// Guards allocation statistics and the tree of contexts.
+static pthread_mutex_t alloc_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Count bytes allocated and freed on a context.
+static void alloc_stats_live(alloc_ctx_t ctx, size_t added, size_t removed) {
+	sync_lock(&alloc_stats_mutex);
+	ctx->stats.live = ctx->stats.live + added - removed;
+	if (ctx->stats.live > ctx->stats.peak) ctx->stats.peak = ctx->stats.live;
+	sync_unlock(&alloc_stats_mutex);
+}
+
+// Count bytes an arena took from malloc.
+static void alloc_stats_reserve(alloc_ctx_t ctx, size_t added) {
+	sync_lock(&alloc_stats_mutex);
+	ctx->stats.reserved += added;
+	sync_unlock(&alloc_stats_mutex);
+}
+
+// Find the slot for a call site in a table of sites_cap slots, which must not be full.
+// Returns either the slot with the tag or the empty slot where it belongs.
+static alloc_site_t *alloc_stats_slot(alloc_site_t *sites, size_t sites_cap, const char *tag) {
+	size_t mask = sites_cap - 1;
+	size_t i    = ((uintptr_t) tag >> 3) * 0x9E3779B97F4A7C15ull >> 32 & mask;
+	while (sites[i].tag && sites[i].tag != tag) i = (i + 1) & mask;
+	return &sites[i];
+}
+
+// Add calls from a call site to statistics.
+// Tags are string constants, so each call site has one tag pointer, which is hashed to find the site.
+static void alloc_stats_site(alloc_stats_t *stats, const char *tag, size_t calls, size_t bytes) {
+	if (!tag) tag = "?";
+	if (stats->sites_len * 2 >= stats->sites_cap) {
+		// Keep the table at most half full.
+		size_t        cap   = stats->sites_cap ? stats->sites_cap * 2 : 16;
+		alloc_site_t *sites = calloc(cap, sizeof(alloc_site_t));
+		for (size_t i = 0; i < stats->sites_cap; i++) {
+			if (stats->sites[i].tag) *alloc_stats_slot(sites, cap, stats->sites[i].tag) = stats->sites[i];
+		}
+		free(stats->sites);
+		stats->sites     = sites;
+		stats->sites_cap = cap;
+	}
+	alloc_site_t *site = alloc_stats_slot(stats->sites, stats->sites_cap, tag);
+	if (!site->tag) {
+		*site = (alloc_site_t) {
+			.tag   = tag,
+			.calls = 0,
+			.bytes = 0,
+		};
+		stats->sites_len ++;
+	}
+	site->calls += calls;
+	site->bytes += bytes;
+}
+
+// Count an allocation or re-allocation made on a context.
+static void alloc_stats_call(alloc_ctx_t ctx, const char *tag, size_t size, bool is_realloc) {
+	sync_lock(&alloc_stats_mutex);
+	if (is_realloc) ctx->stats.reallocs ++;
+	else            ctx->stats.allocs   ++;
+	alloc_stats_site(&ctx->stats, tag, 1, size);
+	sync_unlock(&alloc_stats_mutex);
+}
+
+// Add the statistics of a destroyed context to those of it's parent.
+// Must be called with alloc_stats_mutex held.
+static void alloc_stats_retire(alloc_ctx_t parent, alloc_stats_t *stats) {
+	const char *name = stats->name ? stats->name : "unnamed";
+	
+	// Find destroyed contexts with the same name.
+	alloc_stats_t *ent = NULL;
+	for (size_t i = 0; i < parent->retired_len; i++) {
+		if (!strcmp(parent->retired[i].name, name)) {
+			ent = &parent->retired[i];
+			break;
+		}
+	}
+	if (!ent) {
+		if (parent->retired_len >= parent->retired_cap) {
+			parent->retired_cap = parent->retired_cap ? parent->retired_cap * 2 : 4;
+			parent->retired     = realloc(parent->retired, sizeof(alloc_stats_t) * parent->retired_cap);
+		}
+		ent  = &parent->retired[parent->retired_len++];
+		*ent = (alloc_stats_t) {
+			.name = name,
+		};
+	}
+	
+	// Peaks are those of the biggest context.
+	ent->n_ctx    += stats->n_ctx;
+	ent->allocs   += stats->allocs;
+	ent->reallocs += stats->reallocs;
+	if (stats->peak     > ent->peak)     ent->peak     = stats->peak;
+	if (stats->reserved > ent->reserved) ent->reserved = stats->reserved;
+	for (size_t i = 0; i < stats->sites_cap; i++) {
+		if (!stats->sites[i].tag) continue;
+		alloc_stats_site(ent, stats->sites[i].tag, stats->sites[i].calls, stats->sites[i].bytes);
+	}
+	free(stats->sites);
+}
+
+// Link a new context into the tree of contexts.
+static void alloc_stats_link(alloc_ctx_t ctx) {
+	ctx->stats = (alloc_stats_t) {
+		.n_ctx = 1,
+	};
+	if (!ctx->parent) return;
+	sync_lock(&alloc_stats_mutex);
+	ctx->next_sibling = ctx->parent->first_child;
+	if (ctx->next_sibling) ctx->next_sibling->prev_sibling = ctx;
+	ctx->parent->first_child = ctx;
+	sync_unlock(&alloc_stats_mutex);
+}
+
+// Unlink a context that is about to be destroyed, keeping it's statistics in the parent.
+static void alloc_stats_unlink(alloc_ctx_t ctx) {
+	sync_lock(&alloc_stats_mutex);
+	alloc_ctx_t parent = ctx->parent;
+	
+	// Children are adopted by the parent.
+	while (ctx->first_child) {
+		alloc_ctx_t child = ctx->first_child;
+		ctx->first_child  = child->next_sibling;
+		child->parent       = parent;
+		child->prev_sibling = NULL;
+		child->next_sibling = parent ? parent->first_child : NULL;
+		if (child->next_sibling) child->next_sibling->prev_sibling = child;
+		if (parent) parent->first_child = child;
+	}
+	
+	if (parent) {
+		if (ctx->prev_sibling) ctx->prev_sibling->next_sibling = ctx->next_sibling;
+		else parent->first_child = ctx->next_sibling;
+		if (ctx->next_sibling) ctx->next_sibling->prev_sibling = ctx->prev_sibling;
+		
+		// Destroyed contexts are remembered by name.
+		alloc_stats_retire(parent, &ctx->stats);
+		for (size_t i = 0; i < ctx->retired_len; i++) {
+			alloc_stats_retire(parent, &ctx->retired[i]);
+		}
+	} else {
+		free(ctx->stats.sites);
+		for (size_t i = 0; i < ctx->retired_len; i++) {
+			free(ctx->retired[i].sites);
+		}
+	}
+	free(ctx->retired);
+	sync_unlock(&alloc_stats_mutex);
+}
+
+// Sort call sites by the number of bytes asked for, most first.
+static int alloc_site_cmp(const void *a, const void *b) {
+	size_t x = ((const alloc_site_t *) a)->bytes;
+	size_t y = ((const alloc_site_t *) b)->bytes;
+	return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Print the statistics of one context, or of destroyed contexts with the same name.
+static void alloc_stats_print(alloc_stats_t *stats, int depth, bool retired) {
+	printf("%*s%s", depth * 2, "", stats->name ? stats->name : "unnamed");
+	if (retired) printf(" (%zu destroyed)", stats->n_ctx);
+	printf(": peak %zu, live %zu, %zu allocs, %zu reallocs", stats->peak, stats->live, stats->allocs, stats->reallocs);
+	if (stats->reserved) printf(", %zu reserved", stats->reserved);
+	printf("\n");
+	
+	// Show the call sites that asked for the most memory.
+	// They are sorted in a copy, as the table must stay usable for later allocations.
+	alloc_site_t *sites = malloc(sizeof(alloc_site_t) * (stats->sites_len + 1));
+	size_t        len   = 0;
+	for (size_t i = 0; i < stats->sites_cap; i++) {
+		if (stats->sites[i].tag) sites[len++] = stats->sites[i];
+	}
+	qsort(sites, len, sizeof(alloc_site_t), alloc_site_cmp);
+	for (size_t i = 0; i < len && i < ALLOC_STATS_SITES; i++) {
+		printf("%*s  %zu bytes in %zu calls at %s\n", depth * 2, "", sites[i].bytes, sites[i].calls, sites[i].tag);
+	}
+	free(sites);
+}
+
+// Print the statistics of a context and everything below it.
+static void alloc_stats_print_tree(alloc_ctx_t ctx, int depth) {
+	alloc_stats_print(&ctx->stats, depth, false);
+	for (alloc_ctx_t child = ctx->first_child; child; child = child->next_sibling) {
+		alloc_stats_print_tree(child, depth + 1);
+	}
+	for (size_t i = 0; i < ctx->retired_len; i++) {
+		alloc_stats_print(&ctx->retired[i], depth + 1, true);
+	}
+}
+
+// Prints the allocation statistics of all contexts, as a tree starting at global_alloc.
+// Destroyed contexts are listed by name under their parent.
+void alloc_stats_dump() {
+	sync_lock(&alloc_stats_mutex);
+	printf("Allocation statistics (bytes):\n");
+	alloc_stats_print_tree(global_alloc, 1);
+	sync_unlock(&alloc_stats_mutex);
+}
+
+#else //CTXALLOC_STATS
+
+#define alloc_stats_live(ctx, added, removed)          do {} while(0)
+#define alloc_stats_reserve(ctx, added)                do {} while(0)
+#define alloc_stats_call(ctx, tag, size, is_realloc)   do {} while(0)
+#define alloc_stats_link(ctx)                          do {} while(0)
+#define alloc_stats_unlink(ctx)                        do {} while(0)
+
+#endif //CTXALLOC_STATS
+
 
 // Initialises the alloc system thingy.
 void alloc_init() {
-	if (!global_alloc) global_alloc = alloc_create(ALLOC_NO_PARENT);
+	if (!global_alloc) {
+		global_alloc = alloc_create(ALLOC_NO_PARENT);
+		alloc_set_name(global_alloc, "global");
+	}
 }
 
 
@@ -93,30 +327,68 @@ alloc_ctx_t alloc_create(alloc_ctx_t parent) {
 	// Create a new struct.
 	alloc_ctx_t ctx = malloc(sizeof(alloc_ctx_s));
 	*ctx = (alloc_ctx_s) {
-		.magic1 = ALLOC_CTX_MAGIC1,
-		.parent = parent,
-		.first  = NULL,
-		.magic2 = ALLOC_CTX_MAGIC2,
+#ifdef CTXALLOC_CHECKED
+		.magic1     = ALLOC_CTX_MAGIC1,
+#endif
+		.parent     = parent,
+		.bits       = { .prev = &ctx->bits, .next = &ctx->bits },
+		.chunk_size = 0,
+		.chunk      = NULL,
+#ifdef CTXALLOC_CHECKED
+		.magic2     = ALLOC_CTX_MAGIC2,
+#endif
 	};
+	alloc_stats_link(ctx);
+	return ctx;
+}
+
+// Creates a new memory allocation context that allocates from chunks of at least chunk_size bytes.
+// Only the most recent allocation in an arena can be freed or grown in place;
+// other memory is freed all at once by alloc_clear or alloc_destroy.
+alloc_ctx_t alloc_create_arena(alloc_ctx_t parent, size_t chunk_size) {
+	alloc_ctx_t ctx = alloc_create(parent);
+	ctx->chunk_size = chunk_size ? chunk_size : ALLOC_ARENA_CHUNK;
 	return ctx;
 }
 
+// Sets the name of a context, as shown in allocation statistics.
+void alloc_set_name(alloc_ctx_t ctx, const char *name) {
+#ifdef CTXALLOC_STATS
+	ctx->stats.name = name;
+#endif
+}
+
 // Frees all memory of the context, recursively.
 void alloc_clear(alloc_ctx_t ctx) {
 	// Assert the context is valid.
 	ALLOC_CTX_MAGIC_ASSERT(ctx);
 	
+	// Arenas free their chunks.
+	alloc_chunk_t *chunk = ctx->chunk;
+	while (chunk) {
+		alloc_chunk_t *prev = chunk->prev;
+		free(chunk);
+		chunk = prev;
+	}
+	ctx->chunk = NULL;
+	
 	// Iterate over ALL the things.
-	alloc_bit_t *bit = ctx->first;
-	while (bit) {
+	alloc_bit_t *bit = ctx->bits.next;
+	while (bit != &ctx->bits) {
 		void *mem = bit;
+#ifdef CTXALLOC_CHECKED
 		bit->magic1 = 0;
 		bit->magic2 = 0;
+#endif
 		bit = bit->next;
 		free(mem);
 	}
-	ctx->first = NULL;
-	ctx->last  = NULL;
+	ctx->bits.prev = &ctx->bits;
+	ctx->bits.next = &ctx->bits;
+	
+#ifdef CTXALLOC_STATS
+	alloc_stats_live(ctx, 0, ctx->stats.live);
+#endif
 }
 
 // Frees all memory of the context and destroys the context.
@@ -125,19 +397,122 @@ void alloc_destroy(alloc_ctx_t ctx) {
 	ALLOC_CTX_MAGIC_ASSERT(ctx);
 	// Clear out the context.
 	alloc_clear(ctx);
+	alloc_stats_unlink(ctx);
+#ifdef CTXALLOC_CHECKED
 	ctx->magic1 = 0;
 	ctx->magic2 = 0;
+#endif
 	// Free the memory.
 	free(ctx);
 }
 
 
+// Allocates memory from an arena.
+static void *alloc_on_arena(alloc_ctx_t ctx, size_t size) {
+	// Keep every allocation aligned.
+	size = (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+	
+	alloc_chunk_t *chunk = ctx->chunk;
+	if (!chunk || chunk->size - chunk->used < size) {
+		// Get a new chunk; large allocations get one of their own.
+		size_t cap = size > ctx->chunk_size ? size : ctx->chunk_size;
+#ifdef DEBUG_COMPILER
+		alloc_thread_count ++;
+#endif
+		alloc_chunk_t *fresh = malloc(sizeof(alloc_chunk_t) + cap);
+		if (!fresh) return NULL;
+		fresh->size = cap;
+		fresh->used = 0;
+		fresh->last = 0;
+		alloc_stats_reserve(ctx, cap);
+		if (chunk && cap > ctx->chunk_size) {
+			// Keep allocating from the current chunk afterwards.
+			fresh->prev = chunk->prev;
+			chunk->prev = fresh;
+		} else {
+			fresh->prev = chunk;
+			ctx->chunk  = fresh;
+		}
+		chunk = fresh;
+	}
+	
+	void *ptr = chunk->data + chunk->used;
+	chunk->last  = chunk->used;
+	chunk->used += size;
+	alloc_stats_live(ctx, size, 0);
+	return ptr;
+}
+
+// Finds the arena chunk some memory is in.
+// Empty allocations are only found if they were the most recent in their chunk.
+static alloc_chunk_t *arena_find_chunk(alloc_ctx_t ctx, void *memory) {
+	for (alloc_chunk_t *chunk = ctx->chunk; chunk; chunk = chunk->prev) {
+		char *mem = memory;
+		if (mem >= chunk->data && (mem < chunk->data + chunk->used || mem == chunk->data + chunk->last)) {
+			return chunk;
+		}
+	}
+	return NULL;
+}
+
+// Re-allocates memory from an arena.
+// The most recent allocation is resized in place if it fits,
+// otherwise the old memory stays allocated until the arena is cleared.
+static void *realloc_on_arena(alloc_ctx_t ctx, void *memory, size_t size) {
+	// Find the chunk the memory is in; the object can't extend beyond it.
+	alloc_chunk_t *chunk = arena_find_chunk(ctx, memory);
+	if (!chunk) {
+		// Copying would read memory of unknown size, so this is fatal even in release builds.
+		fflush(stdout);
+		fprintf(stderr, "\033[1m%s:%d: \033[91mfatal error:\033[0m Allocated memory does not belong to given context (%p to %p)\n", __FILE__, __LINE__, memory, ctx);
+		fprintf(stderr, "\033[1;91mAborting!\n");
+		fflush(stderr);
+		abort();
+	}
+	size_t avail = chunk->data + chunk->used - (char *) memory;
+	
+	if ((char *) memory == chunk->data + chunk->last) {
+		// The most recent allocation can simply be resized.
+		size_t aligned = (size + _Alignof(max_align_t) - 1) & ~(_Alignof(max_align_t) - 1);
+		if (aligned <= chunk->size - chunk->last) {
+			alloc_stats_live(ctx, aligned, chunk->used - chunk->last);
+			chunk->used = chunk->last + aligned;
+			return memory;
+		}
+	}
+	
+	void *newmem = alloc_on_arena(ctx, size);
+	if (!newmem) return NULL;
+	memcpy(newmem, memory, avail < size ? avail : size);
+	return newmem;
+}
+
+// Frees memory from an arena.
+// Only the most recent allocation in the current chunk is actually freed.
+static void free_on_arena(alloc_ctx_t ctx, void *memory) {
+	alloc_chunk_t *chunk = ctx->chunk;
+	if (chunk && (char *) memory == chunk->data + chunk->last && chunk->last < chunk->used) {
+		alloc_stats_live(ctx, 0, chunk->used - chunk->last);
+		chunk->used = chunk->last;
+	}
+}
+
 // Allocates memory belonging to a context.
 void *alloc_on_ctx(alloc_ctx_t ctx, size_t size) {
+	return alloc_on_ctx_at(ctx, size, NULL);
+}
+
+// Allocates memory belonging to a context, made from the call site tag.
+void *alloc_on_ctx_at(alloc_ctx_t ctx, size_t size, const char *tag) {
 	// Assert the context is valid.
 	ALLOC_CTX_MAGIC_ASSERT(ctx);
+	alloc_stats_call(ctx, tag, size, false);
+	if (ctx->chunk_size) return alloc_on_arena(ctx, size);
 	
 	// Try to get some memory, yes?
+#ifdef DEBUG_COMPILER
+	alloc_thread_count ++;
+#endif
 	void *newmem = malloc(sizeof(alloc_bit_t) + size);
 	if (!newmem) return NULL;
 	
@@ -145,23 +520,24 @@ void *alloc_on_ctx(alloc_ctx_t ctx, size_t size) {
 	alloc_bit_t *bit = newmem;
 	void        *ptr = (void *) ((size_t) newmem + sizeof(alloc_bit_t));
 	*bit = (alloc_bit_t) {
+#ifdef CTXALLOC_CHECKED
 		.magic1 = ALLOC_BIT_MAGIC1,
-		.owner  = ctx,
 		.magic2 = ALLOC_BIT_MAGIC2,
+#endif
+#if defined(CTXALLOC_CHECKED) || defined(CTXALLOC_STATS)
+		.owner  = ctx,
+#endif
+#ifdef CTXALLOC_STATS
+		.size   = size,
+#endif
+		.prev   = ctx->bits.prev,
+		.next   = &ctx->bits,
 	};
 	
-	// Set up next and prev pointers.
-	if (!ctx->first) {
-		ctx->first      = bit;
-		bit->prev       = NULL;
-	}
-	if (!ctx->last) {
-		bit->next       = NULL;
-	} else {
-		ctx->last->next = bit;
-		bit->prev       = ctx->last;
-	}
-	ctx->last       = bit;
+	// Link it in at the end.
+	bit->prev->next = bit;
+	ctx->bits.prev  = bit;
+	alloc_stats_live(ctx, size, 0);
 	
 	// Return the allocated memory.
 	return ptr;
@@ -169,6 +545,11 @@ void *alloc_on_ctx(alloc_ctx_t ctx, size_t size) {
 
 // Re-allocates memory belonging to a context.
 void *realloc_on_ctx(alloc_ctx_t ctx, void *memory, size_t size) {
+	return realloc_on_ctx_at(ctx, memory, size, NULL);
+}
+
+// Re-allocates memory belonging to a context, made from the call site tag.
+void *realloc_on_ctx_at(alloc_ctx_t ctx, void *memory, size_t size, const char *tag) {
 	// Assert the context is valid.
 	ALLOC_CTX_MAGIC_ASSERT(ctx);
 	
@@ -178,7 +559,11 @@ void *realloc_on_ctx(alloc_ctx_t ctx, void *memory, size_t size) {
 		return NULL;
 	} else if (!memory) {
 		// If memory is NULL then allocate instead.
-		return alloc_on_ctx(ctx, size);
+		return alloc_on_ctx_at(ctx, size, tag);
+	}
+	alloc_stats_call(ctx, tag, size, true);
+	if (ctx->chunk_size) {
+		return realloc_on_arena(ctx, memory, size);
 	}
 	
 	// Magic checks.
@@ -187,12 +572,23 @@ void *realloc_on_ctx(alloc_ctx_t ctx, void *memory, size_t size) {
 	// Assert the bit is owned by the given context.
 	ALLOC_BIT_OWNER_ASSERT((alloc_bit_t *) realmem, ctx);
 	// Re-allocate the memory.
+#ifdef DEBUG_COMPILER
+	alloc_thread_count ++;
+#endif
+#ifdef CTXALLOC_STATS
+	size_t old_size = ((alloc_bit_t *) realmem)->size;
+#endif
 	void *newmem = realloc(realmem, size + sizeof(alloc_bit_t));
 	if (!newmem) {
 		// No extra memory for you!
 		// Pointers remain valid.
 		return NULL;
-	} else if (newmem == realmem) {
+	}
+#ifdef CTXALLOC_STATS
+	((alloc_bit_t *) newmem)->size = size;
+	alloc_stats_live(((alloc_bit_t *) newmem)->owner, size, old_size);
+#endif
+	if (newmem == realmem) {
 		// No need to fix pointers.
 		void *ptr = (void *) ((size_t) newmem + sizeof(alloc_bit_t));
 		return ptr;
@@ -200,17 +596,8 @@ void *realloc_on_ctx(alloc_ctx_t ctx, void *memory, size_t size) {
 	
 	// Fix next and prev pointers.
 	alloc_bit_t *bit = newmem;
-	ctx = bit->owner;
-	if (bit->prev) {
-		bit->prev->next = bit;
-	} else {
-		ctx->first = bit;
-	}
-	if (bit->next) {
-		bit->next->prev = bit;
-	} else {
-		ctx->last = bit;
-	}
+	bit->prev->next = bit;
+	bit->next->prev = bit;
 	
 	// Return usable memory.
 	void *ptr = (void *) ((size_t) newmem + sizeof(alloc_bit_t));
@@ -224,6 +611,11 @@ void free_on_ctx(alloc_ctx_t ctx, void *memory) {
 	
 	// Ignore free of null.
 	if (!memory) return;
+	// Arenas free everything at once.
+	if (ctx->chunk_size) {
+		free_on_arena(ctx, memory);
+		return;
+	}
 	
 	// Check magic values.
 	void *realmem = (void *) ((size_t) memory - sizeof(alloc_bit_t));
@@ -231,23 +623,19 @@ void free_on_ctx(alloc_ctx_t ctx, void *memory) {
 	alloc_bit_t *bit = realmem;
 	// Assert the bit is owned by the given context.
 	ALLOC_BIT_OWNER_ASSERT(bit, ctx);
-	ctx = bit->owner;
 	
 	// Unlink the bit.
-	if (bit->prev) {
-		bit->prev->next = bit->next;
-	} else {
-		ctx->first = bit->next;
-	}
-	if (bit->next) {
-		bit->next->prev = bit->prev;
-	} else {
-		ctx->last = bit->prev;
-	}
+	bit->prev->next = bit->next;
+	bit->next->prev = bit->prev;
+#ifdef CTXALLOC_STATS
+	alloc_stats_live(bit->owner, 0, bit->size);
+#endif
 	
+#ifdef CTXALLOC_CHECKED
 	// Protect against double free.
 	bit->magic1 = 0;
 	bit->magic2 = 0;
+#endif
 	
 	// Free the memory.
 	free(realmem);
@@ -7,29 +7,105 @@
 #include <stdbool.h>
 #include <string.h>
 
+// Define CTXALLOC_CHECKED to give every context and allocation magic values and an owner,
+// so that corrupted pointers and memory freed on the wrong context are detected.
+// Define CTXALLOC_STATS to keep allocation statistics per context and per call site, see alloc_stats_dump.
+
 #ifdef CTXALLOC_C
 
 struct alloc_bit;
+struct alloc_chunk;
 struct alloc_ctx;
-
-typedef struct alloc_bit  alloc_bit_t;
-typedef struct alloc_ctx  alloc_ctx_s;
-typedef struct alloc_ctx *alloc_ctx_t;
-
+struct alloc_site;
+struct alloc_stats;
+
+typedef struct alloc_bit   alloc_bit_t;
+typedef struct alloc_chunk alloc_chunk_t;
+typedef struct alloc_ctx   alloc_ctx_s;
+typedef struct alloc_ctx  *alloc_ctx_t;
+typedef struct alloc_site  alloc_site_t;
+typedef struct alloc_stats alloc_stats_t;
+
+// Header in front of every allocation outside of arenas.
+// Allocations of a context form a circular list through the context's sentinel.
 struct alloc_bit {
+#ifdef CTXALLOC_CHECKED
 	uint64_t     magic1;
+#endif
+#if defined(CTXALLOC_CHECKED) || defined(CTXALLOC_STATS)
 	alloc_ctx_t  owner;
+#endif
 	alloc_bit_t *prev;
 	alloc_bit_t *next;
+#ifdef CTXALLOC_STATS
+	size_t       size;
+#endif
+#ifdef CTXALLOC_CHECKED
 	uint64_t     magic2;
+#endif
+};
+
+// One chunk of memory of an arena.
+struct alloc_chunk {
+	alloc_chunk_t *prev;
+	size_t         size;
+	size_t         used;
+	// Offset of the most recent allocation, which can be freed or resized in place.
+	size_t         last;
+	_Alignas(max_align_t) char data[];
+};
+
+#ifdef CTXALLOC_STATS
+// Allocations made from one call site.
+struct alloc_site {
+	// File and line of the call site.
+	const char    *tag;
+	// Number of allocations and re-allocations made.
+	size_t         calls;
+	// Total number of bytes asked for.
+	size_t         bytes;
+};
+
+// Allocation statistics of a context, or of all destroyed children of a context with the same name.
+struct alloc_stats {
+	const char    *name;
+	// Number of contexts these are the statistics of.
+	size_t         n_ctx;
+	// Bytes currently allocated and the most that were ever allocated at once.
+	size_t         live, peak;
+	// Arenas: bytes taken from malloc for chunks, in total.
+	size_t         reserved;
+	// Number of allocations and re-allocations.
+	size_t         allocs, reallocs;
+	// Call sites that allocated on the context, as an open-addressing table of sites_cap slots.
+	// Empty slots have no tag.
+	alloc_site_t  *sites;
+	size_t         sites_len, sites_cap;
 };
+#endif
 
 struct alloc_ctx {
-	uint64_t     magic1;
-	alloc_ctx_t  parent;
-	alloc_bit_t *first;
-	alloc_bit_t *last;
-	uint64_t     magic2;
+#ifdef CTXALLOC_CHECKED
+	uint64_t       magic1;
+#endif
+	alloc_ctx_t    parent;
+	// Sentinel of the list of allocations; empty if it links to itself.
+	alloc_bit_t    bits;
+	// Arenas: minimum chunk size, or 0 if this is not an arena.
+	size_t         chunk_size;
+	// Arenas: the chunk being allocated from, which links to the older ones.
+	alloc_chunk_t *chunk;
+#ifdef CTXALLOC_STATS
+	alloc_stats_t  stats;
+	// Contexts that have this one as parent.
+	alloc_ctx_t    first_child, next_sibling, prev_sibling;
+	// Statistics of destroyed children, by name.
+	alloc_stats_t *retired;
+	size_t         retired_len, retired_cap;
+#endif
+#ifdef CTXALLOC_CHECKED
+	uint64_t       magic2;
+#endif
 };
 
 #else //CTXALLOC_C
@@ -40,13 +116,32 @@ typedef void *alloc_ctx_t;
 
 extern alloc_ctx_t global_alloc;
 
+#ifdef DEBUG_COMPILER
+// Number of allocations and re-allocations made by the current thread, for benchmarks.
+extern _Thread_local size_t alloc_thread_count;
+#endif
+
 #define ALLOC_NO_PARENT ((void *) 0)
+// Call site of an allocation, as recorded in allocation statistics.
+#define ALLOC_TAG (__FILE__ ":" ALLOC_STRINGIFY(__LINE__))
+#define ALLOC_STRINGIFY(x)  ALLOC_STRINGIFY_(x)
+#define ALLOC_STRINGIFY_(x) #x
+// Default chunk size for arenas.
+#define ALLOC_ARENA_CHUNK 65536
+// Chunk size for arenas that are small and short-lived.
+#define ALLOC_ARENA_SMALL_CHUNK 4096
 
 // Initialises the alloc system thingy.
 void        alloc_init    ();
 
 // Creates a new memory allocation context.
 alloc_ctx_t alloc_create  (alloc_ctx_t parent);
+// Creates a new memory allocation context that allocates from chunks of at least chunk_size bytes.
+// Only the most recent allocation in an arena can be freed or grown in place;
+// other memory is freed all at once by alloc_clear or alloc_destroy.
+alloc_ctx_t alloc_create_arena(alloc_ctx_t parent, size_t chunk_size);
+// Sets the name of a context, as shown in allocation statistics.
+void        alloc_set_name(alloc_ctx_t ctx, const char *name);
 // Frees all memory of the context, recursively.
 void        alloc_clear   (alloc_ctx_t ctx);
 // Frees all memory of the context and destroys the context.
@@ -58,27 +153,34 @@ void       *alloc_on_ctx  (alloc_ctx_t ctx, size_t size);
 void       *realloc_on_ctx(alloc_ctx_t ctx, void  *memory, size_t size);
 // Frees memory belonging to a context.
 void        free_on_ctx   (alloc_ctx_t ctx, void  *memory);
+// Allocates memory belonging to a context, made from the call site tag.
+void       *alloc_on_ctx_at  (alloc_ctx_t ctx, size_t size, const char *tag);
+// Re-allocates memory belonging to a context, made from the call site tag.
+void       *realloc_on_ctx_at(alloc_ctx_t ctx, void  *memory, size_t size, const char *tag);
+
+#ifdef CTXALLOC_STATS
+// Prints the allocation statistics of all contexts, as a tree starting at global_alloc.
+// Destroyed contexts are listed by name under their parent.
+void        alloc_stats_dump();
+#endif
 
 #ifndef CTXALLOC_C
 
 // Allocates memory belonging to a context.
-static inline void *xalloc(alloc_ctx_t ctx, size_t size) {
-	return alloc_on_ctx(ctx, size);
-}
-
+#define xalloc(ctx, size)           alloc_on_ctx_at  ((ctx), (size), ALLOC_TAG)
 // Re-allocates memory belonging to a context.
-static inline void *xrealloc(alloc_ctx_t ctx, void *memory, size_t size) {
-	return realloc_on_ctx(ctx, memory, size);
-}
+#define xrealloc(ctx, memory, size) realloc_on_ctx_at((ctx), (memory), (size), ALLOC_TAG)
+// Strdup but with an allocator.
+#define xstrdup(ctx, memory)        xstrdup_at       ((ctx), (memory), ALLOC_TAG)
 
 // Frees memory belonging to a context.
 static inline void xfree(alloc_ctx_t ctx, void *memory) {
 	free_on_ctx(ctx, memory);
 }
 
-// Strdup but with an allocator.
-static inline char *xstrdup(alloc_ctx_t ctx, const char *memory) {
-	char *newmem = alloc_on_ctx(ctx, strlen(memory) + 1);
+// Strdup but with an allocator, made from the call site tag.
+static inline char *xstrdup_at(alloc_ctx_t ctx, const char *memory, const char *tag) {
+	char *newmem = alloc_on_ctx_at(ctx, strlen(memory) + 1, tag);
 	strcpy(newmem, memory);
 	return newmem;
 }
@@ -0,0 +1,133 @@
+
+#include "intern.h"
+#include "ctxalloc.h"
+#include "sync.h"
+#include <string.h>
+#include <stdbool.h>
+#include "ctxalloc_warn.h"
+
+// Initial number of slots in the intern table.
+#define INTERN_DEFAULT_CAPACITY 256
+// Size of the blocks interned strings are packed into.
+#define INTERN_BLOCK_SIZE       4096
+
+typedef struct {
+	uint32_t    hash;
+	uint32_t    len;
+	const char *str;
+} intern_entry_t;
+
+// Allocator for the table and strings, separate from global_alloc so the lexer thread can use it.
+static alloc_ctx_t     intern_alloc;
+
+// Open addressing table of interned strings.
+static intern_entry_t *intern_table;
+static size_t          intern_capacity;
+static size_t          intern_count;
+
+// Current block to pack strings into.
+static char           *intern_block;
+static size_t          intern_block_left;
+
+// FNV-1a hash of a string.
+static inline uint32_t intern_hash(const char *str, size_t len) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= (uint8_t) str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Find the slot for a string: either the matching entry or an empty slot.
+static inline intern_entry_t *intern_slot(const char *str, size_t len, uint32_t hash) {
+	size_t mask = intern_capacity - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		intern_entry_t *entry = &intern_table[i];
+		if (!entry->str) return entry;
+		if (entry->hash == hash && entry->len == len && !memcmp(entry->str, str, len)) return entry;
+	}
+}
+
+// Double the table's capacity.
+static void intern_grow() {
+	intern_entry_t *old     = intern_table;
+	size_t          old_cap = intern_capacity;
+	
+	if (!intern_alloc) {
+		intern_alloc = alloc_create(ALLOC_NO_PARENT);
+		alloc_set_name(intern_alloc, "intern");
+	}
+	intern_capacity = old_cap ? old_cap * 2 : INTERN_DEFAULT_CAPACITY;
+	intern_table    = xalloc(intern_alloc, sizeof(intern_entry_t) * intern_capacity);
+	memset(intern_table, 0, sizeof(intern_entry_t) * intern_capacity);
+	
+	// Re-insert the existing strings.
+	for (size_t i = 0; i < old_cap; i++) {
+		if (old[i].str) {
+			*intern_slot(old[i].str, old[i].len, old[i].hash) = old[i];
+		}
+	}
+	if (old) xfree(intern_alloc, old);
+}
+
+// Make a permanent copy of a string.
+static const char *intern_copy(const char *str, size_t len) {
+	if (len + 1 > INTERN_BLOCK_SIZE / 4) {
+		// Big strings get their own allocation.
+		char *copy = xalloc(intern_alloc, len + 1);
+		memcpy(copy, str, len);
+		copy[len] = 0;
+		return copy;
+	}
+	if (intern_block_left < len + 1) {
+		intern_block      = xalloc(intern_alloc, INTERN_BLOCK_SIZE);
+		intern_block_left = INTERN_BLOCK_SIZE;
+	}
+	char *copy = intern_block;
+	memcpy(copy, str, len);
+	copy[len] = 0;
+	intern_block      += len + 1;
+	intern_block_left -= len + 1;
+	return copy;
+}
+
+// Get the canonical copy of a NUL-terminated string, creating it if required.
+const char *intern(const char *str) {
+	return intern_n(str, strlen(str));
+}
+
+// Get the canonical copy of a string of given length, creating it if required.
+// The string need not be NUL-terminated.
+const char *intern_n(const char *str, size_t len) {
+	uint32_t hash = intern_hash(str, len);
+	sync_lock(&sync_mutex);
+	
+	// Keep the load factor under one half.
+	if (intern_count * 2 >= intern_capacity) intern_grow();
+	
+	intern_entry_t *entry = intern_slot(str, len, hash);
+	if (!entry->str) {
+		*entry = (intern_entry_t) {
+			.hash = hash,
+			.len  = len,
+			.str  = intern_copy(str, len),
+		};
+		intern_count ++;
+	}
+	const char *res = entry->str;
+	
+	sync_unlock(&sync_mutex);
+	return res;
+}
+
+// Get the canonical copy of a string, but only if one already exists.
+// Returns NULL if the string was never interned.
+const char *intern_find(const char *str) {
+	size_t   len  = strlen(str);
+	uint32_t hash = intern_hash(str, len);
+	sync_lock(&sync_mutex);
+	const char *res = intern_capacity ? intern_slot(str, len, hash)->str : NULL;
+	sync_unlock(&sync_mutex);
+	return res;
+}
@@ -0,0 +1,21 @@
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Interned strings have exactly one canonical copy per distinct spelling.
+// Two interned strings are equal if and only if their pointers are equal.
+// Interned strings live until the program exits and must not be modified.
+
+// Get the canonical copy of a NUL-terminated string, creating it if required.
+const char *intern(const char *str);
+// Get the canonical copy of a string of given length, creating it if required.
+// The string need not be NUL-terminated.
+const char *intern_n(const char *str, size_t len);
+// Get the canonical copy of a string, but only if one already exists.
+// Returns NULL if the string was never interned.
+const char *intern_find(const char *str);
+
+#endif // INTERN_H
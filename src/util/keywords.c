@@ -0,0 +1,113 @@
+
+#include "keywords.h"
+#include "ctxalloc.h"
+#include "sync.h"
+#include <string.h>
+#include <strings.h>
+#include "ctxalloc_warn.h"
+
+// Number of seeds to try before growing the slot count.
+#define KEYW_SEED_ATTEMPTS 256
+
+// Get the keyword string at a given index.
+static inline const char *keyw_string(keyw_table_t *table, size_t index) {
+	return *(const char *const *) ((const char *) table->strings + index * table->stride);
+}
+
+// Fold a character to lowercase if the table is case-insensitive.
+static inline uint8_t keyw_fold(keyw_table_t *table, char c) {
+	if (table->nocase && c >= 'A' && c <= 'Z') return c - 'A' + 'a';
+	return c;
+}
+
+// Seeded FNV-1a hash of a (possibly case folded) string.
+static inline uint32_t keyw_hash(keyw_table_t *table, uint32_t seed, const char *str, size_t len) {
+	uint32_t hash = 2166136261u ^ seed;
+	for (size_t i = 0; i < len; i++) {
+		hash ^= keyw_fold(table, str[i]);
+		hash *= 16777619u;
+	}
+	return hash ^ (hash >> 15);
+}
+
+// Compare a string to a keyword.
+static inline bool keyw_equals(keyw_table_t *table, const char *keyw, const char *str, size_t len) {
+	if (table->nocase) {
+		return !strncasecmp(keyw, str, len) && !keyw[len];
+	} else {
+		return !strncmp(keyw, str, len) && !keyw[len];
+	}
+}
+
+// Try to place all keywords using a given seed.
+// Returns true if there were no collisions.
+static bool keyw_try_seed(keyw_table_t *table, uint32_t seed) {
+	for (size_t i = 0; i <= table->mask; i++) {
+		table->slots[i] = -1;
+	}
+	for (size_t i = 0; i < table->num; i++) {
+		const char *keyw = keyw_string(table, i);
+		size_t      len  = strlen(keyw);
+		if (!len) continue;
+		size_t slot = keyw_hash(table, seed, keyw, len) & table->mask;
+		if (table->slots[slot] == -1) {
+			table->slots[slot] = i;
+		} else if (!keyw_equals(table, keyw_string(table, table->slots[slot]), keyw, len)) {
+			// Collision with a different keyword.
+			return false;
+		}
+	}
+	return true;
+}
+
+// Allocator for the slot arrays, separate from global_alloc so the lexer thread can use it.
+static alloc_ctx_t keyw_alloc;
+
+// Find a perfect hash for the table.
+static void keyw_build(keyw_table_t *table) {
+	if (!keyw_alloc) {
+		keyw_alloc = alloc_create(ALLOC_NO_PARENT);
+		alloc_set_name(keyw_alloc, "keywords");
+	}
+	
+	// Find the longest keyword.
+	table->max_len = 0;
+	for (size_t i = 0; i < table->num; i++) {
+		size_t len = strlen(keyw_string(table, i));
+		if (len > table->max_len) table->max_len = len;
+	}
+	
+	// Start at twice the number of keywords, rounded up to a power of two.
+	size_t n_slots = 2;
+	while (n_slots < table->num * 2) n_slots *= 2;
+	
+	while (1) {
+		table->mask  = n_slots - 1;
+		table->slots = xrealloc(keyw_alloc, table->slots, sizeof(int16_t) * n_slots);
+		for (uint32_t seed = 0; seed < KEYW_SEED_ATTEMPTS; seed++) {
+			if (keyw_try_seed(table, seed)) {
+				table->seed = seed;
+				return;
+			}
+		}
+		n_slots *= 2;
+	}
+}
+
+// Finds the index of a keyword, given a string that need not be NUL-terminated.
+// Empty keywords are never matched, and duplicates resolve to the first occurrence.
+// Returns -1 if the string is not a keyword.
+int keyw_lookup(keyw_table_t *table, const char *str, size_t len) {
+	if (!table->slots) {
+		// Tables are only ever used from one thread, but they share the allocator.
+		sync_lock(&sync_mutex);
+		keyw_build(table);
+		sync_unlock(&sync_mutex);
+	}
+	if (!len || len > table->max_len) return -1;
+	
+	// Every keyword has its own slot, so one comparison decides.
+	int index = table->slots[keyw_hash(table, table->seed, str, len) & table->mask];
+	if (index == -1 || !keyw_equals(table, keyw_string(table, index), str, len)) return -1;
+	return index;
+}
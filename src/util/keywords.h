@@ -0,0 +1,49 @@
+
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// A keyword lookup table, backed by a perfect hash.
+// The hash is found once, the first time the table is used.
+typedef struct keyw_table {
+	// The keyword strings, each `stride` bytes apart.
+	const char *const *strings;
+	size_t             stride;
+	size_t             num;
+	// Whether keywords match regardless of case.
+	bool               nocase;
+	// Length of the longest keyword.
+	size_t             max_len;
+	// Perfect hash parameters: seed and slot mask.
+	uint32_t           seed;
+	size_t             mask;
+	// Keyword index per slot, or -1 for empty slots.
+	int16_t           *slots;
+} keyw_table_t;
+
+// Table over an array of keyword strings.
+#define KEYW_TABLE(array, nocase_) { \
+		.strings = (const char *const *) (array), \
+		.stride  = sizeof((array)[0]), \
+		.num     = sizeof(array) / sizeof((array)[0]), \
+		.nocase  = (nocase_), \
+		.slots   = NULL, \
+	}
+// Table over the string field of an array of structs.
+#define KEYW_TABLE_FIELD(array, field, nocase_) { \
+		.strings = (const char *const *) &(array)[0].field, \
+		.stride  = sizeof((array)[0]), \
+		.num     = sizeof(array) / sizeof((array)[0]), \
+		.nocase  = (nocase_), \
+		.slots   = NULL, \
+	}
+
+// Finds the index of a keyword, given a string that need not be NUL-terminated.
+// Empty keywords are never matched, and duplicates resolve to the first occurrence.
+// Returns -1 if the string is not a keyword.
+int keyw_lookup(keyw_table_t *table, const char *str, size_t len);
+
+#endif // KEYWORDS_H
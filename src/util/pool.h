@@ -0,0 +1,72 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+#include <string.h>
+#include <ctxalloc.h>
+
+// Number of objects a pool takes from it's allocator at once.
+#define POOL_BLOCK 64
+
+#ifdef CTXALLOC_CHECKED
+// Checked builds overwrite freed objects, so that using them after they are freed shows.
+#define POOL_POISON(obj, size) memset(obj, 0xa5, size)
+#else
+#define POOL_POISON(obj, size) do {} while(0)
+#endif
+
+// Declares an object pool of Type, called Type_pool_t.
+// Objects freed to a pool are handed out again by the next allocation from it,
+// so that fixed-size objects which are made and dropped often don't each go through the allocator.
+// The objects belong to the allocator the pool was initialised with and are freed along with it.
+#define POOL_DECLARE(Type) \
+	typedef struct { \
+		/* Allocator new blocks of objects are taken from. */ \
+		alloc_ctx_t allocator; \
+		/* Freed objects, each storing a pointer to the next. */ \
+		void       *free; \
+	} Type##_pool_t; \
+	\
+	/* Initialise a pool of Type that takes it's memory from allocator. */ \
+	void  Type##_pool_init (Type##_pool_t *pool, alloc_ctx_t allocator); \
+	/* Allocate a Type from the pool. */ \
+	Type *Type##_pool_alloc(Type##_pool_t *pool); \
+	/* Return a Type to the pool. */ \
+	void  Type##_pool_free (Type##_pool_t *pool, Type *obj);
+
+// Defines the functions of a pool declared with POOL_DECLARE.
+// Must be used once, where Type is complete.
+#define POOL_DEFINE(Type) \
+	_Static_assert(sizeof(Type) >= sizeof(void *), "Pooled types must fit a pointer"); \
+	\
+	void Type##_pool_init(Type##_pool_t *pool, alloc_ctx_t allocator) { \
+		*pool = (Type##_pool_t) { \
+			.allocator = allocator, \
+			.free      = NULL, \
+		}; \
+	} \
+	\
+	Type *Type##_pool_alloc(Type##_pool_t *pool) { \
+		if (!pool->free) { \
+			/* Take a new block and put all of it in the free list. */ \
+			Type *block = xalloc(pool->allocator, sizeof(Type) * POOL_BLOCK); \
+			if (!block) return NULL; \
+			for (size_t i = 0; i < POOL_BLOCK - 1; i++) { \
+				*(void **) &block[i] = &block[i + 1]; \
+			} \
+			*(void **) &block[POOL_BLOCK - 1] = NULL; \
+			pool->free = block; \
+		} \
+		Type *obj  = pool->free; \
+		pool->free = *(void **) obj; \
+		return obj; \
+	} \
+	\
+	void Type##_pool_free(Type##_pool_t *pool, Type *obj) { \
+		if (!obj) return; \
+		POOL_POISON(obj, sizeof(Type)); \
+		*(void **) obj = pool->free; \
+		pool->free     = obj; \
+	}
+
+#endif //POOL_H
@@ -0,0 +1,183 @@
+
+#include "scan.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_HAS_AVX2
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// The things that can be scanned for.
+typedef enum {
+	// Stop at the first non-space character.
+	SCAN_SPACE,
+	// Stop at the first non-identifier character.
+	SCAN_IDENT,
+	// Stop at the first carriage return or line feed.
+	SCAN_EOL,
+	// Stop at the first "*/".
+	SCAN_BLOCK_END,
+} scan_kind_t;
+
+// Whether scanning stops at str[i].
+// Note: SCAN_BLOCK_END peeks at str[i+1], which must exist.
+static inline bool scan_stop(scan_kind_t kind, const char *str, size_t i) {
+	char c = str[i];
+	switch (kind) {
+		case SCAN_SPACE:
+			return !(c == ' ' || c == '\t' || c == '\r' || c == '\n');
+		case SCAN_IDENT:
+			return !((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_');
+		case SCAN_EOL:
+			return c == '\r' || c == '\n';
+		case SCAN_BLOCK_END:
+			return c == '*' && str[i+1] == '/';
+	}
+	return true;
+}
+
+// One character at a time, for the tail ends and for machines without SIMD.
+static inline size_t scan_scalar(scan_kind_t kind, const char *str, size_t len) {
+	// SCAN_BLOCK_END can't match at the last character.
+	size_t end = kind == SCAN_BLOCK_END && len ? len - 1 : len;
+	for (size_t i = 0; i < end; i++) {
+		if (scan_stop(kind, str, i)) return i;
+	}
+	return len;
+}
+
+
+#ifdef __SSE2__
+// Whether unsigned bytes lie in the range [lo, hi].
+static inline __attribute__((always_inline)) __m128i sse2_in_range(__m128i v, char lo, char hi) {
+	__m128i off = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+	return _mm_cmpeq_epi8(_mm_subs_epu8(off, _mm_set1_epi8(hi - lo)), _mm_setzero_si128());
+}
+
+// Bitmask of the 16 bytes at str where scanning stops.
+static inline __attribute__((always_inline)) uint32_t sse2_stop_mask(scan_kind_t kind, const char *str) {
+	__m128i v = _mm_loadu_si128((const __m128i *) str);
+	__m128i m;
+	switch (kind) {
+		case SCAN_SPACE:
+			m = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),  _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+				_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')))
+			);
+			return ~_mm_movemask_epi8(m) & 0xffff;
+		case SCAN_IDENT:
+			m = _mm_or_si128(
+				_mm_or_si128(sse2_in_range(v, '0', '9'), sse2_in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('_'))
+			);
+			return ~_mm_movemask_epi8(m) & 0xffff;
+		case SCAN_EOL:
+			m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+			return _mm_movemask_epi8(m);
+		case SCAN_BLOCK_END:
+			m = _mm_and_si128(
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('*')),
+				_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (str + 1)), _mm_set1_epi8('/'))
+			);
+			return _mm_movemask_epi8(m);
+	}
+	return 0;
+}
+
+// 16 characters at a time.
+static inline __attribute__((always_inline)) size_t scan_sse2(scan_kind_t kind, const char *str, size_t len) {
+	size_t i = 0;
+	// Leave one byte of room for SCAN_BLOCK_END to peek at.
+	for (; i + 17 <= len; i += 16) {
+		uint32_t mask = sse2_stop_mask(kind, str + i);
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_scalar(kind, str + i, len - i);
+}
+#endif // __SSE2__
+
+
+#ifdef SCAN_HAS_AVX2
+// Whether unsigned bytes lie in the range [lo, hi].
+static inline __attribute__((always_inline, target("avx2"))) __m256i avx2_in_range(__m256i v, char lo, char hi) {
+	__m256i off = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+	return _mm256_cmpeq_epi8(_mm256_subs_epu8(off, _mm256_set1_epi8(hi - lo)), _mm256_setzero_si256());
+}
+
+// Bitmask of the 32 bytes at str where scanning stops.
+static inline __attribute__((always_inline, target("avx2"))) uint32_t avx2_stop_mask(scan_kind_t kind, const char *str) {
+	__m256i v = _mm256_loadu_si256((const __m256i *) str);
+	__m256i m;
+	switch (kind) {
+		case SCAN_SPACE:
+			m = _mm256_or_si256(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),  _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')))
+			);
+			return ~(uint32_t) _mm256_movemask_epi8(m);
+		case SCAN_IDENT:
+			m = _mm256_or_si256(
+				_mm256_or_si256(avx2_in_range(v, '0', '9'), avx2_in_range(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'))
+			);
+			return ~(uint32_t) _mm256_movemask_epi8(m);
+		case SCAN_EOL:
+			m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+			return _mm256_movemask_epi8(m);
+		case SCAN_BLOCK_END:
+			m = _mm256_and_si256(
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')),
+				_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (str + 1)), _mm256_set1_epi8('/'))
+			);
+			return _mm256_movemask_epi8(m);
+	}
+	return 0;
+}
+
+// 32 characters at a time.
+static inline __attribute__((always_inline, target("avx2"))) size_t scan_avx2(scan_kind_t kind, const char *str, size_t len) {
+	size_t i = 0;
+	// Leave one byte of room for SCAN_BLOCK_END to peek at.
+	for (; i + 33 <= len; i += 32) {
+		uint32_t mask = avx2_stop_mask(kind, str + i);
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + scan_scalar(kind, str + i, len - i);
+}
+#endif // SCAN_HAS_AVX2
+
+
+// Define a scanner that picks the widest implementation the CPU supports.
+#if defined(SCAN_HAS_AVX2) && defined(__SSE2__)
+#define SCAN_DEFINE(name, kind) \
+	static __attribute__((target("avx2"))) size_t name##_avx2(const char *str, size_t len) { \
+		return scan_avx2(kind, str, len); \
+	} \
+	size_t name(const char *str, size_t len) { \
+		if (__builtin_cpu_supports("avx2")) return name##_avx2(str, len); \
+		return scan_sse2(kind, str, len); \
+	}
+#elif defined(__SSE2__)
+#define SCAN_DEFINE(name, kind) \
+	size_t name(const char *str, size_t len) { \
+		return scan_sse2(kind, str, len); \
+	}
+#else
+#define SCAN_DEFINE(name, kind) \
+	size_t name(const char *str, size_t len) { \
+		return scan_scalar(kind, str, len); \
+	}
+#endif
+
+// Find the length of the run of space characters (as in is_space) at the start of str.
+SCAN_DEFINE(scan_space,     SCAN_SPACE)
+// Find the length of the run of identifier characters (as in is_alphanumeric) at the start of str.
+SCAN_DEFINE(scan_ident,     SCAN_IDENT)
+// Find the first carriage return or line feed in str.
+SCAN_DEFINE(scan_eol,       SCAN_EOL)
+// Find the first "*/" in str, returning the offset of the '*'.
+SCAN_DEFINE(scan_block_end, SCAN_BLOCK_END)
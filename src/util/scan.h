@@ -0,0 +1,20 @@
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Bulk scanners over memory-resident source text.
+// These use SSE2 or AVX2 where available, and fall back to plain loops otherwise.
+// All of them return an offset into str, which is len if the scan ran off the end.
+
+// Find the length of the run of space characters (as in is_space) at the start of str.
+size_t scan_space(const char *str, size_t len);
+// Find the length of the run of identifier characters (as in is_alphanumeric) at the start of str.
+size_t scan_ident(const char *str, size_t len);
+// Find the first carriage return or line feed in str.
+size_t scan_eol(const char *str, size_t len);
+// Find the first "*/" in str, returning the offset of the '*'.
+size_t scan_block_end(const char *str, size_t len);
+
+#endif // SCAN_H
@@ -1,5 +1,6 @@
 
 #include <strmap.h>
+#include <intern.h>
 #include <malloc.h>
 #include <string.h>
 
@@ -9,6 +10,8 @@ void map_create(map_t *map) {
 	map->capacity = MAP_DEFAULT_CAPACITY;
 	map->strings = (char **) malloc(sizeof(char *) * map->capacity);
 	map->values = (const void **) malloc(sizeof(void *) * map->capacity);
+	map->slots = NULL;
+	map->numSlots = 0;
 }
 
 // Deletes a map.
@@ -17,6 +20,9 @@ void map_delete(map_t *map) {
 	map->capacity = 0;
 	free(map->strings);
 	free(map->values);
+	free(map->slots);
+	map->slots = NULL;
+	map->numSlots = 0;
 }
 
 // Deletes a map and every value.
@@ -27,21 +33,105 @@ void map_delete_with_values(map_t *map) {
 	map_delete(map);
 }
 
-// Finds key in map.
+// Hashes an interned key.
+// Equal keys are the same pointer, so the address is hashed instead of the contents.
+static inline uint32_t map_hash(const char *atom) {
+	return (uint64_t) (uintptr_t) atom * 0x9E3779B97F4A7C15ull >> 32;
+}
+
+// Distance of the slot at index from the slot its hash would like to be in.
+static inline size_t map_slot_dist(map_t *map, size_t index) {
+	return (index - map->slots[index].hash) & (map->numSlots - 1);
+}
+
+// Puts an entry in the hash index, which must have room for it.
+// Entries closer to their ideal slot make way for ones further from it (Robin Hood hashing),
+// which keeps probe sequences short and lets lookups of absent keys stop early.
+static void map_index_insert(map_t *map, uint32_t hash, uint32_t entry) {
+	size_t     mask = map->numSlots - 1;
+	map_slot_t cur  = { .hash = hash, .entry = entry };
+	size_t     dist = 0;
+	for (size_t i = hash & mask;; i = (i + 1) & mask, dist++) {
+		if (!map->slots[i].entry) {
+			map->slots[i] = cur;
+			return;
+		}
+		size_t other = map_slot_dist(map, i);
+		if (other < dist) {
+			map_slot_t tmp = map->slots[i];
+			map->slots[i]  = cur;
+			cur            = tmp;
+			dist           = other;
+		}
+	}
+}
+
+// (Re)builds the hash index with numSlots slots.
+static void map_index_build(map_t *map, size_t numSlots) {
+	free(map->slots);
+	map->numSlots = numSlots;
+	map->slots    = calloc(numSlots, sizeof(map_slot_t));
+	for (size_t i = 0; i < map->numEntries; i++) {
+		map_index_insert(map, map_hash(map->strings[i]), i + 1);
+	}
+}
+
+// Finds the slot of the hash index that refers to atom.
 // Returns -1 if not found.
-static inline int map_lkup(map_t *map, const char *key) {
-	for (int i = 0; i < map->numEntries; i++) {
-		if (!strcmp(map->strings[i], key)) {
+static inline ptrdiff_t map_index_find(map_t *map, const char *atom) {
+	uint32_t hash = map_hash(atom);
+	size_t   mask = map->numSlots - 1;
+	size_t   dist = 0;
+	for (size_t i = hash & mask;; i = (i + 1) & mask, dist++) {
+		map_slot_t *slot = &map->slots[i];
+		// Any entry with this key would have displaced a closer one.
+		if (!slot->entry || map_slot_dist(map, i) < dist) return -1;
+		if (slot->hash == hash && map->strings[slot->entry - 1] == atom) return i;
+	}
+}
+
+// Finds an interned key in map.
+// Returns -1 if not found.
+static inline ptrdiff_t map_lkup_atom(map_t *map, const char *atom) {
+	if (map->slots) {
+		ptrdiff_t slot = map_index_find(map, atom);
+		return slot < 0 ? -1 : (ptrdiff_t) map->slots[slot].entry - 1;
+	}
+	// Small maps are searched linearly, which is faster than hashing at this size.
+	for (size_t i = 0; i < map->numEntries; i++) {
+		if (map->strings[i] == atom) {
 			return i;
 		}
 	}
 	return -1;
 }
 
+// Finds key in map.
+// Returns -1 if not found.
+static inline ptrdiff_t map_lkup(map_t *map, const char *key) {
+	// Most keys are already interned, which makes this the only lookup needed.
+	ptrdiff_t i = map_lkup_atom(map, key);
+	if (i >= 0 || !map->numEntries) return i;
+	// Otherwise, the key may be a copy of an interned string.
+	const char *atom = intern_find(key);
+	return atom && atom != key ? map_lkup_atom(map, atom) : -1;
+}
+
 // Gets key from map.
 // Returns null if no such key.
 void *map_get(map_t *map, const char *key) {
-	int i = map_lkup(map, key);
+	ptrdiff_t i = map_lkup(map, key);
+	if (i >= 0) {
+		return (void *) map->values[i];
+	} else {
+		return 0;
+	}
+}
+
+// Gets an interned key from map, without consulting the intern table.
+// Returns null if no such key.
+void *map_get_atom(map_t *map, const char *atom) {
+	ptrdiff_t i = map_lkup_atom(map, atom);
 	if (i >= 0) {
 		return (void *) map->values[i];
 	} else {
@@ -52,24 +142,38 @@ void *map_get(map_t *map, const char *key) {
 // Puts val in map at key.
 // Providing null for val removes the item.
 // Returns null or replaced item.
-// Will copy the provided string.
+// Will intern the provided string.
 // Will NOT copy the provided item.
 void *map_set(map_t *map, const char *key, const void *val) {
 	if (!val) return map_remove(map, key);
-	int i = map_lkup(map, key);
+	ptrdiff_t i    = map_lkup_atom(map, key);
+	char     *atom = (char *) key;
+	if (i < 0) {
+		// Not present under this pointer; the key may still be a copy of one that is.
+		atom = (char *) intern(key);
+		if (atom != key) i = map_lkup_atom(map, atom);
+	}
 	if (i >= 0) {
 		void *ret = (void *) map->values[i];
 		map->values[i] = val;
 		return ret;
 	} else {
 		if (map->numEntries >= map->capacity) {
-			map->capacity += MAP_CAPACITY_INCREMENT;
+			map->capacity *= 2;
 			map->strings = realloc(map->strings, sizeof(char *) * map->capacity);
 			map->values = realloc(map->values, sizeof(void *) * map->capacity);
 		}
-		map->strings[map->numEntries] = strdup(key);
+		map->strings[map->numEntries] = atom;
 		map->values[map->numEntries] = val;
 		map->numEntries ++;
+		if (map->slots && map->numEntries * 4 <= map->numSlots * 3) {
+			map_index_insert(map, map_hash(atom), map->numEntries);
+		} else if (map->slots) {
+			// Keep the index at most three quarters full.
+			map_index_build(map, map->numSlots * 2);
+		} else if (map->numEntries > MAP_LINEAR_MAX) {
+			map_index_build(map, MAP_LINEAR_MAX * 4);
+		}
 		return NULL;
 	}
 }
@@ -77,19 +181,34 @@ void *map_set(map_t *map, const char *key, const void *val) {
 // Removes key from map.
 // Returns null or removed item.
 void *map_remove(map_t *map, const char *key) {
-	int i = map_lkup(map, key);
-	if (i >= 0) {
-		free(map->strings[i]);
-		void *ret = (void *) map->values[i];
-		map->numEntries --;
-		if (i != map->numEntries) {
-			map->strings[i] = map->strings[map->numEntries];
-			map->values[i] = map->values[map->numEntries];
+	ptrdiff_t i = map_lkup(map, key);
+	if (i < 0) return NULL;
+	size_t last = map->numEntries - 1;
+	
+	if (map->slots) {
+		// Shift the following displaced slots back to fill the hole.
+		ptrdiff_t slot = map_index_find(map, map->strings[i]);
+		size_t    mask = map->numSlots - 1;
+		size_t    next = (slot + 1) & mask;
+		while (map->slots[next].entry && map_slot_dist(map, next)) {
+			map->slots[slot] = map->slots[next];
+			slot = next;
+			next = (next + 1) & mask;
+		}
+		map->slots[slot] = (map_slot_t) { .hash = 0, .entry = 0 };
+		
+		// The last entry is about to move into the gap.
+		if ((size_t) i != last) {
+			map->slots[map_index_find(map, map->strings[last])].entry = i + 1;
 		}
-		return ret;
-	} else {
-		return NULL;
 	}
+	
+	// Fill the gap with the last entry.
+	void *ret = (void *) map->values[i];
+	map->strings[i] = map->strings[last];
+	map->values[i]  = map->values[last];
+	map->numEntries --;
+	return ret;
 }
 
 // Dumps the map for debug purposes.
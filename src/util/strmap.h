@@ -5,15 +5,32 @@
 #include <stdint.h>
 #include <stddef.h>
 
+// A slot in the hash index of a map.
+typedef struct map_slot {
+	// Hash of the key, cached so probing need not look at the entries.
+	uint32_t hash;
+	// Index of the entry plus one, or 0 if the slot is empty.
+	uint32_t entry;
+} map_slot_t;
+
+// Keys are interned (see intern.h), so lookups hash and compare keys by pointer.
+// Entries are kept in insertion order in strings and values, which may be iterated over directly;
+// removing an entry moves the last entry into its place.
+// Larger maps find their entries through an open-addressing (Robin Hood) hash index.
 typedef struct map {
 	size_t numEntries;
 	size_t capacity;
 	char **strings;
 	const void **values;
+	// Hash index; NULL while the map is small enough to search linearly.
+	map_slot_t *slots;
+	// Number of slots, a power of two.
+	size_t numSlots;
 } map_t;
 
 #define MAP_DEFAULT_CAPACITY 4
-#define MAP_CAPACITY_INCREMENT 4
+// Maps with more entries than this get a hash index.
+#define MAP_LINEAR_MAX 8
 
 // Creates an empty map.
 void map_create(map_t *map);
@@ -28,10 +45,14 @@ void map_delete_with_values(map_t *map);
 // Returns null if no such key.
 void *map_get(map_t *map, const char *key);
 
+// Gets an interned key from map, without consulting the intern table.
+// Returns null if no such key.
+void *map_get_atom(map_t *map, const char *atom);
+
 // Puts val in map at key.
 // Providing null for val removes the item.
 // Returns null or replaced item.
-// Does not copy the provided item.
+// Interns the key, but does not copy the provided item.
 void *map_set(map_t *map, const char *key, const void *val);
 
 // Removes key from map.
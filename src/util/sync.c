@@ -0,0 +1,9 @@
+
+#include "sync.h"
+
+// Whether more than one thread may currently be using shared compiler state.
+// Only changed while no other threads are running.
+bool            sync_enabled = false;
+// Guards state shared between the lexer and parser threads:
+// interned strings, source locations and keyword tables.
+pthread_mutex_t sync_mutex   = PTHREAD_MUTEX_INITIALIZER;
@@ -0,0 +1,20 @@
+
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+// Whether more than one thread may currently be using shared compiler state.
+// Only changed while no other threads are running.
+extern bool            sync_enabled;
+// Guards state shared between the lexer and parser threads:
+// interned strings, source locations and keyword tables.
+extern pthread_mutex_t sync_mutex;
+
+// Lock a mutex, but only if other threads may be running.
+#define sync_lock(mutex)   do { if (sync_enabled) pthread_mutex_lock(mutex);   } while (0)
+// Unlock a mutex locked by sync_lock.
+#define sync_unlock(mutex) do { if (sync_enabled) pthread_mutex_unlock(mutex); } while (0)
+
+#endif // SYNC_H
@@ -0,0 +1,6 @@
+
+// Indexing a constant by a constant is a plain memory access;
+// with int being one word, this writes 3 to address 3.
+void index_const() {
+	1[2] = 3;
+}
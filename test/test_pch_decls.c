@@ -0,0 +1,20 @@
+
+// Declarations for test_pch_use.c, which only sees them through a snapshot:
+//   comp --pch-out=decls.pch test/test_pch_decls.c
+//   comp --pch-in=decls.pch test/test_pch_use.c
+
+int add(int a, int b) {
+	return a + b;
+}
+
+unsigned char first(char *str);
+
+int sum(int *arr, int len) {
+	int total = 0;
+	for (int i = 0; i < len; i++) {
+		total += arr[i];
+	}
+	return total;
+}
+
+void nothing();
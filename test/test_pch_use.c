@@ -0,0 +1,11 @@
+
+// Uses the functions of test_pch_decls.c, loaded from a snapshot of it.
+
+int main() {
+	int arr[3];
+	arr[0] = add(1, 2);
+	arr[1] = first("x");
+	arr[2] = 4;
+	nothing();
+	return sum(arr, 3);
+}
@@ -0,0 +1,39 @@
+
+// Headers reached through different paths are only read once.
+#include "test_preproc_once.h"
+#include "./test_preproc_once.h"
+#include "test_preproc_guard.h"
+#include "./test_preproc_guard.h"
+
+// Stringizing and pasting.
+#define str(a)       # a
+#define xstr(a)      str(a)
+#define cat(a, b)    a ## b
+#define hash_hash    # ## #
+#define in_between(a) str(a)
+#define join(c, d)   in_between(c hash_hash d)
+
+// Arithmetic in conditionals.
+#define WIDTH 16
+#if (1 << 4) != WIDTH || -1 >= 0 || 7 / 2 != 3 || 7 % 4 != 3
+#error "Wrong #if arithmetic"
+#endif
+#if !defined(WIDTH) || defined(HEIGHT) || !(WIDTH > 8)
+#error "Wrong defined()"
+#elif WIDTH == 16 && (0 || 2)
+#define CHECKED 1
+#else
+#error "Wrong #elif"
+#endif
+
+char *stringized = xstr(WIDTH);
+char *hashes     = join(x, y);
+
+int main() {
+	int recurse = 0;
+	int cat(value, 2) = once_value() + guard_value();
+	
+	// A macro doesn't expand inside itself.
+	#define recurse recurse + 1
+	return value2 + CHECKED + recurse;
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_PREPROC_GUARD_H
+#define TEST_PREPROC_GUARD_H
+
+// Defining this twice is an error, so the guard must skip this file the second time.
+int guard_value() {
+	return 2;
+}
+
+#endif //TEST_PREPROC_GUARD_H
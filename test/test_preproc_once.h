@@ -0,0 +1,6 @@
+#pragma once
+
+// Defining this twice is an error, so this file must only be read once.
+int once_value() {
+	return 1;
+}